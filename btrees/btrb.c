@@ -90,69 +90,85 @@ void btrb_transplant(btrb_node_t **root, btrb_node_t *u, btrb_node_t *v)
         } else {
                 u->parent->right = v;
         }
-        v->parent = u->parent;
+        /* the nil node is shared by all trees, never write to it, so that
+         * independent trees can be modified concurrently */
+        if (v != &nil_node) {
+                v->parent = u->parent;
+        }
 }
 
 
-void btrb_delete_fixup(btrb_node_t **root, btrb_node_t *x)
+static void delete_fixup(btrb_node_t **root, btrb_node_t *x, btrb_node_t *xp)
 {
+        /* xp is the parent of x, which is tracked separately, since x may be
+         * the nil node */
         if (*root == &nil_node) {
                 return;
         }
         while (x != *root && x->color == BLACK) {
-                if (x == x->parent->left) {
-                        btrb_node_t *w = x->parent->right;
+                if (x == xp->left) {
+                        btrb_node_t *w = xp->right;
                         if (w->color == RED) {
-                                w->color         = BLACK;
-                                x->parent->color = RED;
-                                btrb_left_rotate(root, x->parent);
-                                w = x->parent->right;
+                                w->color  = BLACK;
+                                xp->color = RED;
+                                btrb_left_rotate(root, xp);
+                                w = xp->right;
                         }
                         if (w->left->color == BLACK &&
                             w->right->color == BLACK) {
                                 w->color = RED;
-                                x        = x->parent;
+                                x        = xp;
+                                xp       = x->parent;
                         } else {
                                 if (w->right->color == BLACK) {
                                         w->left->color = BLACK;
                                         w->color       = RED;
                                         btrb_right_rotate(root, w);
-                                        w = x->parent->right;
+                                        w = xp->right;
                                 }
-                                w->color         = x->parent->color;
-                                x->parent->color = BLACK;
-                                w->right->color  = BLACK;
-                                btrb_left_rotate(root, x->parent);
+                                w->color        = xp->color;
+                                xp->color       = BLACK;
+                                w->right->color = BLACK;
+                                btrb_left_rotate(root, xp);
                                 x = *root;
                         }
                 } else {
-                        btrb_node_t *w = x->parent->left;
+                        btrb_node_t *w = xp->left;
                         if (w->color == RED) {
-                                w->color         = BLACK;
-                                x->parent->color = RED;
-                                btrb_right_rotate(root, x->parent);
-                                w = x->parent->left;
+                                w->color  = BLACK;
+                                xp->color = RED;
+                                btrb_right_rotate(root, xp);
+                                w = xp->left;
                         }
                         if (w->right->color == BLACK &&
                             w->left->color == BLACK) {
                                 w->color = RED;
-                                x        = x->parent;
+                                x        = xp;
+                                xp       = x->parent;
                         } else {
                                 if (w->left->color == BLACK) {
                                         w->right->color = BLACK;
                                         w->color        = RED;
                                         btrb_left_rotate(root, w);
-                                        w = x->parent->left;
+                                        w = xp->left;
                                 }
-                                w->color         = x->parent->color;
-                                x->parent->color = BLACK;
-                                w->left->color   = BLACK;
-                                btrb_right_rotate(root, x->parent);
+                                w->color       = xp->color;
+                                xp->color      = BLACK;
+                                w->left->color = BLACK;
+                                btrb_right_rotate(root, xp);
                                 x = *root;
                         }
                 }
         }
-        x->color = BLACK;
+        if (x != &nil_node) {
+                x->color = BLACK;
+        }
+}
+
+
+void btrb_delete_fixup(btrb_node_t **root, btrb_node_t *x)
+{
+        delete_fixup(root, x, x->parent);
 }
 
 
@@ -169,21 +185,28 @@ void btrb_delete(btrb_node_t **root, btrb_node_t *z)
 {
         btrb_node_t *y = z;
         btrb_node_t *x;
+        btrb_node_t *xp;
         bt_color_t y_original_color = y->color;
 
         if (z->left == &nil_node) {
-                x = z->right;
+                x  = z->right;
+                xp = z->parent;
                 btrb_transplant(root, z, z->right);
         } else if (z->right == &nil_node) {
-                x = z->left;
+                x  = z->left;
+                xp = z->parent;
                 btrb_transplant(root, z, z->left);
         } else {
                 y                = tree_minimum(z->right);
                 y_original_color = y->color;
                 x                = y->right;
                 if (y->parent == z) {
-                        x->parent = y;
+                        xp = y;
+                        if (x != &nil_node) {
+                                x->parent = y;
+                        }
                 } else {
+                        xp = y->parent;
                         btrb_transplant(root, y, y->right);
                         y->right         = z->right;
                         y->right->parent = y;
@@ -194,7 +217,7 @@ void btrb_delete(btrb_node_t **root, btrb_node_t *z)
                 y->color        = z->color;
         }
         if (y_original_color == BLACK) {
-                btrb_delete_fixup(root, x);
+                delete_fixup(root, x, xp);
         }
 }
 
@@ -422,7 +445,7 @@ btrb_node_t *btrb_next_smaller(btrb_node_t *node)
 
         if (!btrb_is_nil(tmp->left)) {
                 tmp = tmp->left;
-                while (!btrb_is_nil(tmp->left)) {
+                while (!btrb_is_nil(tmp->right)) {
                         tmp = tmp->right;
                 }
                 return tmp;
@@ -66,6 +66,17 @@ void btrbc_init(btrbc_ctx_t *ctx, btrbc_node_t **root, uintptr_t base,
 }
 
 
+void btrbc_attach(btrbc_ctx_t *ctx, btrbc_node_t **root, uintptr_t base,
+                  btrbc_node_t *nil_node)
+{
+        /* same as btrbc_init, but for an already existing tree, e.g. one
+         * that lives in memory mapped by another process */
+        ctx->base = base;
+        ctx->nil  = P32(nil_node);
+        ctx->root = root;
+}
+
+
 btrbc_node_t *btrbc_nil(btrbc_ctx_t *ctx)
 {
         return P64(ctx->nil);
@@ -455,7 +466,7 @@ btrbc_node_t *btrbc_next_smaller(btrbc_ctx_t *ctx, btrbc_node_t *node)
 
         if (!btrbc_is_nil(ctx, P64(tmp->left))) {
                 tmp = P64(tmp->left);
-                while (!btrbc_is_nil(ctx, P64(tmp->left))) {
+                while (!btrbc_is_nil(ctx, P64(tmp->right))) {
                         tmp = P64(tmp->right);
                 }
                 return tmp;
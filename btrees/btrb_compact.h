@@ -62,6 +62,8 @@ typedef void (*btrbc_iterator_cb)(btrbc_node_t *node);
 
 void btrbc_init(btrbc_ctx_t *ctx, btrbc_node_t **root, uintptr_t base,
                 btrbc_node_t *nil_node);
+void btrbc_attach(btrbc_ctx_t *ctx, btrbc_node_t **root, uintptr_t base,
+                  btrbc_node_t *nil_node);
 
 btrbc_node_t *btrbc_nil(btrbc_ctx_t *ctx);
 void btrbc_delete(btrbc_ctx_t *ctx, btrbc_node_t *v);
@@ -1,6 +1,7 @@
 #include "btrb.h"
 #include "btrb_compact.h"
 #include <stdio.h>
+#include <string.h>
 
 #define CHECK(x, s)                         \
         {                                   \
@@ -165,6 +166,42 @@ int main(void)
         CHECK(tmp == &nodes[3], "min_at_least(7) == 7 ...");
 
 
+        /* 10 has a left child 5 whose only child is 7 on the right, the
+         * predecessor of 10 is found by descending the right spine of 5 */
+        root = NULL;
+        btrb_insert(&root, 10, NULL, &nodes[0]);
+        btrb_insert(&root, 5, NULL, &nodes[1]);
+        btrb_insert(&root, 15, NULL, &nodes[2]);
+        btrb_insert(&root, 7, NULL, &nodes[3]);
+        CHECK(root == &nodes[0] && root->left == &nodes[1] &&
+                  btrb_is_nil(nodes[1].left) && nodes[1].right == &nodes[3],
+              "Tree 10 (5 (-, 7), 15)...");
+        tmp = &nodes[2];
+        CHECK((tmp = btrb_next_smaller(tmp)) == &nodes[0],
+              "... next smaller of 15 == 10 ...");
+        CHECK((tmp = btrb_next_smaller(tmp)) == &nodes[3],
+              "... next smaller of 10 == 7 ...");
+        CHECK((tmp = btrb_next_smaller(tmp)) == &nodes[1],
+              "... next smaller of 7 == 5 ...");
+        CHECK((tmp = btrb_next_smaller(tmp)) == NULL,
+              "... next smaller of 5 == NULL ...");
+
+        /* the nil node is shared by all trees, deletes must not write it.
+         * Delete a node with a nil child from a tree that stays non-empty */
+        btrb_node_t nil_before = *btrb_nil();
+        btrb_delete(&root, &nodes[2]);
+        CHECK(root == &nodes[3] && btrb_search(&root, 15) == NULL,
+              "Delete leaf 15...");
+        CHECK(!memcmp(&nil_before, btrb_nil(), sizeof(btrb_node_t)),
+              "... and nil node is untouched...");
+        btrb_delete(&root, &nodes[1]);
+        btrb_delete(&root, &nodes[3]);
+        CHECK(!memcmp(&nil_before, btrb_nil(), sizeof(btrb_node_t)),
+              "... also after deleting 5 and 7...");
+        btrb_delete(&root, &nodes[0]);
+        CHECK(btrb_is_nil(root), "Delete last node...");
+
+
         printf("Testing compact tree with 32-bit internal pointers...\n");
 
 
@@ -328,5 +365,24 @@ int main(void)
         ctmp = btrbc_min_at_least(&ctx, 7);
         CHECK(ctmp == &static_mem[4], "min_at_least(7) == 7...");
 
+        btrbc_init(&ctx, &croot, (uintptr_t)static_mem, &static_mem[0]);
+        btrbc_insert(&ctx, 10, NULL, &static_mem[1]);
+        btrbc_insert(&ctx, 5, NULL, &static_mem[2]);
+        btrbc_insert(&ctx, 15, NULL, &static_mem[3]);
+        btrbc_insert(&ctx, 7, NULL, &static_mem[4]);
+        CHECK(croot == &static_mem[1] && croot->left == P32(&static_mem[2]) &&
+                  static_mem[2].left == ctx.nil &&
+                  static_mem[2].right == P32(&static_mem[4]),
+              "Tree 10 (5 (-, 7), 15)...");
+        ctmp = &static_mem[3];
+        CHECK((ctmp = btrbc_next_smaller(&ctx, ctmp)) == &static_mem[1],
+              "... next smaller of 15 == 10");
+        CHECK((ctmp = btrbc_next_smaller(&ctx, ctmp)) == &static_mem[4],
+              "... next smaller of 10 == 7");
+        CHECK((ctmp = btrbc_next_smaller(&ctx, ctmp)) == &static_mem[2],
+              "... next smaller of 7 == 5");
+        CHECK((ctmp = btrbc_next_smaller(&ctx, ctmp)) == NULL,
+              "... next smaller of 5 == NULL");
+
         return 0;
 }
@@ -27,6 +27,13 @@ SOFTWARE.
 #include <stdlib.h>
 #include "heapm.h"
 
+#ifdef _WIN32
+#        include <windows.h>
+#else
+#        include <sys/mman.h>
+#        include <unistd.h>
+#endif
+
 
 #ifdef HEAPM_USE_MUTEX_X
 #        define MUTEX_LOCK   xmutex_lock(&ctx->lock)
@@ -90,6 +97,8 @@ static void fblock_remove(hm_ctx_t *ctx, hm_pfx_t *pfx)
                 btrb_insert(&ctx->ftree_root, pfx->fblock.next->size,
                             pfx->fblock.next, FBLOCK_TO_NODE(pfx->fblock.next));
                 pfx->fblock.next->in_tree = true;
+                pfx->fblock.next->prev    = NULL;
+                pfx->fblock.next          = NULL;
         }
 }
 
@@ -112,6 +121,9 @@ static void fblock_chain_push(hm_pfx_t *pfx, hm_fblock_t *fblock)
         pfx->fblock.next  = fblock;
         fblock->prev      = &pfx->fblock;
         fblock->next      = next;
+        if (next) {
+                next->prev = fblock;
+        }
 }
 
 
@@ -148,6 +160,8 @@ void hm_init(hm_ctx_t *ctx, void *base, size_t size)
         MUTEX_LOCK;
         ctx->mem_start = base;
         ctx->mem_size  = size;
+        ctx->regions   = NULL;
+        ctx->grow_size = 0;
 
         /* reserve space for ftree and atree roots, with corresponding block
          * information */
@@ -168,36 +182,199 @@ void hm_init(hm_ctx_t *ctx, void *base, size_t size)
 }
 
 
-#ifndef HEAPM_MALLOC_LINE_STORE
-void *hm_alloc(hm_ctx_t *ctx, size_t size)
+static void region_add(hm_ctx_t *ctx, void *base, size_t size, bool mapped)
 {
-        return hm_aligned_alloc(ctx, size, 0);
+        /* every additional region starts with its own root block, which
+         * carries the region descriptor as its user area. Since the root block
+         * has the lowest address of the region, the adjacent preceding
+         * allocated block of any block in the region is always found inside
+         * the same region, so both trees can simply span all regions */
+
+        hm_pfx_t *root_pfx  = (hm_pfx_t *)base;
+        hm_region_t *region = (hm_region_t *)(root_pfx + 1);
+        size_t root_size    = sizeof(hm_pfx_t) + sizeof(hm_region_t);
+
+        region->base   = (uintptr_t)base;
+        region->size   = size;
+        region->mapped = mapped;
+        region->next   = ctx->regions;
+        ctx->regions   = region;
+
+        root_pfx->abase = (uintptr_t)base;
+        root_pfx->asize = root_size;
+        btrb_insert(&ctx->atree_root, (uintptr_t)base, root_pfx,
+                    &root_pfx->anode);
+
+        fblock_add(ctx, root_pfx, (uintptr_t)base + root_size,
+                   size - root_size);
+}
+
+
+static bool region_is_empty(hm_region_t *region)
+{
+        hm_pfx_t *root_pfx = (hm_pfx_t *)region->base;
+
+        return root_pfx->fblock.size == region->size - root_pfx->asize;
 }
+
+
+static size_t region_page_size(void)
+{
+#ifdef _WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return si.dwAllocationGranularity;
+#else
+        return sysconf(_SC_PAGESIZE);
 #endif
+}
 
 
-#ifdef HEAPM_MALLOC_LINE_STORE
-void *hm_aligned_alloc_d(hm_ctx_t *ctx, size_t size, size_t align,
-                         uint32_t line)
+static void *region_map(size_t size)
+{
+#ifdef _WIN32
+        return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT,
+                            PAGE_READWRITE);
 #else
-void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align)
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? NULL : p;
 #endif
+}
+
+
+static void region_unmap(void *base, size_t size)
 {
-        if (!size) {
-                /* would be possible, but doesn't make sense */
-                return NULL;
+#ifdef _WIN32
+        (void)size;
+        VirtualFree(base, 0, MEM_RELEASE);
+#else
+        munmap(base, size);
+#endif
+}
+
+
+static void region_release(hm_ctx_t *ctx, hm_region_t **link)
+{
+        hm_region_t *region = *link;
+        hm_pfx_t *root_pfx  = (hm_pfx_t *)region->base;
+
+        /* the region is empty, so the root block's fblock spans all of it */
+        fblock_remove(ctx, root_pfx);
+        btrb_delete(&ctx->atree_root, &root_pfx->anode);
+
+        *link = region->next;
+
+        if (region->mapped) {
+                region_unmap((void *)region->base, region->size);
         }
+}
+
+
+static bool region_grow(hm_ctx_t *ctx, size_t size, size_t align)
+{
+        /* worst case: region root, allocation prefix and full alignment
+         * padding */
+        size_t need = size + align + 2 * sizeof(hm_pfx_t) + sizeof(hm_region_t);
+        size_t page = region_page_size();
+        size_t rsize = need > ctx->grow_size ? need : ctx->grow_size;
+
+        rsize = (rsize + page - 1) & ~(page - 1);
+
+        void *base = region_map(rsize);
+        if (!base) {
+                return false;
+        }
+
+        region_add(ctx, base, rsize, true);
+        return true;
+}
 
-        /* add size of prefix to size */
-        size_t rsize = size + sizeof(hm_pfx_t);
 
+int hm_add_region(hm_ctx_t *ctx, void *base, size_t size)
+{
+        if (size <= 2 * sizeof(hm_pfx_t) + sizeof(hm_region_t)) {
+                return -1;
+        }
+
+        MUTEX_LOCK;
+        region_add(ctx, base, size, false);
+        MUTEX_UNLOCK;
+        return 0;
+}
+
+
+int hm_remove_region(hm_ctx_t *ctx, void *base)
+{
         MUTEX_LOCK;
 
+        hm_region_t **link = &ctx->regions;
+        while (*link) {
+                if ((*link)->base == (uintptr_t)base) {
+                        if (!region_is_empty(*link)) {
+                                break;
+                        }
+                        region_release(ctx, link);
+                        MUTEX_UNLOCK;
+                        return 0;
+                }
+                link = &(*link)->next;
+        }
+
+        MUTEX_UNLOCK;
+        return -1;
+}
+
+
+void hm_set_grow(hm_ctx_t *ctx, size_t grow_size)
+{
+        MUTEX_LOCK;
+        ctx->grow_size = grow_size;
+        MUTEX_UNLOCK;
+}
+
+
+size_t hm_trim(hm_ctx_t *ctx)
+{
+        /* give all empty mapped regions back to the OS, caller supplied
+         * regions must be removed explicitly with hm_remove_region */
+        size_t released = 0;
+
+        MUTEX_LOCK;
+
+        hm_region_t **link = &ctx->regions;
+        while (*link) {
+                if ((*link)->mapped && region_is_empty(*link)) {
+                        released += (*link)->size;
+                        region_release(ctx, link);
+                        continue;
+                }
+                link = &(*link)->next;
+        }
+
+        MUTEX_UNLOCK;
+        return released;
+}
+
+
+#ifndef HEAPM_MALLOC_LINE_STORE
+void *hm_alloc(hm_ctx_t *ctx, size_t size)
+{
+        return hm_aligned_alloc(ctx, size, 0);
+}
+#endif
+
+
+static void *aligned_alloc_locked(hm_ctx_t *ctx, size_t size, size_t align,
+                                  uint32_t line)
+{
+        /* add size of prefix to size */
+        size_t rsize = size + sizeof(hm_pfx_t);
+
         btrb_node_t *fnode = btrb_min_at_least(&ctx->ftree_root, rsize);
 
-        if (!fnode) {
+        if (!fnode || btrb_is_nil(fnode)) {
                 /* we are out of memory */
-                MUTEX_UNLOCK;
                 return NULL;
         }
 
@@ -208,49 +385,53 @@ void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align)
         if (align > 1) {
                 /* create alignment mask for address */
                 uint64_t mask = align - 1;
-                uint64_t addr_remainder =
-                    (fblock->base + sizeof(hm_pfx_t)) & mask;
-
-                if (addr_remainder == 0) {
-                        goto already_aligned;
-                }
 
-                alignment_padding = align - addr_remainder;
-                rsize += alignment_padding;
+                /* the padding depends on the block's base, so it must be
+                 * recalculated for every candidate block. Equally sized free
+                 * blocks share one tree node and only differ in their base,
+                 * so the whole chain of a node is tried before the next */
+                while (1) {
+                        for (fblock = (hm_fblock_t *)fnode->user_data; fblock;
+                             fblock = fblock->next) {
+                                uint64_t addr_remainder =
+                                    (fblock->base + sizeof(hm_pfx_t)) & mask;
+                                alignment_padding =
+                                    addr_remainder ? align - addr_remainder : 0;
+
+                                if (fblock->size >= rsize + alignment_padding) {
+                                        break;
+                                }
+                        }
+                        if (fblock) {
+                                break;
+                        }
 
-                while (fnode->val < rsize) {
                         fnode = btrb_next_larger(fnode);
-
                         if (!fnode) {
-                                MUTEX_UNLOCK;
                                 return NULL;
                         }
                 }
 
-                fblock = (hm_fblock_t *)fnode->user_data;
-
-                addr_remainder    = (fblock->base + sizeof(hm_pfx_t)) & mask;
-                alignment_padding = align - addr_remainder;
+                rsize += alignment_padding;
         }
 
-already_aligned:
-
         /* create new pfx and store allocation info */
         hm_pfx_t *new_pfx = (hm_pfx_t *)fblock->base;
 
         new_pfx->abase = fblock->base;
         new_pfx->asize = rsize;
 
-        new_pfx->fblock.base = 0;
-        new_pfx->fblock.size = 0;
-        new_pfx->fblock.next = NULL;
-        new_pfx->fblock.prev = NULL;
+        new_pfx->fblock.base    = new_pfx->abase + rsize;
+        new_pfx->fblock.size    = 0;
+        new_pfx->fblock.next    = NULL;
+        new_pfx->fblock.prev    = NULL;
+        new_pfx->fblock.in_tree = false;
 
         if (fblock->size - rsize) {
                 fblock_add(ctx, new_pfx, fblock->base + rsize,
                            fblock->size - rsize);
         }
-        fblock_remove(ctx, FNODE_TO_PFX(fnode));
+        fblock_remove(ctx, FNODE_TO_PFX(FBLOCK_TO_NODE(fblock)));
         btrb_insert(&ctx->atree_root, new_pfx->abase, new_pfx, &new_pfx->anode);
 
         /* The trick here is to store the padding value padded as well, directly
@@ -264,12 +445,42 @@ already_aligned:
 
 #ifdef HEAPM_MALLOC_LINE_STORE
         new_pfx->malloc_line = line;
+#else
+        (void)line;
 #endif
 
-        MUTEX_UNLOCK;
         return (void *)(new_pfx->abase + sizeof(hm_pfx_t) + alignment_padding);
 }
 
+
+#ifdef HEAPM_MALLOC_LINE_STORE
+void *hm_aligned_alloc_d(hm_ctx_t *ctx, size_t size, size_t align,
+                         uint32_t line)
+#else
+void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align)
+#endif
+{
+#ifndef HEAPM_MALLOC_LINE_STORE
+        uint32_t line = 0;
+#endif
+
+        if (!size) {
+                /* would be possible, but doesn't make sense */
+                return NULL;
+        }
+
+        MUTEX_LOCK;
+
+        void *p = aligned_alloc_locked(ctx, size, align, line);
+
+        if (!p && ctx->grow_size && region_grow(ctx, size, align)) {
+                p = aligned_alloc_locked(ctx, size, align, line);
+        }
+
+        MUTEX_UNLOCK;
+        return p;
+}
+
 #ifndef HEAPM_FATAL_HANDLER
 #        define HEAPM_FATAL_HANDLER abort
 #endif
@@ -309,6 +520,19 @@ void hm_free(hm_ctx_t *ctx, void *p)
 }
 
 
+size_t hm_usable_size(hm_ctx_t *ctx, void *p)
+{
+        /* same reconstruction of the pfx as in hm_free, the size of an
+         * allocated block never changes, so no locking is needed */
+        (void)ctx;
+
+        uint32_t padding = *((uint32_t *)p - 1);
+        hm_pfx_t *pfx    = (hm_pfx_t *)((uintptr_t)p - padding) - 1;
+
+        return pfx->asize - sizeof(hm_pfx_t) - padding;
+}
+
+
 uint64_t hm_max(hm_ctx_t *ctx)
 {
         MUTEX_LOCK;
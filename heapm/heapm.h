@@ -67,6 +67,16 @@ typedef struct {
         ((hm_pfx_t *)((uintptr_t)fn - (uintptr_t) & ((hm_pfx_t *)0)->fnode))
 
 
+/* Descriptor of an additional memory region. It lives in the user area of the
+ * region's root block, directly behind the root prefix */
+typedef struct hm_region {
+        struct hm_region *next;
+        uintptr_t base;
+        size_t size;
+        bool mapped;
+} hm_region_t;
+
+
 typedef struct {
 #ifdef HEAPM_USE_MUTEX_X
         xmutex_t lock;
@@ -75,6 +85,8 @@ typedef struct {
         size_t mem_size;
         btrb_node_t *ftree_root;
         btrb_node_t *atree_root;
+        hm_region_t *regions;
+        size_t grow_size;
 } hm_ctx_t;
 #pragma pack(pop)
 
@@ -101,8 +113,14 @@ void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align);
 #endif
 
 void hm_free(hm_ctx_t *ctx, void *p);
+size_t hm_usable_size(hm_ctx_t *ctx, void *p);
 uint64_t hm_max(hm_ctx_t *ctx);
 uint64_t hm_available(hm_ctx_t *ctx, bool net);
 uint64_t hm_allocated(hm_ctx_t *ctx);
 
+int hm_add_region(hm_ctx_t *ctx, void *base, size_t size);
+int hm_remove_region(hm_ctx_t *ctx, void *base);
+void hm_set_grow(hm_ctx_t *ctx, size_t grow_size);
+size_t hm_trim(hm_ctx_t *ctx);
+
 #endif
@@ -31,7 +31,63 @@ SOFTWARE.
 #define P64(x) ((void *)((uintptr_t)ctx->mem_start + x))
 #define P32(x) ((uint32_t)((uintptr_t)x - (uintptr_t)ctx->mem_start))
 
-#ifdef HEAPM_USE_MUTEX_X
+/* fblock chain links are offsets as well, offset 0 is the root info and can
+ * never be an fblock */
+#define FB64(x) ((x) ? (hm_fblock_t *)P64(x) : NULL)
+#define FB32(x) ((x) ? P32(x) : 0)
+
+#ifdef HEAPM32_SHM
+#        include <fcntl.h>
+#        include <sys/mman.h>
+#        include <sys/stat.h>
+#        include <unistd.h>
+#        include "../threads/x-atomic.h"
+
+#        define HM_SHM_MAGIC 0x32336d7061656875ULL
+
+static void hm_lock(hm_ctx_t *ctx)
+{
+        if (!ctx->shared) {
+#        ifdef HEAPM_USE_MUTEX_X
+                xmutex_lock(&ctx->lock);
+#        endif
+                return;
+        }
+
+        hm_root_info_t *root_info = (hm_root_info_t *)ctx->mem_start;
+        xmutex_lock(&root_info->shm_lock);
+
+        /* the btrbc tree roots are plain pointers, valid only for the process
+         * which modified the trees last. All other tree data is relative to
+         * the heap base, so rebasing the two roots is sufficient */
+        uintptr_t base = (uintptr_t)ctx->mem_start;
+        if (root_info->root_base != base) {
+                root_info->froot =
+                    (btrbc_node_t *)((uintptr_t)root_info->froot -
+                                     root_info->root_base + base);
+                root_info->aroot =
+                    (btrbc_node_t *)((uintptr_t)root_info->aroot -
+                                     root_info->root_base + base);
+                root_info->root_base = base;
+        }
+}
+
+
+static void hm_unlock(hm_ctx_t *ctx)
+{
+        if (!ctx->shared) {
+#        ifdef HEAPM_USE_MUTEX_X
+                xmutex_unlock(&ctx->lock);
+#        endif
+                return;
+        }
+
+        xmutex_unlock(&((hm_root_info_t *)ctx->mem_start)->shm_lock);
+}
+
+#        define MUTEX_LOCK   hm_lock(ctx)
+#        define MUTEX_UNLOCK hm_unlock(ctx)
+#elif defined(HEAPM_USE_MUTEX_X)
 #        define MUTEX_LOCK   xmutex_lock(&ctx->lock)
 #        define MUTEX_UNLOCK xmutex_unlock(&ctx->lock)
 #else
@@ -40,7 +96,7 @@ SOFTWARE.
 #endif
 
 
-static void fblock_chain_pop(hm_pfx_t *pfx)
+static void fblock_chain_pop(hm_ctx_t *ctx, hm_pfx_t *pfx)
 {
         /* here we remove the fblock from the chain. The remaining fblocks are
          * referenced by other prefixes, so we clear this pfx' fblock to make
@@ -49,17 +105,17 @@ static void fblock_chain_pop(hm_pfx_t *pfx)
         hm_fblock_t *prev;
         hm_fblock_t *next;
 
-        prev = pfx->fblock.prev;
-        next = pfx->fblock.next;
+        prev = FB64(pfx->fblock.prev);
+        next = FB64(pfx->fblock.next);
 
         if (prev) {
-                prev->next = next;
+                prev->next = FB32(next);
         }
         if (next) {
-                next->prev = prev;
+                next->prev = FB32(prev);
         }
-        pfx->fblock.prev = NULL;
-        pfx->fblock.next = NULL;
+        pfx->fblock.prev = 0;
+        pfx->fblock.next = 0;
         pfx->fblock.size = 0;
 }
 
@@ -79,7 +135,7 @@ static void fblock_remove(hm_ctx_t *ctx, hm_pfx_t *pfx)
          * remove the fblock from the chain to make it available */
 
         if (!pfx->fblock.in_tree) {
-                fblock_chain_pop(pfx);
+                fblock_chain_pop(ctx, pfx);
                 return;
         }
 
@@ -90,10 +146,12 @@ static void fblock_remove(hm_ctx_t *ctx, hm_pfx_t *pfx)
         if (pfx->fblock.next) {
                 /* the tree node adjacent to fblock (inside the same mem prefix
                  * MUST be usable here */
-                btrbc_insert(&ctx->ftree_ctx, pfx->fblock.next->size,
-                             pfx->fblock.next,
-                             FBLOCK_TO_NODE(pfx->fblock.next));
-                pfx->fblock.next->in_tree = true;
+                hm_fblock_t *next = FB64(pfx->fblock.next);
+                btrbc_insert(&ctx->ftree_ctx, next->size, next,
+                             FBLOCK_TO_NODE(next));
+                next->in_tree    = true;
+                next->prev       = 0;
+                pfx->fblock.next = 0;
         }
 }
 
@@ -110,12 +168,16 @@ static void fblock_grow(hm_ctx_t *ctx, hm_pfx_t *pfx, size_t inc_size)
 }
 
 
-static void fblock_chain_push(hm_pfx_t *pfx, hm_fblock_t *fblock)
+static void fblock_chain_push(hm_ctx_t *ctx, hm_pfx_t *pfx,
+                              hm_fblock_t *fblock)
 {
-        hm_fblock_t *next = pfx->fblock.next;
-        pfx->fblock.next  = fblock;
-        fblock->prev      = &pfx->fblock;
-        fblock->next      = next;
+        hm_fblock_t *next = FB64(pfx->fblock.next);
+        pfx->fblock.next  = P32(fblock);
+        fblock->prev      = P32(&pfx->fblock);
+        fblock->next      = FB32(next);
+        if (next) {
+                next->prev = P32(fblock);
+        }
 }
 
 
@@ -125,15 +187,15 @@ static void fblock_add(hm_ctx_t *ctx, hm_pfx_t *pfx, uint32_t base,
         pfx->fblock.base    = base;
         pfx->fblock.size    = size;
         pfx->fblock.in_tree = false;
-        pfx->fblock.next    = NULL;
-        pfx->fblock.prev    = NULL;
+        pfx->fblock.next    = 0;
+        pfx->fblock.prev    = 0;
 
         /* look if there is already a block of this size in the ftree */
         btrbc_node_t *tmp = btrbc_search(&ctx->ftree_ctx, size);
         if (tmp) {
                 /* yes, get corresponding pfx and push into chain */
                 hm_pfx_t *fpfx = FNODE_TO_PFX(tmp);
-                fblock_chain_push(fpfx, &pfx->fblock);
+                fblock_chain_push(ctx, fpfx, &pfx->fblock);
                 return;
         }
 
@@ -152,6 +214,9 @@ int hm_init(hm_ctx_t *ctx, void *base, size_t size)
 #ifdef HEAPM_USE_MUTEX_X
         xmutex_init(&ctx->lock);
 #endif
+#ifdef HEAPM32_SHM
+        ctx->shared = false;
+#endif
 
         MUTEX_LOCK;
         ctx->mem_start = base;
@@ -209,7 +274,7 @@ void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align)
         btrbc_node_t *fnode =
             btrbc_min_at_least(&ctx->ftree_ctx, (uint32_t)rsize);
 
-        if (!fnode) {
+        if (!fnode || btrbc_is_nil(&ctx->ftree_ctx, fnode)) {
                 /* we are out of memory */
                 MUTEX_UNLOCK;
                 return NULL;
@@ -222,49 +287,54 @@ void *hm_aligned_alloc(hm_ctx_t *ctx, size_t size, size_t align)
         if (align > 1) {
                 /* create alignment mask for address */
                 uint64_t mask = align - 1;
-                uint64_t addr_remainder =
-                    (fblock->base + sizeof(hm_pfx_t)) & mask;
-
-                if (addr_remainder == 0) {
-                        goto already_aligned;
-                }
 
-                alignment_padding = align - addr_remainder;
-                rsize += alignment_padding;
+                /* the padding depends on the block's base, so it must be
+                 * recalculated for every candidate block. Equally sized free
+                 * blocks share one tree node and only differ in their base,
+                 * so the whole chain of a node is tried before the next */
+                while (1) {
+                        for (fblock = (hm_fblock_t *)P64(fnode->user_data);
+                             fblock; fblock = FB64(fblock->next)) {
+                                uint64_t addr_remainder =
+                                    (fblock->base + sizeof(hm_pfx_t)) & mask;
+                                alignment_padding =
+                                    addr_remainder ? align - addr_remainder : 0;
+
+                                if (fblock->size >= rsize + alignment_padding) {
+                                        break;
+                                }
+                        }
+                        if (fblock) {
+                                break;
+                        }
 
-                while (fnode->val < rsize) {
                         fnode = btrbc_next_larger(&ctx->ftree_ctx, fnode);
-
                         if (!fnode) {
                                 MUTEX_UNLOCK;
                                 return NULL;
                         }
                 }
 
-                fblock = (hm_fblock_t *)P64(fnode->user_data);
-
-                addr_remainder    = (fblock->base + sizeof(hm_pfx_t)) & mask;
-                alignment_padding = align - addr_remainder;
+                rsize += alignment_padding;
         }
 
-already_aligned:
-
         /* create new pfx and store allocation info */
         hm_pfx_t *new_pfx = (hm_pfx_t *)P64(fblock->base);
 
         new_pfx->abase = fblock->base;
         new_pfx->asize = (uint32_t)rsize;
 
-        new_pfx->fblock.base = 0;
-        new_pfx->fblock.size = 0;
-        new_pfx->fblock.next = NULL;
-        new_pfx->fblock.prev = NULL;
+        new_pfx->fblock.base    = new_pfx->abase + (uint32_t)rsize;
+        new_pfx->fblock.size    = 0;
+        new_pfx->fblock.next    = 0;
+        new_pfx->fblock.prev    = 0;
+        new_pfx->fblock.in_tree = false;
 
         if (fblock->size - rsize) {
                 fblock_add(ctx, new_pfx, fblock->base + (uint32_t)rsize,
                            (uint32_t)(fblock->size - rsize));
         }
-        fblock_remove(ctx, FNODE_TO_PFX(fnode));
+        fblock_remove(ctx, FNODE_TO_PFX(FBLOCK_TO_NODE(fblock)));
         btrbc_insert(&ctx->atree_ctx, new_pfx->abase, new_pfx, &new_pfx->anode);
 
         /* The trick here is to store the padding value padded as well, directly
@@ -361,7 +431,7 @@ uint64_t hm_available(hm_ctx_t *ctx, bool net)
                         if (net) {
                                 free -= sizeof(hm_pfx_t);
                         }
-                        fb = fb->next;
+                        fb = FB64(fb->next);
                 } while (fb);
 
                 tmp = btrbc_next_larger(&ctx->ftree_ctx, tmp);
@@ -438,10 +508,118 @@ void show_mem(hm_ctx_t *ctx)
                         printf("free memory %08" PRIx64 "-%08" PRIx64
                                " [%" PRIu64 "]\n",
                                fb->base, fb->base + fb->size, fb->size);
-                        fb = fb->next;
+                        fb = FB64(fb->next);
                 } while (fb);
 
                 tmp = btrbc_next_larger(&ctx->ftree_ctx, tmp);
         } while (!btrbc_is_nil(&ctx->ftree_ctx, tmp) && tmp);
 }
 #endif
+
+
+#ifdef HEAPM32_SHM
+int hm_shm_create(hm_ctx_t *ctx, const char *name, size_t size)
+{
+        if (size > (UINT32_MAX >> 1)) {
+                return -1;
+        }
+
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+                return -1;
+        }
+
+        if (ftruncate(fd, size) < 0) {
+                close(fd);
+                shm_unlink(name);
+                return -1;
+        }
+
+        void *base =
+            mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+                shm_unlink(name);
+                return -1;
+        }
+
+        hm_root_info_t *root_info = (hm_root_info_t *)base;
+        xmutex_init(&root_info->shm_lock);
+        root_info->root_base = (uintptr_t)base;
+
+        hm_init(ctx, base, size);
+        ctx->shared = true;
+
+        /* publish the heap, attach fails until the magic is present */
+        x_atomic_store64(&root_info->shm_magic, HM_SHM_MAGIC);
+        return 0;
+}
+
+
+int hm_shm_attach(hm_ctx_t *ctx, const char *name)
+{
+        struct stat st;
+
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+                return -1;
+        }
+
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hm_root_info_t)) {
+                close(fd);
+                return -1;
+        }
+
+        void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+                return -1;
+        }
+
+        hm_root_info_t *root_info = (hm_root_info_t *)base;
+        if (x_atomic_load64(&root_info->shm_magic) != HM_SHM_MAGIC) {
+                munmap(base, st.st_size);
+                return -1;
+        }
+
+#ifdef HEAPM_USE_MUTEX_X
+        xmutex_init(&ctx->lock);
+#endif
+        ctx->mem_start = base;
+        ctx->mem_size  = st.st_size;
+        ctx->shared    = true;
+
+        btrbc_attach(&ctx->atree_ctx, &root_info->aroot, (uintptr_t)base,
+                     &root_info->nil_node);
+        btrbc_attach(&ctx->ftree_ctx, &root_info->froot, (uintptr_t)base,
+                     &root_info->nil_node);
+        return 0;
+}
+
+
+void hm_shm_detach(hm_ctx_t *ctx)
+{
+        munmap(ctx->mem_start, ctx->mem_size);
+        ctx->mem_start = NULL;
+        ctx->mem_size  = 0;
+}
+
+
+int hm_shm_unlink(const char *name)
+{
+        return shm_unlink(name);
+}
+
+
+uint32_t hm_shm_offset(hm_ctx_t *ctx, void *p)
+{
+        return P32(p);
+}
+
+
+void *hm_shm_ptr(hm_ctx_t *ctx, uint32_t offset)
+{
+        return P64(offset);
+}
+#endif
@@ -30,18 +30,23 @@ SOFTWARE.
 
 #include "../btrees/btrb_compact.h"
 
-#ifdef HEAPM_USE_MUTEX_X
+#if defined(HEAPM_USE_MUTEX_X) || defined(HEAPM32_SHM)
 #        include "../mutex/xmutex.h"
 #endif
 
+#if defined(HEAPM32_SHM) && defined(X_MUTEX_MCS)
+/* the MCS queue links thread local nodes of one process */
+#        error "HEAPM32_SHM cannot share X_MUTEX_MCS locks between processes"
+#endif
+
 
 #pragma pack(push, 1)
 typedef struct hm_fblock {
         uint32_t in_tree : 1;
         uint32_t base : 31;
         uint32_t size;
-        struct hm_fblock *next;
-        struct hm_fblock *prev;
+        uint32_t next; /* offsets relative to the heap base, 0 = none */
+        uint32_t prev;
 } hm_fblock_t;
 
 
@@ -60,6 +65,11 @@ typedef struct {
 
 
 typedef struct {
+#ifdef HEAPM32_SHM
+        xmutex_t shm_lock;
+        uint64_t shm_magic;
+        uintptr_t root_base; /* base address the tree roots are valid for */
+#endif
         btrbc_node_t *froot;
         btrbc_node_t *aroot;
         btrbc_node_t nil_node;
@@ -85,6 +95,9 @@ typedef struct {
         size_t mem_size;
         btrbc_ctx_t ftree_ctx;
         btrbc_ctx_t atree_ctx;
+#ifdef HEAPM32_SHM
+        bool shared;
+#endif
 } hm_ctx_t;
 #pragma pack(pop)
 
@@ -115,4 +128,13 @@ uint64_t hm_max(hm_ctx_t *ctx);
 uint64_t hm_available(hm_ctx_t *ctx, bool net);
 uint64_t hm_allocated(hm_ctx_t *ctx);
 
+#ifdef HEAPM32_SHM
+int hm_shm_create(hm_ctx_t *ctx, const char *name, size_t size);
+int hm_shm_attach(hm_ctx_t *ctx, const char *name);
+void hm_shm_detach(hm_ctx_t *ctx);
+int hm_shm_unlink(const char *name);
+uint32_t hm_shm_offset(hm_ctx_t *ctx, void *p);
+void *hm_shm_ptr(hm_ctx_t *ctx, uint32_t offset);
+#endif
+
 #endif
@@ -1,7 +1,9 @@
 #include "heapm32.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 static void shuffle(int *array, size_t n)
 {
@@ -188,7 +190,7 @@ int main(void)
             "******************** malloc line store test ******************\n");
 
         /* make sure, the preceeding alloc is on the line tested below :D */
-        TEST_CHECK(((hm_pfx_t *)p[0] - 1)->malloc_line == 185);
+        TEST_CHECK(((hm_pfx_t *)p[0] - 1)->malloc_line == 187);
 
         printf("\nPASSED\n");
 
@@ -216,6 +218,54 @@ int main(void)
 
         printf("\nPASSED\n");
 
+        printf(
+            "******************** shared memory heap test *****************\n");
+
+        /* attach the same segment twice, so the heap is mapped at two
+         * different addresses just like in two processes */
+        hm_ctx_t prod, cons;
+        char shm_name[32];
+        snprintf(shm_name, sizeof(shm_name), "/heapm32_test_%d", (int)getpid());
+
+        TEST_CHECK(hm_shm_create(&prod, shm_name, 1048576) == 0);
+        TEST_CHECK(hm_shm_attach(&cons, shm_name) == 0);
+        TEST_CHECK(prod.mem_start != cons.mem_start);
+
+        uint32_t offs[6];
+        for (int i = 0; i < 6; i++) {
+                uint8_t *buf = hm_alloc(&prod, 65536);
+                TEST_CHECK(buf != NULL);
+                memset(buf, i, 65536);
+                offs[i] = hm_shm_offset(&prod, buf);
+        }
+        TEST_CHECK(hm_allocated(&cons) == hm_allocated(&prod));
+
+        /* the consumer frees in a different order, so the free trees get
+         * rebuilt from the other mapping */
+        for (int i = 5; i >= 0; i -= 2) {
+                uint8_t *buf = hm_shm_ptr(&cons, offs[i]);
+                TEST_CHECK(buf[0] == i && buf[65535] == i);
+                hm_free(&cons, buf);
+        }
+        for (int i = 0; i < 6; i += 2) {
+                hm_free(&cons, hm_shm_ptr(&cons, offs[i]));
+        }
+
+        TEST_CHECK(hm_allocated(&prod) == sizeof(hm_root_info_t));
+        TEST_CHECK(hm_available(&prod, false) ==
+                   prod.mem_size - sizeof(hm_root_info_t));
+
+        p1 = hm_alloc(&prod, hm_max(&cons));
+        TEST_CHECK(p1 != NULL);
+        TEST_CHECK(hm_max(&cons) == 0);
+        hm_free(&cons, hm_shm_ptr(&cons, hm_shm_offset(&prod, p1)));
+
+        hm_shm_detach(&cons);
+        hm_shm_detach(&prod);
+        TEST_CHECK(hm_shm_unlink(shm_name) == 0);
+
+        printf("\nPASSED\n");
+
         printf(
             "****************** general memory footprint ******************\n");
 
@@ -0,0 +1,354 @@
+/* Allocation trace benchmark for heapm, heapm32 and the C library's malloc.
+ *
+ * The same source is built once per backend (BENCH_HEAPM, BENCH_HEAPM32 or
+ * neither for malloc), since heapm and heapm32 share their symbol names. Each
+ * trace runs in a forked child, so the peak RSS of one trace does not hide the
+ * next one. All traces are generated from fixed seeds and do not depend on the
+ * backend, so every backend replays exactly the same operations. */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#if defined(BENCH_HEAPM)
+#        include "heapm.h"
+#        define BACKEND "heapm"
+#elif defined(BENCH_HEAPM32)
+#        include "heapm32.h"
+#        define BACKEND "heapm32"
+#else
+#        include <malloc.h>
+#        define BACKEND "malloc"
+#endif
+
+#define N_OPS   400000
+#define N_SLOTS 8192
+
+/* heap size for heapm and heapm32, pages are only touched when used */
+#define HEAP_SIZE (512UL * 1024 * 1024)
+
+
+typedef struct {
+        double ops_per_sec;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t peak_live;
+        long rss_kb;
+        double frag;
+} bench_result_t;
+
+
+static uint32_t latency[N_OPS];
+static uint64_t n_lat;
+static void *slot[N_SLOTS];
+static size_t slot_size[N_SLOTS];
+static uint64_t live, peak_live;
+
+
+#if defined(BENCH_HEAPM) || defined(BENCH_HEAPM32)
+static hm_ctx_t ctx;
+
+static void backend_init(void)
+{
+        void *base = mmap(NULL, HEAP_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+                perror("mmap");
+                exit(1);
+        }
+        hm_init(&ctx, base, HEAP_SIZE);
+}
+
+static void *backend_alloc(size_t size, size_t align)
+{
+        return align ? hm_aligned_alloc(&ctx, size, align)
+                     : hm_alloc(&ctx, size);
+}
+
+static void backend_free(void *p)
+{
+        hm_free(&ctx, p);
+}
+
+static double backend_frag(void)
+{
+        /* share of free memory not usable for the largest allocation */
+        uint64_t avail = hm_available(&ctx, false);
+        return avail ? 1.0 - (double)hm_max(&ctx) / avail : 0.0;
+}
+#else
+static void backend_init(void)
+{
+}
+
+static void *backend_alloc(size_t size, size_t align)
+{
+        return align ? aligned_alloc(align, (size + align - 1) & ~(align - 1))
+                     : malloc(size);
+}
+
+static void backend_free(void *p)
+{
+        free(p);
+}
+
+static double backend_frag(void)
+{
+        return -1.0;
+}
+#endif
+
+
+static inline uint64_t now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void do_alloc(int i, size_t size, size_t align)
+{
+        uint64_t t0 = now_ns();
+        slot[i]     = backend_alloc(size, align);
+        uint64_t t1 = now_ns();
+
+        if (!slot[i]) {
+                fprintf(stderr, BACKEND ": out of memory\n");
+                exit(1);
+        }
+
+        /* touch the block like a real user would, this also makes the RSS
+         * comparable between the backends */
+        memset(slot[i], 0x5a, size);
+
+        latency[n_lat++] = (uint32_t)(t1 - t0);
+        slot_size[i]     = size;
+        live += size;
+        if (live > peak_live) {
+                peak_live = live;
+        }
+}
+
+
+static void do_free(int i)
+{
+        uint64_t t0 = now_ns();
+        backend_free(slot[i]);
+        uint64_t t1 = now_ns();
+
+        latency[n_lat++] = (uint32_t)(t1 - t0);
+        live -= slot_size[i];
+        slot[i] = NULL;
+}
+
+
+static size_t rand_size(unsigned int *seed, size_t min, size_t max)
+{
+        /* log-uniform, small blocks are much more common than large ones */
+        unsigned int bits_min = 63 - __builtin_clzll(min);
+        unsigned int bits_max = 63 - __builtin_clzll(max);
+        unsigned int bits = bits_min + rand_r(seed) % (bits_max - bits_min + 1);
+        size_t size       = ((size_t)1 << bits) + rand_r(seed) % (1UL << bits);
+
+        return size > max ? max : size;
+}
+
+
+/* random sizes, random alloc/free decisions on random slots */
+static void trace_random(void)
+{
+        unsigned int seed = 1;
+
+        while (n_lat < N_OPS) {
+                int i = rand_r(&seed) % N_SLOTS;
+                if (slot[i]) {
+                        do_free(i);
+                } else {
+                        do_alloc(i, rand_size(&seed, 16, 4096), 0);
+                }
+        }
+}
+
+
+/* a producer allocates bursts of messages, a consumer frees them in FIFO
+ * order, the queue depth varies */
+static void trace_prodcons(void)
+{
+        unsigned int seed = 2;
+        int head = 0, tail = 0, depth = 0;
+
+        while (n_lat < N_OPS) {
+                int burst = rand_r(&seed) % 64 + 1;
+                for (int j = 0; j < burst && depth < N_SLOTS; j++) {
+                        do_alloc(head, rand_size(&seed, 64, 65536), 0);
+                        head = (head + 1) % N_SLOTS;
+                        depth++;
+                }
+                burst = rand_r(&seed) % 64 + 1;
+                for (int j = 0; j < burst && depth > 0; j++) {
+                        do_free(tail);
+                        tail = (tail + 1) % N_SLOTS;
+                        depth--;
+                }
+        }
+}
+
+
+/* mostly short lived small blocks, interleaved with long lived larger ones
+ * which stay allocated until the end of the trace */
+static void trace_lifetime(void)
+{
+        unsigned int seed = 3;
+        const int n_long  = N_SLOTS / 4;
+        int next_long     = 0;
+
+        while (n_lat < N_OPS) {
+                if (rand_r(&seed) % 100 < 2 && next_long < n_long) {
+                        do_alloc(next_long++, rand_size(&seed, 256, 16384),
+                                 0);
+                        continue;
+                }
+                int i = n_long + rand_r(&seed) % 32;
+                if (slot[i]) {
+                        do_free(i);
+                } else {
+                        do_alloc(i, rand_size(&seed, 16, 512), 0);
+                }
+        }
+}
+
+
+/* random sizes with random power of two alignments */
+static void trace_aligned(void)
+{
+        unsigned int seed = 4;
+
+        while (n_lat < N_OPS) {
+                int i = rand_r(&seed) % N_SLOTS;
+                if (slot[i]) {
+                        do_free(i);
+                } else {
+                        size_t align = (size_t)16 << (rand_r(&seed) % 9);
+                        do_alloc(i, rand_size(&seed, 16, 4096), align);
+                }
+        }
+}
+
+
+static int cmp_u32(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+        return (x > y) - (x < y);
+}
+
+
+static void run_child(void (*trace)(void), int fd)
+{
+        bench_result_t res;
+        struct rusage ru;
+
+        backend_init();
+
+        getrusage(RUSAGE_SELF, &ru);
+        long rss_start = ru.ru_maxrss;
+
+        trace();
+
+        getrusage(RUSAGE_SELF, &ru);
+        res.rss_kb    = ru.ru_maxrss - rss_start;
+        res.frag      = backend_frag();
+        res.peak_live = peak_live;
+
+        for (int i = 0; i < N_SLOTS; i++) {
+                if (slot[i]) {
+                        backend_free(slot[i]);
+                }
+        }
+
+        /* throughput of the allocator calls only, without touching the
+         * memory and generating the trace. The latency of taking the time is
+         * contained, but it is the same for all backends */
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < n_lat; i++) {
+                total += latency[i];
+        }
+        res.ops_per_sec = (double)n_lat * 1e9 / total;
+        qsort(latency, n_lat, sizeof(latency[0]), cmp_u32);
+        res.p50 = latency[n_lat / 2];
+        res.p99 = latency[n_lat * 99 / 100];
+
+        if (write(fd, &res, sizeof(res)) != sizeof(res)) {
+                exit(1);
+        }
+        exit(0);
+}
+
+
+static void run(const char *name, void (*trace)(void))
+{
+        int fds[2];
+        bench_result_t res;
+
+        if (pipe(fds) < 0) {
+                perror("pipe");
+                exit(1);
+        }
+
+        /* make sure the latency array is resident before the baseline RSS is
+         * taken in the child */
+        memset(latency, 0, sizeof(latency));
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+                close(fds[0]);
+                run_child(trace, fds[1]);
+        }
+        close(fds[1]);
+
+        int status;
+        ssize_t n = read(fds[0], &res, sizeof(res));
+        close(fds[0]);
+        waitpid(pid, &status, 0);
+
+        if (n != sizeof(res) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+                printf("%-8s %-10s failed\n", BACKEND, name);
+                return;
+        }
+
+        printf("%-8s %-10s %12.0f %8" PRIu64 " %8" PRIu64 " %10ld %9.2f ",
+               BACKEND, name, res.ops_per_sec, res.p50, res.p99, res.rss_kb,
+               (double)res.rss_kb * 1024 / res.peak_live);
+        if (res.frag < 0) {
+                printf("%6s\n", "-");
+        } else {
+                printf("%6.3f\n", res.frag);
+        }
+        fflush(stdout);
+}
+
+
+int main(int argc, char **argv)
+{
+        if (argc < 2 || strcmp(argv[1], "-n")) {
+                printf("%-8s %-10s %12s %8s %8s %10s %9s %6s\n", "backend",
+                       "trace", "ops/s", "p50[ns]", "p99[ns]", "rss[kB]",
+                       "rss/live", "frag");
+        }
+
+        run("random", trace_random);
+        run("prodcons", trace_prodcons);
+        run("lifetime", trace_lifetime);
+        run("aligned", trace_aligned);
+
+        return 0;
+}
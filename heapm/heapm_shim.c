@@ -0,0 +1,352 @@
+/************************************************************************
+ *              Modular Heap Memory Manager - malloc shim
+ *
+ *      Copyright (c) 2023 Andreas J. Reichel
+ *      MIT License
+ *
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ ************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "heapm.h"
+#include "heapm_shim.h"
+
+#ifndef HEAPM_USE_MUTEX_X
+#        error "the heapm shim needs HEAPM_USE_MUTEX_X for cross thread frees"
+#endif
+
+
+/* Every thread allocates from its own arena, so the arena locks are only
+ * contended if a block is freed by another thread. Arenas are never
+ * destroyed, because their blocks may outlive the thread. When a thread
+ * exits, its arena is put into a pool and reused by the next new thread.
+ * Allocations made by TLS destructors that run after the arena was released
+ * go to one shared arena, which is safe because every arena is locked. */
+typedef struct hm_shim_arena {
+        hm_ctx_t ctx;
+        struct hm_shim_arena *next;     /* in the pool */
+        struct hm_shim_arena *all_next; /* in the list of all arenas */
+} hm_shim_arena_t;
+
+
+/* Directly before each user block, the owning arena and the offset of the
+ * user block relative to the heapm block are stored */
+typedef struct {
+        hm_shim_arena_t *arena;
+        size_t offset;
+} hm_shim_hdr_t;
+
+#define SHIM_MIN_ALIGN 16
+
+
+static __thread hm_shim_arena_t *tls_arena
+    __attribute__((tls_model("initial-exec")));
+static __thread bool tls_exiting __attribute__((tls_model("initial-exec")));
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shim_key;
+static xmutex_t pool_lock; /* protects pool, arenas and shared */
+static hm_shim_arena_t *pool;
+static hm_shim_arena_t *arenas;
+static hm_shim_arena_t *shared;
+
+
+static void arena_release(void *p)
+{
+        hm_shim_arena_t *arena = p;
+
+        /* later destructors of this thread must not use the pooled arena */
+        tls_arena   = NULL;
+        tls_exiting = true;
+
+        xmutex_lock(&pool_lock);
+        arena->next = pool;
+        pool        = arena;
+        xmutex_unlock(&pool_lock);
+}
+
+
+/* No other thread may hold an arena lock across fork, the child would
+ * deadlock on it. pool_lock is taken first, as in arena_get. */
+static void shim_fork_prepare(void)
+{
+        xmutex_lock(&pool_lock);
+        for (hm_shim_arena_t *a = arenas; a; a = a->all_next) {
+                xmutex_lock(&a->ctx.lock);
+        }
+}
+
+
+static void shim_fork_parent(void)
+{
+        for (hm_shim_arena_t *a = arenas; a; a = a->all_next) {
+                xmutex_unlock(&a->ctx.lock);
+        }
+        xmutex_unlock(&pool_lock);
+}
+
+
+static void shim_fork_child(void)
+{
+        /* only the forking thread survives, the arenas of all others are
+         * free for reuse */
+        pool = NULL;
+        for (hm_shim_arena_t *a = arenas; a; a = a->all_next) {
+                xmutex_unlock(&a->ctx.lock);
+                if (a != tls_arena && a != shared) {
+                        a->next = pool;
+                        pool    = a;
+                }
+        }
+        xmutex_unlock(&pool_lock);
+}
+
+
+static void shim_init(void)
+{
+        xmutex_init(&pool_lock);
+        pthread_key_create(&shim_key, arena_release);
+        pthread_atfork(shim_fork_prepare, shim_fork_parent, shim_fork_child);
+}
+
+
+/* called with pool_lock held */
+static hm_shim_arena_t *arena_new(void)
+{
+        void *base = mmap(NULL, HEAPM_SHIM_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+
+        /* the arena itself lives at the start of its initial heap block */
+        hm_shim_arena_t *arena = base;
+        hm_init(&arena->ctx, arena + 1,
+                HEAPM_SHIM_ARENA_SIZE - sizeof(hm_shim_arena_t));
+        hm_set_grow(&arena->ctx, HEAPM_SHIM_ARENA_SIZE);
+        arena->next     = NULL;
+        arena->all_next = arenas;
+        arenas          = arena;
+
+        return arena;
+}
+
+
+static hm_shim_arena_t *arena_get(void)
+{
+        if (tls_arena) {
+                return tls_arena;
+        }
+
+        pthread_once(&shim_once, shim_init);
+
+        xmutex_lock(&pool_lock);
+        hm_shim_arena_t *arena;
+        if (tls_exiting) {
+                if (!shared) {
+                        shared = arena_new();
+                }
+                arena = shared;
+        } else {
+                arena = pool;
+                if (arena) {
+                        pool = arena->next;
+                } else {
+                        arena = arena_new();
+                }
+        }
+        xmutex_unlock(&pool_lock);
+
+        if (!arena || tls_exiting) {
+                return arena;
+        }
+
+        tls_arena = arena;
+        pthread_setspecific(shim_key, arena);
+        return arena;
+}
+
+
+static void *shim_alloc(size_t size, size_t align)
+{
+        if (align < SHIM_MIN_ALIGN) {
+                align = SHIM_MIN_ALIGN;
+        }
+
+        /* the header must fit in front of the user block without breaking
+         * its alignment */
+        size_t offset = align;
+
+        if (size > SIZE_MAX - offset) {
+                return NULL;
+        }
+
+        hm_shim_arena_t *arena = arena_get();
+        if (!arena) {
+                return NULL;
+        }
+
+        uint8_t *p = hm_aligned_alloc(&arena->ctx, size + offset, align);
+        if (!p) {
+                return NULL;
+        }
+
+        hm_shim_hdr_t *hdr = (hm_shim_hdr_t *)(p + offset) - 1;
+        hdr->arena         = arena;
+        hdr->offset        = offset;
+
+        return p + offset;
+}
+
+
+static size_t shim_usable_size(hm_shim_hdr_t *hdr)
+{
+        uint8_t *p = (uint8_t *)(hdr + 1) - hdr->offset;
+
+        return hm_usable_size(&hdr->arena->ctx, p) - hdr->offset;
+}
+
+
+void *HM_SHIM(malloc)(size_t size)
+{
+        void *p = shim_alloc(size ? size : 1, 0);
+        if (!p) {
+                errno = ENOMEM;
+        }
+        return p;
+}
+
+
+void HM_SHIM(free)(void *p)
+{
+        if (!p) {
+                return;
+        }
+
+        hm_shim_hdr_t *hdr     = (hm_shim_hdr_t *)p - 1;
+        hm_shim_arena_t *arena = hdr->arena;
+        bool trim = shim_usable_size(hdr) >= HEAPM_SHIM_TRIM_THRESHOLD;
+
+        hm_free(&arena->ctx, (uint8_t *)p - hdr->offset);
+
+        if (trim) {
+                hm_trim(&arena->ctx);
+        }
+}
+
+
+void *HM_SHIM(calloc)(size_t nmemb, size_t size)
+{
+        if (size && nmemb > SIZE_MAX / size) {
+                errno = ENOMEM;
+                return NULL;
+        }
+
+        /* shim_alloc instead of malloc, otherwise the compiler may turn the
+         * malloc/memset pair into a recursive calloc call */
+        size_t total = nmemb * size;
+        void *p      = shim_alloc(total ? total : 1, 0);
+        if (!p) {
+                errno = ENOMEM;
+                return NULL;
+        }
+        memset(p, 0, total);
+        return p;
+}
+
+
+void *HM_SHIM(realloc)(void *p, size_t size)
+{
+        if (!p) {
+                return HM_SHIM(malloc)(size);
+        }
+        if (!size) {
+                HM_SHIM(free)(p);
+                return NULL;
+        }
+
+        size_t old_size = shim_usable_size((hm_shim_hdr_t *)p - 1);
+        if (size <= old_size) {
+                return p;
+        }
+
+        void *n = HM_SHIM(malloc)(size);
+        if (!n) {
+                return NULL;
+        }
+        memcpy(n, p, old_size);
+        HM_SHIM(free)(p);
+        return n;
+}
+
+
+int HM_SHIM(posix_memalign)(void **memptr, size_t align, size_t size)
+{
+        if (!align || (align & (align - 1)) || align % sizeof(void *)) {
+                return EINVAL;
+        }
+
+        void *p = shim_alloc(size ? size : 1, align);
+        if (!p) {
+                return ENOMEM;
+        }
+        *memptr = p;
+        return 0;
+}
+
+
+void *HM_SHIM(aligned_alloc)(size_t align, size_t size)
+{
+        return HM_SHIM(memalign)(align, size);
+}
+
+
+void *HM_SHIM(memalign)(size_t align, size_t size)
+{
+        if (!align || (align & (align - 1))) {
+                errno = EINVAL;
+                return NULL;
+        }
+
+        void *p = shim_alloc(size ? size : 1, align);
+        if (!p) {
+                errno = ENOMEM;
+        }
+        return p;
+}
+
+
+void *HM_SHIM(valloc)(size_t size)
+{
+        return HM_SHIM(memalign)(sysconf(_SC_PAGESIZE), size);
+}
+
+
+size_t HM_SHIM(malloc_usable_size)(void *p)
+{
+        if (!p) {
+                return 0;
+        }
+        return shim_usable_size((hm_shim_hdr_t *)p - 1);
+}
@@ -0,0 +1,61 @@
+#ifndef HEAPM_SHIM_H
+#define HEAPM_SHIM_H
+/************************************************************************
+ *              Modular Heap Memory Manager - malloc shim
+ *
+ *      Copyright (c) 2023 Andreas J. Reichel
+ *      MIT License
+ *
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ ************************************************************************/
+#include <stddef.h>
+
+/* The shim implements the standard allocation functions on top of heapm
+ * contexts, one per thread. By default the functions carry their standard
+ * names, so the shim replaces the C library's allocator when it is linked
+ * statically or preloaded. If HEAPM_SHIM_PREFIX is defined, the functions are
+ * prefixed with hm_shim_ instead, so both allocators can be used side by
+ * side. */
+
+#ifdef HEAPM_SHIM_PREFIX
+#        define HM_SHIM(name) hm_shim_##name
+#else
+#        define HM_SHIM(name) name
+#endif
+
+#ifndef HEAPM_SHIM_ARENA_SIZE
+#        define HEAPM_SHIM_ARENA_SIZE (4UL * 1024 * 1024)
+#endif
+
+/* freeing a block at least this large returns empty regions to the OS */
+#ifndef HEAPM_SHIM_TRIM_THRESHOLD
+#        define HEAPM_SHIM_TRIM_THRESHOLD (1UL * 1024 * 1024)
+#endif
+
+void *HM_SHIM(malloc)(size_t size);
+void HM_SHIM(free)(void *p);
+void *HM_SHIM(calloc)(size_t nmemb, size_t size);
+void *HM_SHIM(realloc)(void *p, size_t size);
+int HM_SHIM(posix_memalign)(void **memptr, size_t align, size_t size);
+void *HM_SHIM(aligned_alloc)(size_t align, size_t size);
+void *HM_SHIM(memalign)(size_t align, size_t size);
+void *HM_SHIM(valloc)(size_t size);
+size_t HM_SHIM(malloc_usable_size)(void *p);
+
+#endif
@@ -0,0 +1,210 @@
+#include "heapm_shim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../threads/x-threads.h"
+
+/* This test is linked against the static shim library, so the standard
+ * allocation functions used below are the heapm based ones */
+
+#define STRINGIFY(x) STRFY(x)
+#define STRFY(x)     #x
+
+#define TEST_CHECK(x)                                             \
+        {                                                         \
+                int line = __LINE__;                              \
+                if (!(x)) {                                       \
+                        printf("Error: '%s' failed in line %d\n", \
+                               STRINGIFY(x), line);               \
+                        return 1;                                 \
+                }                                                 \
+        }
+
+#define N_THREADS 8
+#define N_BLOCKS  4096
+
+static void *blocks[N_THREADS][N_BLOCKS];
+static int thread_result[N_THREADS];
+
+
+static int thread_work(int id)
+{
+        unsigned int seed = id;
+
+        for (int i = 0; i < N_BLOCKS; i++) {
+                size_t size   = rand_r(&seed) % 2048 + 1;
+                blocks[id][i] = malloc(size);
+                TEST_CHECK(blocks[id][i] != NULL);
+                TEST_CHECK(((uintptr_t)blocks[id][i] & 15) == 0);
+                TEST_CHECK(malloc_usable_size(blocks[id][i]) >= size);
+                memset(blocks[id][i], id, size);
+        }
+
+        /* free every second block of our own */
+        for (int i = 0; i < N_BLOCKS; i += 2) {
+                free(blocks[id][i]);
+                blocks[id][i] = NULL;
+        }
+
+        return 0;
+}
+
+
+X_THREAD_FUNC(worker)
+{
+        int id            = (int)(intptr_t)p;
+        thread_result[id] = thread_work(id);
+        return NULL;
+}
+
+
+/* a destructor that runs a second round, after the shim released the
+ * thread's arena, and allocates there */
+static pthread_key_t late_key;
+static void *late_block;
+
+
+static void late_destructor(void *p)
+{
+        if (p == (void *)1) {
+                pthread_setspecific(late_key, (void *)2);
+                return;
+        }
+        late_block = malloc(100);
+        if (late_block) {
+                memset(late_block, 0x55, 100);
+        }
+}
+
+
+X_THREAD_FUNC(late_worker)
+{
+        free(malloc(10));
+        pthread_setspecific(late_key, (void *)1);
+        return NULL;
+}
+
+
+static volatile int fork_stop;
+
+
+X_THREAD_FUNC(fork_worker)
+{
+        unsigned int seed = (unsigned int)(intptr_t)p;
+        void *keep[64]    = { NULL };
+
+        while (!fork_stop) {
+                int i = rand_r(&seed) % 64;
+                free(keep[i]);
+                keep[i] = malloc(rand_r(&seed) % 4096 + 1);
+        }
+        for (int i = 0; i < 64; i++) {
+                free(keep[i]);
+        }
+        return NULL;
+}
+
+
+int main(void)
+{
+        printf(
+            "********************* malloc shim basic test *****************\n");
+
+        uint8_t *p = calloc(1000, 4);
+        TEST_CHECK(p != NULL);
+        for (int i = 0; i < 4000; i++) {
+                TEST_CHECK(p[i] == 0);
+                p[i] = (uint8_t)i;
+        }
+
+        p = realloc(p, 100000);
+        TEST_CHECK(p != NULL);
+        for (int i = 0; i < 4000; i++) {
+                TEST_CHECK(p[i] == (uint8_t)i);
+        }
+        free(p);
+
+        void *a;
+        TEST_CHECK(posix_memalign(&a, 4096, 12345) == 0);
+        TEST_CHECK(((uintptr_t)a & 4095) == 0);
+        free(a);
+        TEST_CHECK(posix_memalign(&a, 24, 16) != 0);
+
+        /* larger than an arena, needs a mapped region of its own */
+        p = malloc(16 * 1024 * 1024);
+        TEST_CHECK(p != NULL);
+        memset(p, 0xaa, 16 * 1024 * 1024);
+        free(p);
+
+        printf("\nPASSED\n");
+
+        printf(
+            "***************** malloc shim multi thread test **************\n");
+
+        x_thread_t t[N_THREADS];
+        for (int i = 0; i < N_THREADS; i++) {
+                t[i] = x_thread_create(worker, (void *)(intptr_t)i);
+        }
+        for (int i = 0; i < N_THREADS; i++) {
+                x_thread_wait_infinite(t[i]);
+                TEST_CHECK(thread_result[i] == 0);
+        }
+
+        /* the threads are gone, free the rest of their blocks from here */
+        for (int i = 0; i < N_THREADS; i++) {
+                for (int j = 1; j < N_BLOCKS; j += 2) {
+                        TEST_CHECK(*(uint8_t *)blocks[i][j] == i);
+                        free(blocks[i][j]);
+                }
+        }
+
+        printf("\nPASSED\n");
+
+        printf(
+            "************** malloc shim thread exit and fork test **********\n");
+
+        TEST_CHECK(pthread_key_create(&late_key, late_destructor) == 0);
+        for (int i = 0; i < 4; i++) {
+                late_block = NULL;
+                x_thread_wait_infinite(x_thread_create(late_worker, NULL));
+                TEST_CHECK(late_block != NULL);
+                TEST_CHECK(((uint8_t *)late_block)[99] == 0x55);
+                free(late_block);
+        }
+
+        for (int i = 0; i < N_THREADS; i++) {
+                t[i] = x_thread_create(fork_worker, (void *)(intptr_t)i);
+        }
+        for (int i = 0; i < 20; i++) {
+                pid_t pid = fork();
+                TEST_CHECK(pid >= 0);
+                if (!pid) {
+                        /* the locks of the other threads' arenas must be
+                         * free here and their arenas reusable */
+                        late_block = NULL;
+                        for (int j = 0; j < 1000; j++) {
+                                free(malloc(j + 1));
+                        }
+                        x_thread_wait_infinite(
+                            x_thread_create(late_worker, NULL));
+                        _exit(late_block ? 0 : 1);
+                }
+                int status;
+                TEST_CHECK(waitpid(pid, &status, 0) == pid);
+                TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        fork_stop = 1;
+        for (int i = 0; i < N_THREADS; i++) {
+                x_thread_wait_infinite(t[i]);
+        }
+
+        printf("\nPASSED\n");
+
+        return 0;
+}
@@ -19,6 +19,7 @@ static void shuffle(int *array, size_t n)
 
 
 uint8_t static_mem[1048576];
+uint8_t region_mem[262144];
 
 #define STRINGIFY(x) STRFY(x)
 #define STRFY(x)     #x
@@ -179,7 +180,7 @@ int main(void)
             "******************** malloc line store test ******************\n");
 
         /* make sure, the preceeding alloc is on the line tested below :D */
-        TEST_CHECK(((hm_pfx_t *)p[0] - 1)->malloc_line == 176);
+        TEST_CHECK(((hm_pfx_t *)p[0] - 1)->malloc_line == 177);
 
         printf("\nPASSED\n");
 
@@ -207,6 +208,101 @@ int main(void)
 
         printf("\nPASSED\n");
 
+        printf(
+            "********************* multi region test **********************\n");
+
+        void *p_full = hm_alloc(&ctx, hm_max(&ctx));
+        TEST_CHECK(p_full != NULL);
+        TEST_CHECK(hm_alloc(&ctx, 65536) == NULL);
+
+        TEST_CHECK(hm_add_region(&ctx, region_mem, sizeof(region_mem)) == 0);
+        uint64_t region_free = hm_available(&ctx, false);
+        TEST_CHECK(region_free == sizeof(region_mem) - sizeof(hm_pfx_t) -
+                                      sizeof(hm_region_t));
+
+        p1 = hm_alloc(&ctx, 65536);
+        TEST_CHECK((uint8_t *)p1 > region_mem &&
+                   (uint8_t *)p1 < region_mem + sizeof(region_mem));
+        TEST_CHECK(hm_remove_region(&ctx, region_mem) == -1);
+        hm_free(&ctx, p1);
+        TEST_CHECK(hm_available(&ctx, false) == region_free);
+
+        /* let the heap grow by mapped regions on demand */
+        hm_set_grow(&ctx, 1048576);
+        for (int i = 0; i < 6; i++) {
+                p[i] = hm_aligned_alloc(&ctx, 524288, 4096);
+                TEST_CHECK(p[i] != NULL);
+                TEST_CHECK(((uintptr_t)p[i] & 4095) == 0);
+        }
+        TEST_CHECK(hm_trim(&ctx) == 0);
+
+        for (int i = 0; i < 6; i++) {
+                hm_free(&ctx, p[i]);
+        }
+        TEST_CHECK(hm_trim(&ctx) > 0);
+        TEST_CHECK(ctx.regions != NULL && ctx.regions->next == NULL);
+        TEST_CHECK(hm_available(&ctx, false) == region_free);
+
+        TEST_CHECK(hm_remove_region(&ctx, region_mem) == 0);
+        TEST_CHECK(ctx.regions == NULL);
+        TEST_CHECK(hm_available(&ctx, false) == 0);
+        hm_set_grow(&ctx, 0);
+
+        hm_free(&ctx, p_full);
+        TEST_CHECK(hm_max(&ctx) == max_block);
+
+        printf("\nPASSED\n");
+
+        printf(
+            "****************** aligned alloc chain test ******************\n");
+
+        /* equally sized free blocks are chained behind one tree node when
+         * an allocation leaves a remainder of a size already in the tree.
+         * Two holes are split into equal remainders, the chained one is
+         * 64 byte aligned for a new pfx, the one in the tree is not */
+        hm_ctx_t actx;
+        hm_init(&actx, region_mem, sizeof(region_mem));
+
+        size_t hole_size  = 2048;
+        size_t split_size = 1500;
+        uint8_t *hole[2];
+        void *sep[2];
+
+        hole[0] = hm_alloc(&actx, hole_size);
+        sep[0]  = hm_alloc(&actx,
+                          64 + ((32 - hole_size - 2 * sizeof(hm_pfx_t)) & 63));
+        hole[1] = hm_alloc(&actx, hole_size);
+        sep[1]  = hm_alloc(&actx, 64);
+        p_full  = hm_alloc(&actx, hm_max(&actx));
+        TEST_CHECK(((uintptr_t)hole[1] - (uintptr_t)hole[0]) % 64 == 32);
+        TEST_CHECK(p_full != NULL && hm_max(&actx) == 0);
+
+        split_size +=
+            -((uintptr_t)hole[1] + split_size + sizeof(hm_pfx_t)) & 63;
+        hm_free(&actx, hole[0]);
+        hm_free(&actx, hole[1]);
+        p[0] = hm_alloc(&actx, split_size);
+        p[1] = hm_alloc(&actx, split_size);
+        TEST_CHECK(p[0] == hole[0] && p[1] == hole[1]);
+        TEST_CHECK(((hm_pfx_t *)hole[0] - 1)->fblock.in_tree);
+        TEST_CHECK(!((hm_pfx_t *)hole[1] - 1)->fblock.in_tree);
+
+        p1 = hm_aligned_alloc(&actx, hole_size - split_size - sizeof(hm_pfx_t),
+                              64);
+        TEST_CHECK(p1 == hole[1] + split_size + sizeof(hm_pfx_t));
+        TEST_CHECK(((hm_pfx_t *)hole[0] - 1)->fblock.in_tree);
+
+        hm_free(&actx, p1);
+        hm_free(&actx, p[0]);
+        hm_free(&actx, p[1]);
+        hm_free(&actx, sep[0]);
+        hm_free(&actx, sep[1]);
+        hm_free(&actx, p_full);
+        TEST_CHECK(hm_available(&actx, false) ==
+                   sizeof(region_mem) - sizeof(hm_pfx_t));
+
+        printf("\nPASSED\n");
+
         printf(
             "****************** general memory footprint ******************\n");
 
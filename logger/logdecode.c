@@ -0,0 +1,31 @@
+/* Converts a binary log file of logger_save_binary into text.
+ *
+ * usage: logdecode [-t] <log> <text>
+ *   -t  starts every line with the time stamp */
+
+#include "logger_bin.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+int main(int argc, char **argv)
+{
+        bool ts = argc > 1 && !strcmp(argv[1], "-t");
+        int arg = ts ? 2 : 1;
+
+        if (argc - arg < 2) {
+                fprintf(stderr, "usage: %s [-t] <log> <text>\n", argv[0]);
+                return 1;
+        }
+
+        int64_t n = logger_bin_decode(argv[arg], argv[arg + 1], ts);
+
+        if (n < 0) {
+                fprintf(stderr, "%s: cannot decode %s\n", argv[0], argv[arg]);
+                return 1;
+        }
+        printf("%lld messages\n", (long long)n);
+
+        return 0;
+}
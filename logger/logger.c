@@ -1,11 +1,67 @@
 #include "logger.h"
+#include "logger_args.h"
+#include "logger_bin.h"
 #include "../mutex/x_mutex.h"
+#include "../ringbuffer/ringbuffer_var.h"
+#include "../ringbuffer/ringbuffer_wait.h"
+#include "../threads/x-atomic.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
 
+#ifdef _MSC_VER
+#        define LOGGER_TLS __declspec(thread)
+#else
+#        define LOGGER_TLS __thread
+#endif
+
+
+/* per thread ring, only its thread writes. In async mode rb holds packed
+ * messages for the logger thread, in per thread mode entries holds
+ * tbuf_num formatted ones for logger_next. w and r are free running. */
+typedef struct logger_ring {
+        struct logger_ring *next;
+        void *rb;
+        log_entry_t *entries;
+        uintptr_t owner;
+        uint64_t w;
+        uint8_t pad[64 - sizeof(uint64_t)]; /* w and r on other lines */
+        uint64_t r;
+} logger_ring_t;
+
+/* message in a ring, followed by args_len bytes of packed arguments */
+typedef struct {
+        uint64_t time_stamp;
+        const char *fmt;
+        uint8_t level;
+        uint8_t log;
+        uint16_t reserved;
+        uint32_t args_len;
+} logger_rec_t;
+
+/* buffer of binary mode */
+struct logger_bin {
+        uint8_t *mem;
+        size_t size;
+        size_t used;
+        int64_t msgs;
+        uint32_t num_logs; /* highest log used + 1 */
+        uint32_t num_fmts;
+        const char *fmts[LOGGER_BIN_FMTS];
+        /* open addressing table from format addresses to ids */
+        const char *keys[2 * LOGGER_BIN_FMTS];
+        uint16_t ids[2 * LOGGER_BIN_FMTS];
+};
+
+/* last async or per thread logger used by this thread and its ring */
+static LOGGER_TLS uint64_t tls_gen;
+static LOGGER_TLS logger_ring_t *tls_ring;
+
+static uint64_t logger_gen;
+
 
 const char *log_level_prefix[3] = {[LOG_LEVEL_ERROR - 1]   = "ERROR",
                                    [LOG_LEVEL_WARNING - 1] = "WARNING",
@@ -13,6 +69,40 @@ const char *log_level_prefix[3] = {[LOG_LEVEL_ERROR - 1]   = "ERROR",
 
 #define LOG_LEVEL_PREFIX_MAX_LEN 7
 
+static logger_t *logger_init_common(logger_t *logger, log_entry_t *entries,
+                                    size_t num, get_time_hook_t gth)
+{
+        logger->log_mem       = entries;
+        logger->log_base      = entries;
+        logger->log_max       = entries + num;
+        logger->level         = LOG_LEVEL_NONE;
+        logger->logs          = 0;
+        logger->get_time      = gth;
+        logger->log_prefixes  = NULL;
+        logger->rings         = NULL;
+        logger->ring_size     = 0;
+        logger->gen           = 0;
+        logger->stop          = 0;
+        logger->dropped       = 0;
+        logger->head          = 0;
+        logger->tail          = 0;
+        logger->lost          = 0;
+        logger->wrap          = 0;
+        logger->num_sinks     = 0;
+        logger->flush_ms      = 0;
+        logger->bin           = NULL;
+        logger->tbuf_num      = 0;
+        logger->rate_interval = 0;
+        logger->rate_tau      = 0;
+        logger->wait          = NULL;
+
+        xmutex_init(&logger->lock);
+        xmutex_init(&logger->flush_lock);
+
+        return logger;
+}
+
+
 logger_t *logger_init(size_t num, get_time_hook_t gth)
 {
         logger_t *logger = (logger_t *)malloc(sizeof(logger_t));
@@ -20,92 +110,763 @@ logger_t *logger_init(size_t num, get_time_hook_t gth)
                 return NULL;
         }
 
-        logger->log_mem = (log_entry_t *)malloc(sizeof(log_entry_t) * num);
-        if (!logger->log_mem) {
+        log_entry_t *entries = (log_entry_t *)malloc(sizeof(log_entry_t) * num);
+        if (!entries) {
                 free(logger);
                 return NULL;
         }
-        logger->log_base     = logger->log_mem;
-        logger->log_max      = logger->log_mem + num;
-        logger->level        = LOG_LEVEL_NONE;
-        logger->logs         = 0;
-        logger->get_time     = gth;
-        logger->log_prefixes = NULL;
-
-        xmutex_init(&logger->lock);
 
-        return logger;
+        return logger_init_common(logger, entries, num, gth);
 }
 
 
 logger_t *logger_init_static(logger_t *logger, log_entry_t *entries, size_t num,
                              get_time_hook_t gth)
 {
-        logger->log_mem      = entries;
-        logger->log_base     = entries;
-        logger->log_max      = entries + num;
-        logger->level        = LOG_LEVEL_NONE;
-        logger->logs         = 0;
-        logger->get_time     = gth;
-        logger->log_prefixes = NULL;
+        return logger_init_common(logger, entries, num, gth);
+}
 
-        xmutex_init(&logger->lock);
+
+void logger_set_prefixes(logger_t *logger, const char **log_prefixes)
+{
+        logger->log_prefixes = log_prefixes;
+}
+
+
+// two columns, two spaces, new line and null terminator subtracted
+static char log_buffer[LOG_MSG_LENGTH - 6];
+
+
+static void logger_fill(logger_t *logger, log_entry_t *entry,
+                        uint64_t time_stamp, uint8_t log_level, uint8_t log,
+                        const char *msg)
+{
+        /* difference between LOG_MSG_LENGTH - 1 and buffer size is exactly 5 as
+         * well */
+        snprintf(entry->msg, LOG_MSG_LENGTH - 1, "%s: %s: %s\n",
+                 log_level_prefix[log_level - 1], logger->log_prefixes[log],
+                 msg);
+        entry->time_stamp = time_stamp;
+}
+
+
+/* appends a formatted message, called with the lock held */
+static void logger_store(logger_t *logger, uint64_t time_stamp,
+                         uint8_t log_level, uint8_t log, const char *msg)
+{
+        if (logger->log_mem >= logger->log_max) {
+                if (!logger->wrap || logger->log_max == logger->log_base) {
+                        return;
+                }
+                logger->log_mem = logger->log_base;
+        }
+
+        logger_fill(logger, logger->log_mem, time_stamp, log_level, log, msg);
+        logger->log_mem++;
+        logger->head++;
+        if (logger->wrap && logger->log_mem >= logger->log_max) {
+                logger->log_mem = logger->log_base;
+        }
+}
+
+
+/* message length left for the text of a message */
+static size_t logger_msg_room(logger_t *logger, uint8_t log_level, uint8_t log)
+{
+        /* subtract 5 from length for two cols, two spaces and one new-line */
+        return LOG_MSG_LENGTH - strlen(log_level_prefix[log_level - 1]) -
+               strlen(logger->log_prefixes[log]) - 5;
+}
+
+
+/* finds or creates the ring of the calling thread, only the first message
+ * of a thread takes the lock. Nothing notices when a thread exits: its ring
+ * is only reused by a later thread that gets the same TLS address, so with
+ * many short lived threads the list grows until logger_free. */
+static logger_ring_t *logger_ring_get(logger_t *logger)
+{
+        if (tls_gen == logger->gen) {
+                return tls_ring;
+        }
+
+        /* the address of a thread local identifies the thread */
+        uintptr_t owner  = (uintptr_t)&tls_ring;
+        logger_ring_t *r = NULL;
+
+        xmutex_lock(&logger->lock);
+        for (r = logger->rings; r; r = r->next) {
+                if (r->owner == owner) {
+                        break;
+                }
+        }
+
+        if (!r) {
+                r = (logger_ring_t *)calloc(1, sizeof(logger_ring_t));
+                if (r) {
+                        if (logger->ring_size) {
+                                r->rb = h_ringbuff_var_alloc(logger->ring_size);
+                        } else {
+                                r->entries = (log_entry_t *)malloc(
+                                    logger->tbuf_num * sizeof(log_entry_t));
+                        }
+                        if (r->rb || r->entries) {
+                                if (r->rb) {
+                                        h_ringbuff_var_init(r->rb);
+                                }
+                                r->owner      = owner;
+                                r->next       = logger->rings;
+                                logger->rings = r;
+                        } else {
+                                free(r);
+                                r = NULL;
+                        }
+                }
+        }
+        xmutex_unlock(&logger->lock);
+
+        tls_gen  = logger->gen;
+        tls_ring = r;
+
+        return r;
+}
+
+
+
+/* per thread mode: formats into the ring of the calling thread, no lock */
+static void logger_log_threaded(logger_t *logger, uint8_t log_level,
+                                uint8_t log, char *fmt, va_list ap)
+{
+        logger_ring_t *r = logger_ring_get(logger);
+        char buf[LOG_MSG_LENGTH];
+
+        uint64_t w = r ? r->w : 0;
+        if (!r || w - x_atomic_load64(&r->r) >= logger->tbuf_num) {
+                x_atomic_fetch_add64(&logger->dropped, 1);
+                return;
+        }
+
+        vsnprintf(buf, logger_msg_room(logger, log_level, log), fmt, ap);
+        logger_fill(logger, &r->entries[w & (logger->tbuf_num - 1)],
+                    logger->get_time(), log_level, log, buf);
+
+        /* a plain store on x86, no locked instruction */
+        x_atomic_store64(&r->w, w + 1);
+}
+
+
+logger_t *logger_init_threaded(size_t num, get_time_hook_t gth)
+{
+        logger_t *logger = (logger_t *)malloc(sizeof(logger_t));
+        if (!logger) {
+                return NULL;
+        }
+
+        logger_init_common(logger, NULL, 0, gth);
+
+        logger->tbuf_num = 1;
+        while (logger->tbuf_num < num) {
+                logger->tbuf_num <<= 1;
+        }
+        logger->gen = x_atomic_fetch_add64(&logger_gen, 1) + 1;
 
         return logger;
 }
 
 
-void logger_set_prefixes(logger_t *logger, const char **log_prefixes)
+bool logger_next(logger_t *logger, log_entry_t *entry)
 {
-        logger->log_prefixes = log_prefixes;
+        logger_ring_t *best    = NULL;
+        log_entry_t *best_head = NULL;
+
+        /* k-way merge: each ring is ordered by time stamp already, take the
+         * oldest head */
+        xmutex_lock(&logger->lock);
+        for (logger_ring_t *r = logger->rings; r; r = r->next) {
+                if (!r->entries || r->r == x_atomic_load64(&r->w)) {
+                        continue;
+                }
+
+                log_entry_t *head =
+                    &r->entries[r->r & (logger->tbuf_num - 1)];
+                if (!best || head->time_stamp < best_head->time_stamp) {
+                        best      = r;
+                        best_head = head;
+                }
+        }
+
+        if (best) {
+                *entry = *best_head;
+                x_atomic_store64(&best->r, best->r + 1);
+        }
+        xmutex_unlock(&logger->lock);
+
+        return best != NULL;
+}
+
+
+#ifdef LOGGER_ASYNC
+/* formats the messages of all rings oldest first, returns their number */
+static size_t logger_async_drain(logger_t *logger)
+{
+        char buf[LOG_MSG_LENGTH];
+        size_t n = 0;
+
+        /* rings are only ever added at the head, the rest of the list does
+         * not change */
+        xmutex_lock(&logger->lock);
+        logger_ring_t *head = logger->rings;
+        xmutex_unlock(&logger->lock);
+
+        for (;;) {
+                logger_ring_t *best    = NULL;
+                logger_rec_t *best_rec = NULL;
+
+                for (logger_ring_t *r = head; r; r = r->next) {
+                        uint32_t len;
+                        logger_rec_t *rec =
+                            (logger_rec_t *)h_ringbuff_var_read(r->rb, &len);
+                        if (rec && (!best_rec || rec->time_stamp <
+                                                     best_rec->time_stamp)) {
+                                best     = r;
+                                best_rec = rec;
+                        }
+                }
+
+                if (!best) {
+                        return n;
+                }
+
+                logger_args_format(
+                    buf,
+                    logger_msg_room(logger, best_rec->level, best_rec->log),
+                    best_rec->fmt, best_rec + 1, best_rec->args_len);
+
+                xmutex_lock(&logger->lock);
+                logger_store(logger, best_rec->time_stamp, best_rec->level,
+                             best_rec->log, buf);
+                xmutex_unlock(&logger->lock);
+
+                /* pop after storing, logger_flush waits for empty rings */
+                h_ringbuff_var_pop(best->rb);
+                n++;
+        }
+}
+
+
+/* wait condition of the idle logger thread */
+static bool logger_async_pending(void *p)
+{
+        logger_t *logger = (logger_t *)p;
+        bool pending     = x_atomic_load64(&logger->stop) != 0;
+
+        xmutex_lock(&logger->lock);
+        for (logger_ring_t *r = logger->rings; r && !pending; r = r->next) {
+                pending = !h_ringbuff_var_is_empty(r->rb);
+        }
+        xmutex_unlock(&logger->lock);
+
+        return pending;
+}
+
+
+X_THREAD_FUNC(logger_thread)
+{
+        logger_t *logger = (logger_t *)p;
+        uint32_t idle    = 0;
+
+        for (;;) {
+                /* read stop first, so the last drain sees all messages
+                 * logged before logger_free */
+                uint64_t stop = x_atomic_load64(&logger->stop);
+
+                if (logger_async_drain(logger)) {
+                        idle = 0;
+                        continue;
+                }
+                if (stop) {
+                        break;
+                }
+
+                /* polling batches the messages of busy periods, waking on
+                 * every message would cost a futex call each. Once idle,
+                 * sleep until the next message. Without futexes
+                 * h_ringbuff_wait yields in a loop, keep polling there. */
+#        ifdef __gnu_linux__
+                if (++idle >= LOGGER_IDLE_POLLS) {
+                        h_ringbuff_wait(logger->wait, logger_async_pending,
+                                        logger, -1);
+                        idle = 0;
+                        continue;
+                }
+#        endif
+                x_thread_sleep_ms(1);
+        }
+
+#        ifdef __gnu_linux__
+        return NULL;
+#        endif
+}
+
+
+static void logger_log_async(logger_t *logger, uint8_t log_level, uint8_t log,
+                             char *fmt, va_list ap)
+{
+        logger_ring_t *r = logger_ring_get(logger);
+        void *rb         = r ? r->rb : NULL;
+        logger_rec_t *rec;
+
+        if (!rb || !(rec = (logger_rec_t *)h_ringbuff_var_reserve(
+                         rb, sizeof(logger_rec_t) + LOGGER_ARGS_MAX))) {
+                x_atomic_fetch_add64(&logger->dropped, 1);
+                return;
+        }
+
+        rec->time_stamp = logger->get_time();
+        rec->fmt        = fmt;
+        rec->level      = log_level;
+        rec->log        = log;
+        rec->reserved   = 0;
+        rec->args_len =
+            (uint32_t)logger_args_pack(rec + 1, LOGGER_ARGS_MAX, fmt, ap);
+
+        h_ringbuff_var_commit(rb, sizeof(logger_rec_t) + rec->args_len);
+        /* only a fence and a load while the logger thread is busy */
+        h_ringbuff_notify(logger->wait);
+}
+#endif
+
+
+logger_t *logger_init_binary(size_t size, get_time_hook_t gth)
+{
+        logger_t *logger = (logger_t *)malloc(sizeof(logger_t));
+        if (!logger) {
+                return NULL;
+        }
+
+        struct logger_bin *b = (struct logger_bin *)calloc(1, sizeof(*b));
+        if (!b || !(b->mem = (uint8_t *)malloc(size))) {
+                free(b);
+                free(logger);
+                return NULL;
+        }
+        b->size = size;
+
+        logger_init_common(logger, NULL, 0, gth);
+        logger->bin = b;
+
+        return logger;
+}
+
+
+/* id of a format string, registers new ones. Returns -1 if the table is
+ * full. Called with the lock held. */
+static int logger_bin_fmt_id(struct logger_bin *b, const char *fmt)
+{
+        const uint32_t mask = 2 * LOGGER_BIN_FMTS - 1;
+        uint32_t i = (uint32_t)(((uint64_t)(uintptr_t)fmt *
+                                 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+        for (; b->keys[i]; i = (i + 1) & mask) {
+                if (b->keys[i] == fmt) {
+                        return b->ids[i];
+                }
+        }
+
+        if (b->num_fmts >= LOGGER_BIN_FMTS) {
+                return -1;
+        }
+
+        b->keys[i]             = fmt;
+        b->ids[i]              = (uint16_t)b->num_fmts;
+        b->fmts[b->num_fmts++] = fmt;
+
+        return b->ids[i];
+}
+
+
+static void logger_log_binary(logger_t *logger, uint8_t log_level,
+                              uint8_t log, char *fmt, va_list ap)
+{
+        struct logger_bin *b = logger->bin;
+        uint8_t args[LOGGER_ARGS_MAX];
+        logger_bin_rec_t rec;
+
+        /* packing needs no lock */
+        rec.args_len = (uint32_t)logger_args_pack(args, sizeof(args), fmt, ap);
+        rec.level    = log_level;
+        rec.log      = log;
+
+        xmutex_lock(&logger->lock);
+        int id = logger_bin_fmt_id(b, fmt);
+        if (id < 0 || b->size - b->used < sizeof(rec) + rec.args_len) {
+                xmutex_unlock(&logger->lock);
+                x_atomic_fetch_add64(&logger->dropped, 1);
+                return;
+        }
+
+        rec.fmt        = (uint16_t)id;
+        rec.time_stamp = logger->get_time();
+        memcpy(b->mem + b->used, &rec, sizeof(rec));
+        memcpy(b->mem + b->used + sizeof(rec), args, rec.args_len);
+        b->used += sizeof(rec) + rec.args_len;
+        b->msgs++;
+        if (log >= b->num_logs) {
+                b->num_logs = log + 1u;
+        }
+        xmutex_unlock(&logger->lock);
+}
+
+
+static int logger_bin_put_str(FILE *f, const char *str)
+{
+        uint32_t len = str ? (uint32_t)strlen(str) : 0;
+
+        return fwrite(&len, sizeof(len), 1, f) == 1 &&
+               fwrite(str, 1, len, f) == len;
+}
+
+
+int64_t logger_save_binary(logger_t *logger, const char *path)
+{
+        struct logger_bin *b = logger->bin;
+        if (!b) {
+                return -1;
+        }
+
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+                return -1;
+        }
+
+        xmutex_lock(&logger->lock);
+
+        logger_bin_hdr_t hdr;
+        hdr.magic        = LOGGER_BIN_MAGIC;
+        hdr.version      = LOGGER_BIN_VERSION;
+        hdr.num_prefixes = b->num_logs;
+        hdr.num_fmts     = b->num_fmts;
+        hdr.reserved     = 0;
+        hdr.size         = b->used;
+
+        int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+        for (uint32_t i = 0; ok && i < b->num_logs; i++) {
+                ok = logger_bin_put_str(
+                    f, logger->log_prefixes ? logger->log_prefixes[i] : NULL);
+        }
+        for (uint32_t i = 0; ok && i < b->num_fmts; i++) {
+                ok = logger_bin_put_str(f, b->fmts[i]);
+        }
+        if (ok && b->used) {
+                ok = fwrite(b->mem, 1, b->used, f) == b->used;
+        }
+        int64_t msgs = b->msgs;
+
+        xmutex_unlock(&logger->lock);
+
+        if (fclose(f) || !ok) {
+                return -1;
+        }
+
+        return msgs;
+}
+
+
+#define LOGGER_FLUSH_BATCH 16
+
+/* copies up to LOGGER_FLUSH_BATCH new entries, oldest first */
+static size_t logger_sink_batch(logger_t *logger, log_entry_t *batch)
+{
+        uint64_t num = logger->log_max - logger->log_base;
+        size_t n;
+
+        if (logger->tbuf_num) {
+                for (n = 0; n < LOGGER_FLUSH_BATCH &&
+                            logger_next(logger, &batch[n]);
+                     n++) {
+                }
+                return n;
+        }
+
+        xmutex_lock(&logger->lock);
+        if (logger->head - logger->tail > num) {
+                logger->lost += logger->head - logger->tail - num;
+                logger->tail = logger->head - num;
+        }
+        for (n = 0; n < LOGGER_FLUSH_BATCH && logger->tail != logger->head;
+             n++) {
+                batch[n] = logger->log_base[logger->tail++ % num];
+        }
+        xmutex_unlock(&logger->lock);
+
+        return n;
+}
+
+
+void logger_flush_sinks(logger_t *logger)
+{
+        log_entry_t batch[LOGGER_FLUSH_BATCH];
+        size_t n;
+
+        if (!logger->num_sinks) {
+                return;
+        }
+
+        /* copy under the lock, write without it. The flush lock keeps the
+         * flusher thread and logger_flush from interleaving batches */
+        xmutex_lock(&logger->flush_lock);
+        do {
+                n = logger_sink_batch(logger, batch);
+                for (size_t i = 0; i < n; i++) {
+                        batch[i].msg[LOG_MSG_LENGTH - 1] = '\0';
+                        size_t len = strlen(batch[i].msg);
+                        for (size_t s = 0; s < logger->num_sinks; s++) {
+                                logger->sinks[s]->write(logger->sinks[s],
+                                                        batch[i].time_stamp,
+                                                        batch[i].msg, len);
+                        }
+                }
+        } while (n == LOGGER_FLUSH_BATCH);
+
+        for (size_t s = 0; s < logger->num_sinks; s++) {
+                if (logger->sinks[s]->flush) {
+                        logger->sinks[s]->flush(logger->sinks[s]);
+                }
+        }
+        xmutex_unlock(&logger->flush_lock);
+}
+
+
+#ifdef LOGGER_ASYNC
+X_THREAD_FUNC(logger_flusher)
+{
+        logger_t *logger = (logger_t *)p;
+
+        while (!x_atomic_load64(&logger->stop)) {
+                logger_flush_sinks(logger);
+                x_thread_sleep_ms(logger->flush_ms);
+        }
+
+#        ifdef __gnu_linux__
+        return NULL;
+#        endif
+}
+#endif
+
+
+int logger_add_sink(logger_t *logger, logger_sink_t *sink)
+{
+        if (!sink || logger->num_sinks >= LOGGER_SINKS_MAX ||
+            logger->flush_ms) {
+                return -1;
+        }
+
+        logger->sinks[logger->num_sinks++] = sink;
+
+        return 0;
+}
+
+
+int logger_start_flusher(logger_t *logger, uint32_t period_ms)
+{
+#ifdef LOGGER_ASYNC
+        if (logger->flush_ms || !period_ms) {
+                return -1;
+        }
+
+        logger->flush_ms = period_ms;
+        logger->flusher  = x_thread_create(logger_flusher, logger);
+        if (!logger->flusher) {
+                logger->flush_ms = 0;
+                return -1;
+        }
+
+        return 0;
+#else
+        (void)logger, (void)period_ms;
+        return -1;
+#endif
+}
+
+
+void logger_set_wrap(logger_t *logger, bool wrap)
+{
+        xmutex_lock(&logger->lock);
+        logger->wrap = wrap;
+        xmutex_unlock(&logger->lock);
+}
+
+
+uint64_t logger_lost(logger_t *logger)
+{
+        xmutex_lock(&logger->lock);
+        uint64_t lost = logger->lost;
+        xmutex_unlock(&logger->lock);
+
+        return lost;
+}
+
+
+logger_t *logger_init_async(size_t num, size_t ring_size, get_time_hook_t gth)
+{
+#ifdef LOGGER_ASYNC
+        /* every ring has to fit at least one message of maximum size */
+        if (ring_size < 2 * (sizeof(logger_rec_t) + LOGGER_ARGS_MAX +
+                             sizeof(h_ringbuff_var_rec_t))) {
+                return NULL;
+        }
+
+        logger_t *logger = logger_init(num, gth);
+        if (!logger) {
+                return NULL;
+        }
+
+        logger->ring_size = ring_size;
+        logger->gen       = x_atomic_fetch_add64(&logger_gen, 1) + 1;
+        logger->wait      = (struct h_ringbuff_wait *)malloc(
+            sizeof(h_ringbuff_wait_t));
+        if (logger->wait) {
+                h_ringbuff_wait_init(logger->wait, 1, false);
+                logger->thread = x_thread_create(logger_thread, logger);
+        }
+        if (!logger->wait || !logger->thread) {
+                free(logger->wait);
+                free(logger->log_base);
+                free(logger);
+                return NULL;
+        }
+
+        return logger;
+#else
+        (void)num, (void)ring_size, (void)gth;
+        return NULL;
+#endif
+}
+
+
+void logger_flush(logger_t *logger)
+{
+        for (;;) {
+                bool empty = true;
+
+                xmutex_lock(&logger->lock);
+                for (logger_ring_t *r = logger->rings; r; r = r->next) {
+                        if (r->rb && !h_ringbuff_var_is_empty(r->rb)) {
+                                empty = false;
+                                break;
+                        }
+                }
+                xmutex_unlock(&logger->lock);
+
+                if (empty) {
+                        break;
+                }
+#ifdef LOGGER_ASYNC
+                x_thread_sleep_ms(1);
+#endif
+        }
+
+        logger_flush_sinks(logger);
+}
+
+
+uint64_t logger_dropped(logger_t *logger)
+{
+        return x_atomic_load64(&logger->dropped);
 }
 
 
 void logger_free(logger_t *logger)
 {
+#ifdef LOGGER_ASYNC
+        x_atomic_store64(&logger->stop, 1);
+        if (logger->ring_size) {
+                h_ringbuff_notify(logger->wait);
+                x_thread_wait_infinite(logger->thread);
+                h_ringbuff_wait_destroy(logger->wait);
+                free(logger->wait);
+        }
+        if (logger->flush_ms) {
+                x_thread_wait_infinite(logger->flusher);
+        }
+#endif
+
+        /* pass what is left, then close the sinks */
+        logger_flush_sinks(logger);
+        for (size_t s = 0; s < logger->num_sinks; s++) {
+                logger->sinks[s]->close(logger->sinks[s]);
+        }
+
+        logger_ring_t *r = logger->rings;
+        while (r) {
+                logger_ring_t *next = r->next;
+                if (r->rb) {
+                        h_ringbuff_var_free(r->rb);
+                }
+                free(r->entries);
+                free(r);
+                r = next;
+        }
+
+        if (logger->bin) {
+                free(logger->bin->mem);
+                free(logger->bin);
+        }
+
         free(logger->log_base);
         free(logger);
 }
 
 
-// two columns, two spaces, new line and null terminator subtracted
-static char log_buffer[LOG_MSG_LENGTH - 6];
+static bool logger_is_enabled(logger_t *logger, uint8_t log_level,
+                              uint8_t log)
+{
+        if (logger->level == LOG_LEVEL_NONE) {
+                /* logs disabled */
+                return false;
+        }
+
+        if (logger->level < log_level || log_level > LOG_LEVEL_INFO) {
+                return false;
+        }
+
+        return (logger->logs & (1ULL << log)) != 0;
+}
 
 
 static void logger_log(logger_t *logger, uint8_t log_level, uint8_t log,
                        char *fmt, va_list ap)
 {
-        if (logger->level == LOG_LEVEL_NONE) {
-                /* logs disabled */
+        if (!logger_is_enabled(logger, log_level, log)) {
                 return;
         }
 
-        if (logger->level < log_level || log_level > LOG_LEVEL_INFO) {
+#ifdef LOGGER_ASYNC
+        if (logger->ring_size) {
+                logger_log_async(logger, log_level, log, fmt, ap);
                 return;
         }
+#endif
 
-        if (!(logger->logs & (1ULL << log))) {
+        if (logger->bin) {
+                logger_log_binary(logger, log_level, log, fmt, ap);
                 return;
         }
 
-        if (logger->log_mem >= logger->log_max) {
+        if (logger->tbuf_num) {
+                logger_log_threaded(logger, log_level, log, fmt, ap);
                 return;
         }
 
         xmutex_lock(&logger->lock);
+        /* a full logger drops messages unless wrap has been set since */
+        if (!logger->wrap && logger->log_mem >= logger->log_max) {
+                xmutex_unlock(&logger->lock);
+                return;
+        }
         memset(log_buffer, 0, sizeof(log_buffer));
-        /* subtract 5 from length for two cols, two spaces and one new-line */
-        vsnprintf(log_buffer,
-                  LOG_MSG_LENGTH - strlen(log_level_prefix[log_level - 1]) -
-                      strlen(logger->log_prefixes[log]) - 5,
-                  fmt, ap);
-        /* difference between LOG_MSG_LENGTH - 1 and buffer size is exactly 5 as
-         * well */
-        snprintf(logger->log_mem->msg, LOG_MSG_LENGTH - 1, "%s: %s: %s\n",
-                 log_level_prefix[log_level - 1], logger->log_prefixes[log],
-                 log_buffer);
-        logger->log_mem->time_stamp = logger->get_time();
-        logger->log_mem++;
+        vsnprintf(log_buffer, logger_msg_room(logger, log_level, log), fmt,
+                  ap);
+        logger_store(logger, logger->get_time(), log_level, log, log_buffer);
         xmutex_unlock(&logger->lock);
 }
 
@@ -158,6 +919,75 @@ void logger_err_v(logger_t *logger, uint8_t log, char *fmt, va_list args)
 }
 
 
+void logger_set_rate_limit(logger_t *logger, uint32_t burst,
+                           uint64_t interval)
+{
+        xmutex_lock(&logger->lock);
+        logger->rate_interval = interval;
+        logger->rate_tau      = burst ? (burst - 1) * interval : 0;
+        xmutex_unlock(&logger->lock);
+}
+
+
+/* token bucket kept as the time it is full again (GCRA), one CAS and no
+ * lock per call */
+static bool logger_site_pass(logger_t *logger, logger_site_t *site)
+{
+        uint64_t now = logger->get_time();
+        uint64_t tat = x_atomic_load64(&site->tat);
+        uint64_t next;
+
+        do {
+                uint64_t t = tat > now ? tat : now;
+                if (t - now > logger->rate_tau) {
+                        return false;
+                }
+                next = t + logger->rate_interval;
+        } while (!x_atomic_cas64(&site->tat, &tat, next));
+
+        return true;
+}
+
+
+static void logger_log_fmt(logger_t *logger, uint8_t log_level, uint8_t log,
+                           char *fmt, ...)
+{
+        va_list ap;
+
+        va_start(ap, fmt);
+        logger_log(logger, log_level, log, fmt, ap);
+        va_end(ap);
+}
+
+
+void logger_log_site(logger_t *logger, logger_site_t *site, uint8_t log_level,
+                     uint8_t log, char *fmt, ...)
+{
+        va_list ap;
+
+        if (!logger_is_enabled(logger, log_level, log)) {
+                return;
+        }
+
+        if (logger->rate_interval) {
+                if (!logger_site_pass(logger, site)) {
+                        x_atomic_fetch_add64(&site->suppressed, 1);
+                        return;
+                }
+                if (x_atomic_load64(&site->suppressed)) {
+                        uint64_t n = x_atomic_fetch_and64(&site->suppressed, 0);
+                        logger_log_fmt(logger, log_level, log,
+                                       "message repeated %llu times",
+                                       (unsigned long long)n);
+                }
+        }
+
+        va_start(ap, fmt);
+        logger_log(logger, log_level, log, fmt, ap);
+        va_end(ap);
+}
+
+
 void logger_enable_log(logger_t *logger, uint8_t log)
 {
         xmutex_lock(&logger->lock);
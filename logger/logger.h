@@ -15,12 +15,24 @@
 
 #define LOG_MSG_LENGTH 128
 
+/* async mode: max bytes of packed arguments per message */
+#define LOGGER_ARGS_MAX 256
+/* async mode: empty 1 ms polls before the logger thread sleeps until the
+ * next message */
+#define LOGGER_IDLE_POLLS 10
+
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 #include "../mutex/xmutex.h"
+#include "../threads/x-threads.h"
+
+#if defined(X_THREAD_SUPPORT) && !defined(X_THREADS_TIRTOS)
+#        define LOGGER_ASYNC
+#endif
 
 
 typedef struct {
@@ -32,8 +44,22 @@ typedef struct {
 typedef uint64_t (*get_time_hook_t)(void);
 
 
+#define LOGGER_SINKS_MAX 4
+
+/* output for log entries, called by the flusher only (see logger_sink.h) */
+typedef struct logger_sink {
+        /* msg is a '\0' terminated line of len characters */
+        void (*write)(struct logger_sink *sink, uint64_t time_stamp,
+                      const char *msg, size_t len);
+        void (*flush)(struct logger_sink *sink); /* may be NULL */
+        void (*close)(struct logger_sink *sink); /* frees the sink */
+        void *ctx;
+} logger_sink_t;
+
+
 typedef struct {
         xmutex_t lock;
+        xmutex_t flush_lock; /* one caller of logger_flush_sinks at a time */
         log_entry_t *log_base;
         log_entry_t *log_mem;
         log_entry_t *log_max;
@@ -41,12 +67,98 @@ typedef struct {
         uint8_t level;
         uint64_t logs;
         const char **log_prefixes;
+        /* async mode if ring_size != 0 */
+        struct logger_ring *rings;
+        uint64_t ring_size;
+        uint64_t gen;
+        uint64_t stop;
+        uint64_t dropped;
+        /* entries stored so far and entries passed to the sinks */
+        uint64_t head;
+        uint64_t tail;
+        uint64_t lost;
+        uint8_t wrap;
+        logger_sink_t *sinks[LOGGER_SINKS_MAX];
+        size_t num_sinks;
+        uint32_t flush_ms; /* flusher running if != 0 */
+        struct logger_bin *bin; /* binary mode if != NULL */
+        uint64_t tbuf_num;      /* per thread mode if != 0 */
+        /* call site rate limit, off if rate_interval == 0 */
+        uint64_t rate_interval;
+        uint64_t rate_tau;
+        struct h_ringbuff_wait *wait; /* async mode, wakes the logger thread */
+#ifdef LOGGER_ASYNC
+        x_thread_t thread;
+        x_thread_t flusher;
+#endif
 } logger_t;
 
 
+/* state of one rate limited call site, see LOGGER_INFO_LIMITED */
+typedef struct logger_site {
+        uint64_t tat; /* time the bucket is full again */
+        uint64_t suppressed;
+} logger_site_t;
+
+
 logger_t *logger_init(size_t num, get_time_hook_t gth);
 logger_t *logger_init_static(logger_t *logger, log_entry_t *entries, size_t num,
                              get_time_hook_t gth);
+/* async mode: callers only copy the format pointer, the arguments (see
+ * logger_args.h) and the time stamp into a lock free ring of ring_size bytes
+ * per thread. A background thread formats the messages into the num
+ * entries, oldest first among the ones waiting in the rings. A message that
+ * is committed late may follow newer ones of other threads, each thread's
+ * messages stay in order. The format string must stay valid until the
+ * message is formatted, string arguments are copied. Messages are dropped
+ * (and counted) while a thread's ring is full. */
+logger_t *logger_init_async(size_t num, size_t ring_size,
+                            get_time_hook_t gth);
+/* per thread mode: every thread formats its messages into its own ring of
+ * num entries (rounded up to a power of 2), without taking the lock. The
+ * rings are created on the first message of a thread and only freed by
+ * logger_free, thread churn makes them pile up. Messages are dropped (and
+ * counted) while a ring is full. gth has to be one clock for all threads,
+ * logger_next orders by it. */
+logger_t *logger_init_threaded(size_t num, get_time_hook_t gth);
+/* per thread mode: removes the oldest entry of all rings into entry. Each ring
+ * is in time stamp order, so consecutive calls give one merged view. A message
+ * that is still being written while a newer one is returned comes out of order.
+ * Returns false if all rings are empty. The sinks use it as well, do not mix
+ * both. */
+bool logger_next(logger_t *logger, log_entry_t *entry);
+/* binary mode: messages are stored as the id of their format string, the
+ * time stamp and the packed arguments in a buffer of size bytes, nothing is
+ * formatted while logging. Format strings must be constant, they are
+ * identified by their address. Messages are dropped (and counted) when the
+ * buffer is full, sinks and ring mode are not used. */
+logger_t *logger_init_binary(size_t size, get_time_hook_t gth);
+/* writes the messages of binary mode with their format strings and prefixes
+ * into path, logger_bin_decode (logdecode) produces the text. Returns the
+ * number of messages or -1. */
+int64_t logger_save_binary(logger_t *logger, const char *path);
+/* waits until all messages logged so far are formatted and written to the
+ * sinks */
+void logger_flush(logger_t *logger);
+
+/* ring mode: when all entries are used, the oldest ones are overwritten
+ * instead of dropping new messages. log_mem is the next entry to write. */
+void logger_set_wrap(logger_t *logger, bool wrap);
+
+/* adds a sink that receives every stored entry, the logger closes it on
+ * logger_free. Returns 0 or -1 if LOGGER_SINKS_MAX sinks are added. Sinks
+ * must be added before the flusher is started. */
+int logger_add_sink(logger_t *logger, logger_sink_t *sink);
+/* starts a thread that passes new entries to the sinks every period_ms.
+ * Without it, logger_flush_sinks has to be called. Returns 0 or -1. */
+int logger_start_flusher(logger_t *logger, uint32_t period_ms);
+/* passes all new entries to the sinks and flushes them, concurrent calls
+ * and the flusher thread take turns */
+void logger_flush_sinks(logger_t *logger);
+/* number of entries overwritten in ring mode before reaching the sinks */
+uint64_t logger_lost(logger_t *logger);
+/* number of messages dropped by full rings or a full binary buffer */
+uint64_t logger_dropped(logger_t *logger);
 void logger_set_prefixes(logger_t *logger, const char **log_prefixes);
 void logger_free(logger_t *logger);
 void logger_info(logger_t *logger, uint8_t log, char *fmt, ...);
@@ -56,6 +168,33 @@ void logger_info_v(logger_t *logger, uint8_t log, char *fmt, va_list args);
 void logger_warn_v(logger_t *logger, uint8_t log, char *fmt, va_list args);
 void logger_err_v(logger_t *logger, uint8_t log, char *fmt, va_list args);
 
+/* rate limit of LOGGER_*_LIMITED: every call site may log burst messages
+ * at once and one more per interval (in get_time units) after that. The
+ * others only count, nothing is formatted or stored. The next message that
+ * passes is preceded by "message repeated N times", so the count of a last
+ * run of suppressed messages only shows up once that site logs again.
+ * interval 0 turns the limit off. */
+void logger_set_rate_limit(logger_t *logger, uint32_t burst,
+                           uint64_t interval);
+void logger_log_site(logger_t *logger, logger_site_t *site, uint8_t log_level,
+                     uint8_t log, char *fmt, ...);
+
+/* like logger_info etc. with a rate limit per call site. The site state is
+ * a static of the call site, if it logs to several loggers they share one
+ * bucket. Use logger_log_site with a logger_site_t per logger instead. */
+#define LOGGER_LOG_LIMITED(LOGGER, LEVEL, LOG, ...)                         \
+        do {                                                                \
+                static logger_site_t logger_site_;                          \
+                logger_log_site(LOGGER, &logger_site_, LEVEL, LOG,          \
+                                __VA_ARGS__);                               \
+        } while (0)
+#define LOGGER_INFO_LIMITED(LOGGER, LOG, ...) \
+        LOGGER_LOG_LIMITED(LOGGER, LOG_LEVEL_INFO, LOG, __VA_ARGS__)
+#define LOGGER_WARN_LIMITED(LOGGER, LOG, ...) \
+        LOGGER_LOG_LIMITED(LOGGER, LOG_LEVEL_WARNING, LOG, __VA_ARGS__)
+#define LOGGER_ERR_LIMITED(LOGGER, LOG, ...) \
+        LOGGER_LOG_LIMITED(LOGGER, LOG_LEVEL_ERROR, LOG, __VA_ARGS__)
+
 void logger_enable_log(logger_t *logger, uint8_t log);
 void logger_disable_log(logger_t *logger, uint8_t log);
 void logger_enable_all(logger_t *logger);
@@ -0,0 +1,369 @@
+#include "logger_args.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#define LA_SPEC_MAX 32
+
+enum la_len { LA_NONE, LA_HH, LA_H, LA_L, LA_LL, LA_J, LA_Z, LA_T, LA_LD };
+
+/* one conversion of a format string */
+typedef struct {
+        char text[LA_SPEC_MAX]; /* normalized spec for snprintf */
+        char conv;
+        enum la_len len;
+        int star_width;
+        int star_prec;
+        int prec; /* literal precision, -1 if none */
+} la_spec_t;
+
+
+static int la_is_int(char c)
+{
+        return c && strchr("diouxX", c) != NULL;
+}
+
+
+static int la_is_float(char c)
+{
+        return c && strchr("fFeEgGaA", c) != NULL;
+}
+
+
+/* parses the spec after '%', returns the position behind it. Integer
+ * conversions get an "ll" length, all others none. Overlong flags, width or
+ * precision are cut, the rest of the spec always fits */
+#define LA_ADD(C)                                 \
+        do {                                      \
+                if (t < LA_SPEC_MAX - 6) {        \
+                        s->text[t++] = (C);       \
+                }                                 \
+        } while (0)
+
+static const char *la_parse(const char *p, la_spec_t *s)
+{
+        size_t t = 0;
+
+        s->text[t++]  = '%';
+        s->star_width = 0;
+        s->star_prec  = 0;
+        s->prec       = -1;
+        s->len        = LA_NONE;
+
+        while (*p && strchr("-+ #0", *p)) {
+                LA_ADD(*p++);
+        }
+        if (*p == '*') {
+                s->star_width = 1;
+                LA_ADD(*p++);
+        } else {
+                while (*p >= '0' && *p <= '9') {
+                        LA_ADD(*p++);
+                }
+        }
+        if (*p == '.') {
+                LA_ADD(*p++);
+                if (*p == '*') {
+                        s->star_prec = 1;
+                        LA_ADD(*p++);
+                } else {
+                        s->prec = 0;
+                        while (*p >= '0' && *p <= '9') {
+                                s->prec = s->prec * 10 + (*p - '0');
+                                LA_ADD(*p++);
+                        }
+                }
+        }
+
+        switch (*p) {
+        case 'h':
+                p++;
+                s->len = LA_H;
+                if (*p == 'h') {
+                        p++;
+                        s->len = LA_HH;
+                }
+                break;
+        case 'l':
+                p++;
+                s->len = LA_L;
+                if (*p == 'l') {
+                        p++;
+                        s->len = LA_LL;
+                }
+                break;
+        case 'j': p++, s->len = LA_J; break;
+        case 'z': p++, s->len = LA_Z; break;
+        case 't': p++, s->len = LA_T; break;
+        case 'L': p++, s->len = LA_LD; break;
+        }
+
+        s->conv = *p;
+        if (la_is_int(s->conv)) {
+                s->text[t++] = 'l';
+                s->text[t++] = 'l';
+        }
+        if (*p) {
+                s->text[t++] = *p++;
+        }
+        s->text[t] = '\0';
+
+        return p;
+}
+
+
+static int64_t la_get_signed(la_spec_t *s, va_list *ap)
+{
+        switch (s->len) {
+        case LA_HH: return (signed char)va_arg(*ap, int);
+        case LA_H: return (short)va_arg(*ap, int);
+        case LA_L: return va_arg(*ap, long);
+        case LA_LL: return va_arg(*ap, long long);
+        case LA_J: return va_arg(*ap, intmax_t);
+        case LA_Z: return (int64_t)va_arg(*ap, size_t);
+        case LA_T: return va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, int);
+        }
+}
+
+
+static uint64_t la_get_unsigned(la_spec_t *s, va_list *ap)
+{
+        switch (s->len) {
+        case LA_HH: return (unsigned char)va_arg(*ap, unsigned int);
+        case LA_H: return (unsigned short)va_arg(*ap, unsigned int);
+        case LA_L: return va_arg(*ap, unsigned long);
+        case LA_LL: return va_arg(*ap, unsigned long long);
+        case LA_J: return va_arg(*ap, uintmax_t);
+        case LA_Z: return va_arg(*ap, size_t);
+        case LA_T: return (uint64_t)va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, unsigned int);
+        }
+}
+
+
+static int la_put(char *dst, size_t max, size_t *pos, const void *v,
+                  size_t size)
+{
+        if (*pos + size > max) {
+                return 0;
+        }
+
+        memcpy(dst + *pos, v, size);
+        *pos += size;
+
+        return 1;
+}
+
+
+size_t logger_args_pack(void *dst, size_t max, const char *fmt, va_list ap)
+{
+        char *d    = (char *)dst;
+        size_t pos = 0;
+        la_spec_t s;
+        va_list aq;
+
+        /* va_list may be an array type, work on a copy that can be passed
+         * by address */
+        va_copy(aq, ap);
+
+        while (*fmt) {
+                if (*fmt++ != '%') {
+                        continue;
+                }
+                if (*fmt == '%') {
+                        fmt++;
+                        continue;
+                }
+
+                fmt = la_parse(fmt, &s);
+
+                int64_t star;
+                int prec = s.prec;
+                if (s.star_width) {
+                        star = va_arg(aq, int);
+                        if (!la_put(d, max, &pos, &star, sizeof(star))) {
+                                break;
+                        }
+                }
+                if (s.star_prec) {
+                        star = va_arg(aq, int);
+                        prec = (int)star;
+                        if (!la_put(d, max, &pos, &star, sizeof(star))) {
+                                break;
+                        }
+                }
+
+                int ok = 1;
+                if (s.conv == 'd' || s.conv == 'i') {
+                        int64_t v = la_get_signed(&s, &aq);
+                        ok        = la_put(d, max, &pos, &v, sizeof(v));
+                } else if (la_is_int(s.conv)) {
+                        uint64_t v = la_get_unsigned(&s, &aq);
+                        ok         = la_put(d, max, &pos, &v, sizeof(v));
+                } else if (s.conv == 'c') {
+                        int64_t v = va_arg(aq, int);
+                        ok        = la_put(d, max, &pos, &v, sizeof(v));
+                } else if (la_is_float(s.conv)) {
+                        double v = s.len == LA_LD
+                                       ? (double)va_arg(aq, long double)
+                                       : va_arg(aq, double);
+                        ok = la_put(d, max, &pos, &v, sizeof(v));
+                } else if (s.conv == 'p') {
+                        uint64_t v = (uintptr_t)va_arg(aq, void *);
+                        ok         = la_put(d, max, &pos, &v, sizeof(v));
+                } else if (s.conv == 's') {
+                        const char *str = va_arg(aq, const char *);
+                        size_t limit    = LOGGER_ARGS_STR_MAX;
+                        if (!str) {
+                                str = "(null)";
+                        }
+                        if (prec >= 0 && (size_t)prec < limit) {
+                                limit = (size_t)prec;
+                        }
+                        size_t slen = 0;
+                        while (slen < limit && str[slen]) {
+                                slen++;
+                        }
+                        /* shorten the string to what fits */
+                        if (pos + sizeof(uint32_t) + 1 > max) {
+                                break;
+                        }
+                        if (pos + sizeof(uint32_t) + slen + 1 > max) {
+                                slen = max - pos - sizeof(uint32_t) - 1;
+                        }
+                        uint32_t l = (uint32_t)slen;
+                        la_put(d, max, &pos, &l, sizeof(l));
+                        la_put(d, max, &pos, str, slen);
+                        d[pos++] = '\0';
+                } else if (s.conv == 'n') {
+                        (void)va_arg(aq, void *);
+                }
+                if (!ok) {
+                        break;
+                }
+        }
+
+        va_end(aq);
+
+        return pos;
+}
+
+
+static int la_get(const char *args, size_t len, size_t *pos, void *v,
+                  size_t size)
+{
+        if (*pos + size > len) {
+                return 0;
+        }
+
+        memcpy(v, args + *pos, size);
+        *pos += size;
+
+        return 1;
+}
+
+
+/* prints one value with the optional star arguments in front */
+#define LA_PRINT(VAL)                                                       \
+        do {                                                                \
+                size_t room = o < n ? n - o : 0;                            \
+                char *at    = room ? out + o : NULL;                        \
+                int r;                                                      \
+                if (s.star_width && s.star_prec) {                          \
+                        r = snprintf(at, room, s.text, (int)w, (int)p, VAL); \
+                } else if (s.star_width) {                                  \
+                        r = snprintf(at, room, s.text, (int)w, VAL);        \
+                } else if (s.star_prec) {                                   \
+                        r = snprintf(at, room, s.text, (int)p, VAL);        \
+                } else {                                                    \
+                        r = snprintf(at, room, s.text, VAL);                \
+                }                                                           \
+                if (r > 0) {                                                \
+                        o += (size_t)r;                                     \
+                }                                                           \
+        } while (0)
+
+
+size_t logger_args_format(char *out, size_t n, const char *fmt,
+                          const void *args, size_t len)
+{
+        const char *a = (const char *)args;
+        size_t pos    = 0;
+        size_t o      = 0;
+        la_spec_t s;
+
+        while (*fmt) {
+                if (*fmt != '%' || fmt[1] == '%') {
+                        if (o + 1 < n) {
+                                out[o] = *fmt;
+                        }
+                        o++;
+                        fmt += *fmt == '%' ? 2 : 1;
+                        continue;
+                }
+
+                const char *start = fmt;
+                fmt               = la_parse(fmt + 1, &s);
+
+                int64_t w = 0;
+                int64_t p = 0;
+                if ((s.star_width && !la_get(a, len, &pos, &w, sizeof(w))) ||
+                    (s.star_prec && !la_get(a, len, &pos, &p, sizeof(p)))) {
+                        break;
+                }
+
+                if (s.conv == 'd' || s.conv == 'i' || s.conv == 'c') {
+                        int64_t v;
+                        if (!la_get(a, len, &pos, &v, sizeof(v))) {
+                                break;
+                        }
+                        if (s.conv == 'c') {
+                                LA_PRINT((int)v);
+                        } else {
+                                LA_PRINT((long long)v);
+                        }
+                } else if (la_is_int(s.conv)) {
+                        uint64_t v;
+                        if (!la_get(a, len, &pos, &v, sizeof(v))) {
+                                break;
+                        }
+                        LA_PRINT((unsigned long long)v);
+                } else if (la_is_float(s.conv)) {
+                        double v;
+                        if (!la_get(a, len, &pos, &v, sizeof(v))) {
+                                break;
+                        }
+                        LA_PRINT(v);
+                } else if (s.conv == 'p') {
+                        uint64_t v;
+                        if (!la_get(a, len, &pos, &v, sizeof(v))) {
+                                break;
+                        }
+                        LA_PRINT((void *)(uintptr_t)v);
+                } else if (s.conv == 's') {
+                        uint32_t l;
+                        if (!la_get(a, len, &pos, &l, sizeof(l)) ||
+                            pos + l + 1 > len) {
+                                break;
+                        }
+                        LA_PRINT(a + pos);
+                        pos += l + 1;
+                } else if (s.conv != 'n') {
+                        /* unknown conversion, copy it */
+                        for (; start < fmt; start++, o++) {
+                                if (o + 1 < n) {
+                                        out[o] = *start;
+                                }
+                        }
+                }
+        }
+
+        if (n) {
+                out[o < n ? o : n - 1] = '\0';
+        }
+
+        return o;
+}
@@ -0,0 +1,42 @@
+#ifndef HELPERS_LOGGER_ARGS_H
+#define HELPERS_LOGGER_ARGS_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+/* Deferred printf formatting.
+ *
+ * logger_args_pack walks a printf format string and copies the raw values of
+ * its arguments into a byte buffer, logger_args_format walks the same format
+ * string later on (another thread or another process) and produces the text.
+ * Values are stored without type tags in the order of the conversions:
+ *   integers, characters, pointers, '*' width and precision   8 bytes
+ *   floating point (long double is narrowed to double)        8 bytes
+ *   strings   uint32_t length, the characters and a '\0'
+ * Values are unaligned. %n is ignored, unknown conversions are copied to the
+ * output as they are and consume no argument. */
+
+#define LOGGER_ARGS_STR_MAX 1024 /* longer %s arguments are truncated */
+
+
+/*! @brief copies the arguments of fmt into dst
+ *  @param dst  destination buffer
+ *  @param max  size of dst, arguments that do not fit are left out
+ *  @param fmt  printf format string
+ *  @param ap   its arguments
+ *  @return     number of bytes written to dst
+ */
+size_t logger_args_pack(void *dst, size_t max, const char *fmt, va_list ap);
+
+/*! @brief formats packed arguments like snprintf
+ *  @param out   destination, always '\0' terminated if n > 0
+ *  @param n     size of out
+ *  @param fmt   format string given to logger_args_pack
+ *  @param args  packed arguments
+ *  @param len   number of bytes in args, missing values end the output
+ *  @return      length of the complete text, as snprintf
+ */
+size_t logger_args_format(char *out, size_t n, const char *fmt,
+                          const void *args, size_t len);
+
+#endif
@@ -0,0 +1,163 @@
+#include "logger_bin.h"
+#include "logger_args.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGGER_BIN_STR_MAX (1 << 20) /* longer strings mean a broken file */
+
+static const char *bin_level_prefix[3] = {"ERROR", "WARNING", "INFO"};
+
+
+/* reads a length prefixed string, returns it '\0' terminated or NULL */
+static char *logger_bin_get_str(FILE *f)
+{
+        uint32_t len;
+
+        if (fread(&len, sizeof(len), 1, f) != 1 || len > LOGGER_BIN_STR_MAX) {
+                return NULL;
+        }
+
+        char *str = (char *)malloc(len + 1);
+        if (!str) {
+                return NULL;
+        }
+        if (fread(str, 1, len, f) != len) {
+                free(str);
+                return NULL;
+        }
+        str[len] = '\0';
+
+        return str;
+}
+
+
+static char **logger_bin_get_strs(FILE *f, uint32_t num)
+{
+        char **strs = (char **)calloc(num ? num : 1, sizeof(char *));
+        if (!strs) {
+                return NULL;
+        }
+
+        for (uint32_t i = 0; i < num; i++) {
+                if (!(strs[i] = logger_bin_get_str(f))) {
+                        for (uint32_t k = 0; k < i; k++) {
+                                free(strs[k]);
+                        }
+                        free(strs);
+                        return NULL;
+                }
+        }
+
+        return strs;
+}
+
+
+static void logger_bin_free_strs(char **strs, uint32_t num)
+{
+        if (!strs) {
+                return;
+        }
+        for (uint32_t i = 0; i < num; i++) {
+                free(strs[i]);
+        }
+        free(strs);
+}
+
+
+/* writes the messages of the records, returns their number or -1 */
+static int64_t logger_bin_records(FILE *fi, FILE *fo, logger_bin_hdr_t *hdr,
+                                  char **prefixes, char **fmts,
+                                  bool time_stamps)
+{
+        uint8_t args[LOGGER_ARGS_MAX];
+        size_t text_size = 256;
+        char *text       = (char *)malloc(text_size);
+        uint64_t left    = hdr->size;
+        int64_t n        = 0;
+        logger_bin_rec_t rec;
+
+        if (!text) {
+                return -1;
+        }
+
+        /* a partially written record at the end is ignored */
+        while (left >= sizeof(rec) && fread(&rec, sizeof(rec), 1, fi) == 1) {
+                if (rec.args_len > sizeof(args) || rec.fmt >= hdr->num_fmts ||
+                    rec.log >= hdr->num_prefixes || rec.level < 1 ||
+                    rec.level > 3) {
+                        n = -1;
+                        break;
+                }
+                if (fread(args, 1, rec.args_len, fi) != rec.args_len) {
+                        break;
+                }
+                left -= sizeof(rec) + rec.args_len;
+
+                size_t len = logger_args_format(NULL, 0, fmts[rec.fmt], args,
+                                                rec.args_len);
+                if (len >= text_size) {
+                        char *t = (char *)realloc(text, len + 1);
+                        if (!t) {
+                                n = -1;
+                                break;
+                        }
+                        text      = t;
+                        text_size = len + 1;
+                }
+                logger_args_format(text, text_size, fmts[rec.fmt], args,
+                                   rec.args_len);
+
+                if (time_stamps) {
+                        fprintf(fo, "%llu ",
+                                (unsigned long long)rec.time_stamp);
+                }
+                fprintf(fo, "%s: %s: %s\n", bin_level_prefix[rec.level - 1],
+                        prefixes[rec.log], text);
+                n++;
+        }
+
+        free(text);
+
+        return n;
+}
+
+
+int64_t logger_bin_decode(const char *in, const char *out, bool time_stamps)
+{
+        FILE *fi = fopen(in, "rb");
+        if (!fi) {
+                return -1;
+        }
+
+        logger_bin_hdr_t hdr;
+        if (fread(&hdr, sizeof(hdr), 1, fi) != 1 ||
+            hdr.magic != LOGGER_BIN_MAGIC ||
+            hdr.version != LOGGER_BIN_VERSION || hdr.num_prefixes > LOGS_MAX ||
+            hdr.num_fmts > LOGGER_BIN_FMTS) {
+                fclose(fi);
+                return -1;
+        }
+
+        char **prefixes = logger_bin_get_strs(fi, hdr.num_prefixes);
+        char **fmts     = prefixes ? logger_bin_get_strs(fi, hdr.num_fmts)
+                                   : NULL;
+        FILE *fo        = fmts ? fopen(out, "w") : NULL;
+        int64_t n       = -1;
+
+        if (fo) {
+                n = logger_bin_records(fi, fo, &hdr, prefixes, fmts,
+                                       time_stamps);
+                if (fclose(fo)) {
+                        n = -1;
+                }
+        }
+
+        logger_bin_free_strs(fmts, hdr.num_fmts);
+        logger_bin_free_strs(prefixes, hdr.num_prefixes);
+        fclose(fi);
+
+        return n;
+}
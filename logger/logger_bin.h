@@ -0,0 +1,52 @@
+#ifndef HELPERS_LOGGER_BIN_H
+#define HELPERS_LOGGER_BIN_H
+
+/* Binary log files.
+ *
+ * In binary mode (logger_init_binary) a message is stored as a
+ * logger_bin_rec_t with the id of its format string, followed by its packed
+ * arguments (see logger_args.h). logger_save_binary writes a file of
+ *   logger_bin_hdr_t
+ *   num_prefixes log prefixes     uint32_t length and the characters
+ *   num_fmts format strings       the same, in id order
+ *   size bytes of records
+ * which logger_bin_decode turns into the text a text mode logger would
+ * store, without its LOG_MSG_LENGTH limit. Nothing is aligned. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOGGER_BIN_MAGIC   0x314E494252474F4CULL /* "LOGRBIN1" */
+#define LOGGER_BIN_VERSION 1
+#define LOGGER_BIN_FMTS    1024 /* different format strings per logger */
+
+#pragma pack(push, 1)
+typedef struct logger_bin_hdr {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t num_prefixes;
+        uint32_t num_fmts;
+        uint32_t reserved;
+        uint64_t size;
+} logger_bin_hdr_t;
+
+/* followed by args_len bytes of packed arguments */
+typedef struct logger_bin_rec {
+        uint64_t time_stamp;
+        uint16_t fmt;
+        uint8_t level;
+        uint8_t log;
+        uint32_t args_len;
+} logger_bin_rec_t;
+#pragma pack(pop)
+
+
+/*! @brief converts a binary log file into text
+ *  @param in           file written by logger_save_binary
+ *  @param out          text file, one line per message
+ *  @param time_stamps  starts every line with the time stamp
+ *  @return             number of messages or -1 on error
+ */
+int64_t logger_bin_decode(const char *in, const char *out, bool time_stamps);
+
+#endif
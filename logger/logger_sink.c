@@ -0,0 +1,163 @@
+#include "logger_sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGGER_SINK_FILE_BUF (1 << 16)
+
+
+static void sink_file_write(logger_sink_t *sink, uint64_t time_stamp,
+                            const char *msg, size_t len)
+{
+        (void)time_stamp;
+        fwrite(msg, 1, len, (FILE *)sink->ctx);
+}
+
+
+static void sink_file_flush(logger_sink_t *sink)
+{
+        fflush((FILE *)sink->ctx);
+}
+
+
+static void sink_file_close(logger_sink_t *sink)
+{
+        fclose((FILE *)sink->ctx);
+        free(sink);
+}
+
+
+logger_sink_t *logger_sink_file(const char *path, size_t buf_size)
+{
+        logger_sink_t *sink = (logger_sink_t *)malloc(sizeof(logger_sink_t));
+        if (!sink) {
+                return NULL;
+        }
+
+        FILE *f = fopen(path, "a");
+        if (!f) {
+                free(sink);
+                return NULL;
+        }
+        setvbuf(f, NULL, _IOFBF, buf_size ? buf_size : LOGGER_SINK_FILE_BUF);
+
+        sink->write = sink_file_write;
+        sink->flush = sink_file_flush;
+        sink->close = sink_file_close;
+        sink->ctx   = f;
+
+        return sink;
+}
+
+
+static void sink_stderr_close(logger_sink_t *sink)
+{
+        free(sink);
+}
+
+
+logger_sink_t *logger_sink_stderr(void)
+{
+        logger_sink_t *sink = (logger_sink_t *)malloc(sizeof(logger_sink_t));
+        if (!sink) {
+                return NULL;
+        }
+
+        sink->write = sink_file_write;
+        sink->flush = sink_file_flush;
+        sink->close = sink_stderr_close;
+        sink->ctx   = stderr;
+
+        return sink;
+}
+
+
+/* the text is a byte ring, total counts all bytes ever written */
+typedef struct {
+        xmutex_t lock;
+        size_t size;
+        uint64_t total;
+        char text[];
+} sink_mem_t;
+
+
+static void sink_mem_write(logger_sink_t *sink, uint64_t time_stamp,
+                           const char *msg, size_t len)
+{
+        sink_mem_t *m = (sink_mem_t *)sink->ctx;
+
+        (void)time_stamp;
+        if (len > m->size) {
+                msg += len - m->size;
+                len = m->size;
+        }
+
+        xmutex_lock(&m->lock);
+        size_t pos   = m->total % m->size;
+        size_t first = len < m->size - pos ? len : m->size - pos;
+        memcpy(m->text + pos, msg, first);
+        memcpy(m->text, msg + first, len - first);
+        m->total += len;
+        xmutex_unlock(&m->lock);
+}
+
+
+static void sink_mem_close(logger_sink_t *sink)
+{
+        free(sink->ctx);
+        free(sink);
+}
+
+
+logger_sink_t *logger_sink_mem(size_t size)
+{
+        if (!size) {
+                return NULL;
+        }
+
+        logger_sink_t *sink = (logger_sink_t *)malloc(sizeof(logger_sink_t));
+        sink_mem_t *m       = (sink_mem_t *)malloc(sizeof(sink_mem_t) + size);
+        if (!sink || !m) {
+                free(sink);
+                free(m);
+                return NULL;
+        }
+
+        xmutex_init(&m->lock);
+        m->size  = size;
+        m->total = 0;
+
+        sink->write = sink_mem_write;
+        sink->flush = NULL;
+        sink->close = sink_mem_close;
+        sink->ctx   = m;
+
+        return sink;
+}
+
+
+size_t logger_sink_mem_read(logger_sink_t *sink, char *dst, size_t n)
+{
+        sink_mem_t *m = (sink_mem_t *)sink->ctx;
+
+        if (!n) {
+                return 0;
+        }
+
+        xmutex_lock(&m->lock);
+        size_t len = m->total < m->size ? (size_t)m->total : m->size;
+        if (len > n - 1) {
+                len = n - 1;
+        }
+        /* the newest len bytes end at total */
+        size_t start = (size_t)((m->total - len) % m->size);
+        size_t first = len < m->size - start ? len : m->size - start;
+        memcpy(dst, m->text + start, first);
+        memcpy(dst + first, m->text, len - first);
+        xmutex_unlock(&m->lock);
+
+        dst[len] = '\0';
+
+        return len;
+}
@@ -0,0 +1,47 @@
+#ifndef HELPERS_LOGGER_SINK_H
+#define HELPERS_LOGGER_SINK_H
+
+#include <stddef.h>
+
+#include "logger.h"
+
+/* Sinks for logger_add_sink. All of them are called by one flusher at a
+ * time and are freed by their close function. */
+
+struct net_api;
+
+
+/*! @brief appends log lines to a file through a stdio buffer
+ *  @param path      file, created if missing
+ *  @param buf_size  stdio buffer size, 0 for the default of 64 KiB
+ *  @return          sink or NULL
+ */
+logger_sink_t *logger_sink_file(const char *path, size_t buf_size);
+
+/*! @brief writes log lines to stderr */
+logger_sink_t *logger_sink_stderr(void);
+
+/*! @brief keeps the last size bytes of log text in memory, e.g. for crash
+ *         dumps or a diagnostic interface
+ *  @param size  bytes to keep
+ *  @return      sink or NULL
+ */
+logger_sink_t *logger_sink_mem(size_t size);
+
+/*! @brief copies the text kept by a memory sink, oldest first
+ *  @param sink  sink from logger_sink_mem
+ *  @param dst   destination, '\0' terminated
+ *  @param n     size of dst, the newest text is kept if it is too small
+ *  @return      number of characters copied
+ */
+size_t logger_sink_mem_read(logger_sink_t *sink, char *dst, size_t n);
+
+/*! @brief sends every log line as one syslog style datagram ("<pri>line")
+ *         with net_send_single, implemented in logger_sink_net.c
+ *  @param n  connected UDP client from net_client_init, not closed by the
+ *            sink
+ *  @return   sink or NULL
+ */
+logger_sink_t *logger_sink_udp(struct net_api *n);
+
+#endif
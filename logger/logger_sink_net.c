@@ -0,0 +1,66 @@
+#if !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE)
+#        define _DEFAULT_SOURCE /* struct timeval in net_api.h */
+#endif
+
+#include "logger_sink.h"
+#include "../net-core/net_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* facility "user" */
+#define SINK_SYSLOG_FACILITY 1
+
+
+/* severity from the level prefix written by the logger */
+static int sink_udp_severity(const char *msg)
+{
+        switch (msg[0]) {
+        case 'E': return 3;
+        case 'W': return 4;
+        default: return 6;
+        }
+}
+
+
+static void sink_udp_write(logger_sink_t *sink, uint64_t time_stamp,
+                           const char *msg, size_t len)
+{
+        char buf[LOG_MSG_LENGTH + 8];
+
+        (void)time_stamp;
+        /* one line per datagram, without the new-line */
+        if (len && msg[len - 1] == '\n') {
+                len--;
+        }
+        int n = snprintf(buf, sizeof(buf), "<%d>%.*s",
+                         SINK_SYSLOG_FACILITY * 8 + sink_udp_severity(msg),
+                         (int)len, msg);
+        if (n > 0) {
+                net_send_single((net_api_t *)sink->ctx, buf,
+                                (size_t)n < sizeof(buf) ? (size_t)n
+                                                        : sizeof(buf) - 1);
+        }
+}
+
+
+static void sink_udp_close(logger_sink_t *sink)
+{
+        free(sink);
+}
+
+
+logger_sink_t *logger_sink_udp(struct net_api *n)
+{
+        logger_sink_t *sink = (logger_sink_t *)malloc(sizeof(logger_sink_t));
+        if (!sink) {
+                return NULL;
+        }
+
+        sink->write = sink_udp_write;
+        sink->flush = NULL;
+        sink->close = sink_udp_close;
+        sink->ctx   = n;
+
+        return sink;
+}
@@ -0,0 +1,918 @@
+#define _POSIX_C_SOURCE 199309L
+#include "../logger.h"
+#include "../logger_args.h"
+#include "../logger_bin.h"
+#include "../logger_sink.h"
+#include "../../threads/x-atomic.h"
+#include "../../threads/x-threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <time.h>
+#ifdef _WIN32
+#        include <Windows.h>
+#endif
+
+uint64_t get_time_stamp(void)
+{
+#ifdef _WIN32
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER count;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&count);
+        return count.QuadPart * 1000 / frequency.QuadPart;
+#else
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)(t.tv_sec) * (uint64_t)1000000000 +
+               (uint64_t)(t.tv_nsec);
+#endif
+}
+
+static const char *test_prefixes[] = {"TEST", "OTHER"};
+
+
+static logger_t *test_setup(logger_t *logger)
+{
+        if (logger) {
+                logger_set_prefixes(logger, test_prefixes);
+                logger_set_level(logger, LOG_LEVEL_INFO);
+                logger_enable_all(logger);
+        }
+        return logger;
+}
+
+
+/* packs and formats fmt into out[n], returns the length */
+static size_t args_roundtrip(char *out, size_t n, const char *fmt, va_list ap)
+{
+        char args[4096];
+
+        size_t len = logger_args_pack(args, sizeof(args), fmt, ap);
+        return logger_args_format(out, n, fmt, args, len);
+}
+
+
+/* the round trip has to give the text and length of vsnprintf, for a
+ * large and a small output buffer */
+static bool args_same(const char *fmt, ...)
+{
+        char expect[512];
+        char out[512];
+        va_list ap, aq;
+
+        va_start(ap, fmt);
+        bool ok = true;
+        for (size_t n = sizeof(out); ok && n; n = n == sizeof(out) ? 5 : 0) {
+                va_copy(aq, ap);
+                int r = vsnprintf(expect, n, fmt, aq);
+                va_end(aq);
+                va_copy(aq, ap);
+                size_t len = args_roundtrip(out, n, fmt, aq);
+                va_end(aq);
+
+                ok = r >= 0 && len == (size_t)r && !strcmp(out, expect);
+                if (!ok) {
+                        printf("args '%s': '%s' instead of '%s'!\n", fmt, out,
+                               expect);
+                }
+        }
+        va_end(ap);
+
+        return ok;
+}
+
+
+static bool args_match(const char *expect, const char *fmt, ...)
+{
+        char out[2048];
+        va_list ap;
+
+        va_start(ap, fmt);
+        size_t len = args_roundtrip(out, sizeof(out), fmt, ap);
+        va_end(ap);
+
+        if (len != strlen(expect) || strcmp(out, expect)) {
+                printf("args '%s': '%s' instead of '%s'!\n", fmt, out, expect);
+                return false;
+        }
+        return true;
+}
+
+
+static int test_args(void)
+{
+        if (!args_same("%-+8d|% 05d|%#x|%#o|%X|%-6u|", -42, 42, 255u, 8u,
+                       0xBEEFu, 7u) ||
+            !args_same("%*d|%-*.*f|%.*s|%*s", 6, 17, 10, 3, 3.14159, 2,
+                       "abcdef", -4, "x") ||
+            !args_same("%hhd %hhu %hd %hu", 300, 300u, 70000, 70000u) ||
+            !args_same("%zu %td %lld %llu %ld %jd", (size_t)123456789012ULL,
+                       (ptrdiff_t)-5, -9000000000LL, 18000000000ULL, -7L,
+                       (intmax_t)-1) ||
+            !args_same("%Lf %.3Le %f", 1.5L, 2.25L, -0.125) ||
+            !args_same("%e %g %G %a", 1e-300, 0.1, 1e20, 1.0) ||
+            !args_same("100%% %c%c %%d", 'o', 'k') ||
+            !args_same("%p", (void *)0x1234) ||
+            !args_same("%s|%5s|%-5s|%.1s", "", "ab", "cd", "ef")) {
+                return 101;
+        }
+
+        /* unknown conversions are copied and take no argument */
+        if (!args_match("a %y b 5", "a %y b %d", 5) ||
+            !args_match("%k7", "%k%d", 7)) {
+                return 102;
+        }
+
+        /* %n is skipped */
+        int pos = 0;
+        if (!args_match("abc", "ab%nc", &pos)) {
+                return 103;
+        }
+
+        /* long strings are cut at LOGGER_ARGS_STR_MAX */
+        char str[LOGGER_ARGS_STR_MAX + 500];
+        char expect[LOGGER_ARGS_STR_MAX + 3];
+        memset(str, 'x', sizeof(str) - 1);
+        str[sizeof(str) - 1] = '\0';
+        expect[0]            = '[';
+        memset(expect + 1, 'x', LOGGER_ARGS_STR_MAX);
+        strcpy(expect + 1 + LOGGER_ARGS_STR_MAX, "]");
+        if (!args_match(expect, "[%s]", str)) {
+                return 104;
+        }
+
+        return EXIT_SUCCESS;
+}
+
+
+#define ASYNC_THREADS 4
+#define ASYNC_MSGS    1000
+
+static logger_t *async_logger;
+
+
+X_THREAD_FUNC(async_thread)
+{
+        int id = (int)(intptr_t)p;
+
+        for (int i = 0; i < ASYNC_MSGS; i++) {
+                logger_info(async_logger, 0, "thread %d msg %d", id, i);
+        }
+        return NULL;
+}
+
+
+static int test_async(void)
+{
+        x_thread_t t[ASYNC_THREADS];
+
+        async_logger = test_setup(logger_init_async(
+            ASYNC_THREADS * ASYNC_MSGS, 1 << 20, get_time_stamp));
+        if (!async_logger) {
+                printf("logger async init failed!\n");
+                return 201;
+        }
+
+        for (int i = 0; i < ASYNC_THREADS; i++) {
+                t[i] = x_thread_create(async_thread, (void *)(intptr_t)i);
+        }
+        for (int i = 0; i < ASYNC_THREADS; i++) {
+                x_thread_wait_infinite(t[i]);
+        }
+
+        /* everything logged so far is stored after the flush, in order per
+         * thread */
+        logger_flush(async_logger);
+
+        int res    = EXIT_SUCCESS;
+        size_t num = async_logger->log_mem - async_logger->log_base;
+        int next[ASYNC_THREADS] = {0};
+        if (num != ASYNC_THREADS * ASYNC_MSGS ||
+            logger_dropped(async_logger)) {
+                printf("logger async stored %zu, dropped %llu!\n", num,
+                       (unsigned long long)logger_dropped(async_logger));
+                res = 202;
+                goto exit;
+        }
+        for (size_t i = 0; i < num; i++) {
+                log_entry_t *e = &async_logger->log_base[i];
+                int id, msg;
+                if (sscanf(e->msg, "INFO: TEST: thread %d msg %d", &id,
+                           &msg) != 2 ||
+                    id < 0 || id >= ASYNC_THREADS || msg != next[id]++) {
+                        printf("logger async entry %zu wrong: %s", i, e->msg);
+                        res = 203;
+                        goto exit;
+                }
+        }
+
+exit:
+        logger_free(async_logger);
+        return res;
+}
+
+
+static int test_async_dropped(void)
+{
+        logger_t *logger =
+            test_setup(logger_init_async(128, 1024, get_time_stamp));
+        if (!logger) {
+                printf("logger async init failed!\n");
+                return 301;
+        }
+
+        /* the first message creates the ring. While the lock is held, the
+         * logger thread cannot store, so the small ring fills up. */
+        logger_info(logger, 0, "first");
+        xmutex_lock(&logger->lock);
+        for (int i = 0; i < 100; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+        xmutex_unlock(&logger->lock);
+        logger_flush(logger);
+
+        int res          = EXIT_SUCCESS;
+        size_t stored    = logger->log_mem - logger->log_base;
+        uint64_t dropped = logger_dropped(logger);
+        if (dropped < 50 || stored + dropped != 101) {
+                printf("logger async stored %zu, dropped %llu of 101!\n",
+                       stored, (unsigned long long)dropped);
+                res = 302;
+        }
+
+        logger_free(logger);
+        return res;
+}
+
+
+/* sink that keeps the lines it gets */
+#define CAPTURE_LINES 64
+
+static struct {
+        char lines[CAPTURE_LINES][LOG_MSG_LENGTH];
+        uint64_t num;
+        int closed;
+} capture;
+
+
+static void capture_write(logger_sink_t *sink, uint64_t time_stamp,
+                          const char *msg, size_t len)
+{
+        (void)sink, (void)time_stamp, (void)len;
+        uint64_t n = capture.num;
+        if (n < CAPTURE_LINES) {
+                strcpy(capture.lines[n], msg);
+        }
+        x_atomic_store64(&capture.num, n + 1);
+}
+
+
+static void capture_close(logger_sink_t *sink)
+{
+        (void)sink;
+        capture.closed = 1;
+}
+
+
+static logger_sink_t capture_sink = {capture_write, NULL, capture_close, NULL};
+
+
+static void capture_reset(void)
+{
+        memset(&capture, 0, sizeof(capture));
+}
+
+
+/* the captured lines have to be "msg first" to "msg first + num - 1" */
+static bool capture_check(int first, int num)
+{
+        char expect[LOG_MSG_LENGTH];
+
+        if (x_atomic_load64(&capture.num) != (uint64_t)num) {
+                printf("logger sink got %llu lines instead of %d!\n",
+                       (unsigned long long)capture.num, num);
+                return false;
+        }
+        for (int i = 0; i < num; i++) {
+                snprintf(expect, sizeof(expect), "INFO: TEST: msg %d\n",
+                         first + i);
+                if (strcmp(capture.lines[i], expect)) {
+                        printf("logger sink line %d: %s", i, capture.lines[i]);
+                        return false;
+                }
+        }
+        return true;
+}
+
+
+static int test_wrap(void)
+{
+        logger_t *logger = test_setup(logger_init(8, get_time_stamp));
+        if (!logger) {
+                printf("logger init failed!\n");
+                return 401;
+        }
+
+        capture_reset();
+        logger_set_wrap(logger, true);
+        logger_add_sink(logger, &capture_sink);
+
+        /* 13 messages into 8 entries, the sink gets the last 8 */
+        for (int i = 0; i < 13; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+        logger_flush_sinks(logger);
+
+        int res = EXIT_SUCCESS;
+        if (logger_lost(logger) != 5 || !capture_check(5, 8)) {
+                printf("logger wrap lost %llu!\n",
+                       (unsigned long long)logger_lost(logger));
+                res = 402;
+                goto exit;
+        }
+
+        /* nothing is lost while the sink keeps up */
+        for (int i = 13; i < 16; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+        logger_flush_sinks(logger);
+        if (logger_lost(logger) != 5 || !capture_check(5, 11)) {
+                res = 403;
+        }
+
+exit:
+        logger_free(logger);
+        if (!capture.closed) {
+                printf("logger sink not closed!\n");
+                res = 404;
+        }
+        return res;
+}
+
+
+static int test_wrap_late(void)
+{
+        logger_t *logger = test_setup(logger_init(4, get_time_stamp));
+        if (!logger) {
+                printf("logger init failed!\n");
+                return 405;
+        }
+
+        capture_reset();
+        logger_add_sink(logger, &capture_sink);
+
+        /* a full logger drops messages until wrap is set */
+        for (int i = 0; i < 6; i++) {
+                logger_info(logger, 0, i < 4 ? "msg %d" : "full %d", i);
+        }
+        logger_flush_sinks(logger);
+        logger_set_wrap(logger, true);
+        for (int i = 4; i < 6; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+        logger_flush_sinks(logger);
+
+        int res = EXIT_SUCCESS;
+        if (logger_lost(logger) != 0 || !capture_check(0, 6)) {
+                printf("logger late wrap failed!\n");
+                res = 406;
+        }
+
+        logger_free(logger);
+        return res;
+}
+
+
+static int test_sink_mem(void)
+{
+        logger_t *logger   = test_setup(logger_init(64, get_time_stamp));
+        logger_sink_t *mem = logger_sink_mem(100);
+        if (!logger || !mem) {
+                printf("logger sink mem init failed!\n");
+                return 501;
+        }
+        logger_add_sink(logger, mem);
+
+        /* 40 lines of 18 or 19 characters wrap around the 100 bytes */
+        char all[40 * LOG_MSG_LENGTH] = "";
+        size_t len                    = 0;
+        for (int i = 0; i < 40; i++) {
+                logger_info(logger, 0, "msg %d", i);
+                len += snprintf(all + len, sizeof(all) - len,
+                                "INFO: TEST: msg %d\n", i);
+        }
+        logger_flush_sinks(logger);
+
+        int res = EXIT_SUCCESS;
+        char out[256];
+        if (logger_sink_mem_read(mem, out, sizeof(out)) != 100 ||
+            strcmp(out, all + len - 100)) {
+                printf("logger sink mem kept '%s'!\n", out);
+                res = 502;
+                goto exit;
+        }
+
+        /* a small destination gets the newest text */
+        if (logger_sink_mem_read(mem, out, 20) != 19 ||
+            strcmp(out, all + len - 19) ||
+            logger_sink_mem_read(mem, out, 1) != 0 || out[0]) {
+                printf("logger sink mem read into 20 bytes '%s'!\n", out);
+                res = 503;
+        }
+
+exit:
+        logger_free(logger);
+        return res;
+}
+
+
+static int test_flusher(void)
+{
+        logger_t *logger = test_setup(logger_init(64, get_time_stamp));
+        if (!logger) {
+                printf("logger init failed!\n");
+                return 601;
+        }
+
+        capture_reset();
+        logger_add_sink(logger, &capture_sink);
+
+        int res = EXIT_SUCCESS;
+        if (logger_start_flusher(logger, 2) ||
+            !logger_start_flusher(logger, 2) ||
+            !logger_add_sink(logger, &capture_sink)) {
+                printf("logger flusher start wrong!\n");
+                res = 602;
+                goto exit;
+        }
+
+        for (int i = 0; i < 10; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+        for (int i = 0; i < 1000 && x_atomic_load64(&capture.num) < 10; i++) {
+                x_thread_sleep_ms(2);
+        }
+        if (!capture_check(0, 10)) {
+                res = 603;
+                goto exit;
+        }
+
+        /* flushing next to the flusher keeps the order, logger_free stops
+         * the flusher and passes the rest */
+        for (int i = 10; i < 60; i++) {
+                logger_info(logger, 0, "msg %d", i);
+                if (i % 3 == 0) {
+                        logger_flush_sinks(logger);
+                }
+        }
+
+exit:
+        logger_free(logger);
+        if (res == EXIT_SUCCESS && (!capture_check(0, 60) || !capture.closed)) {
+                res = 604;
+        }
+        return res;
+}
+
+
+static uint64_t fake_now;
+
+
+static uint64_t fake_time(void)
+{
+        return ++fake_now;
+}
+
+
+#define BIN_FILE  "logger_test.bin"
+#define BIN_TEXT  "logger_test.txt"
+#define BIN_CUT   "logger_test_cut.bin"
+#define BIN_LINES 8
+
+static logger_t *bin_logger;
+static logger_t *txt_logger;
+
+
+static void log_both(uint8_t level, uint8_t log, char *fmt, ...)
+{
+        void (*fn[3])(logger_t *, uint8_t, char *, va_list) = {
+            logger_err_v, logger_warn_v, logger_info_v};
+        va_list ap;
+
+        va_start(ap, fmt);
+        fn[level - 1](bin_logger, log, fmt, ap);
+        va_end(ap);
+        va_start(ap, fmt);
+        fn[level - 1](txt_logger, log, fmt, ap);
+        va_end(ap);
+}
+
+
+/* compares the first num lines of path with the text logger, optionally
+ * behind time stamps 1, 2, ... */
+static bool bin_check_text(const char *path, size_t num, bool time_stamps)
+{
+        char line[1024];
+        char expect[1024];
+        size_t n = 0;
+
+        FILE *f = fopen(path, "r");
+        if (!f) {
+                return false;
+        }
+        for (; fgets(line, sizeof(line), f); n++) {
+                if (n >= num) {
+                        break;
+                }
+                expect[0] = '\0';
+                if (time_stamps) {
+                        snprintf(expect, sizeof(expect), "%zu ", n + 1);
+                }
+                strcat(expect, txt_logger->log_base[n].msg);
+                if (strcmp(line, expect)) {
+                        printf("logger decoded '%s' instead of '%s'!\n", line,
+                               expect);
+                        break;
+                }
+        }
+        fclose(f);
+
+        return n == num;
+}
+
+
+/* copies the first size bytes of BIN_FILE into BIN_CUT */
+static bool bin_cut(long size)
+{
+        char buf[4096];
+
+        FILE *fi = fopen(BIN_FILE, "rb");
+        FILE *fo = fopen(BIN_CUT, "wb");
+        bool ok  = fi && fo && size <= (long)sizeof(buf) &&
+                  fread(buf, 1, size, fi) == (size_t)size &&
+                  fwrite(buf, 1, size, fo) == (size_t)size;
+        if (fi) {
+                fclose(fi);
+        }
+        if (fo) {
+                ok = !fclose(fo) && ok;
+        }
+        return ok;
+}
+
+
+static int test_binary(void)
+{
+        fake_now   = 0;
+        bin_logger = test_setup(logger_init_binary(1 << 16, fake_time));
+        txt_logger = test_setup(logger_init(BIN_LINES, get_time_stamp));
+        if (!bin_logger || !txt_logger) {
+                printf("logger binary init failed!\n");
+                return 701;
+        }
+
+        log_both(LOG_LEVEL_INFO, 0, "plain");
+        log_both(LOG_LEVEL_WARNING, 1, "%d %u %x %lld", -1, 2u, 255u, -3LL);
+        log_both(LOG_LEVEL_ERROR, 0, "%s|%-6s|%.2s", "str", "ab", "cdef");
+        log_both(LOG_LEVEL_INFO, 1, "%.3f %e %c", 3.14159, 1e10, 'z');
+        log_both(LOG_LEVEL_INFO, 0, "%*d|%-*.*f|100%%", 5, 42, 8, 2, 0.5);
+        log_both(LOG_LEVEL_WARNING, 0, "%zu %hhd %p", (size_t)7, 300,
+                 (void *)0x10);
+        log_both(LOG_LEVEL_INFO, 1, "plain");
+        log_both(LOG_LEVEL_ERROR, 1, "%s", "");
+
+        int res = EXIT_SUCCESS;
+        if (logger_save_binary(bin_logger, BIN_FILE) != BIN_LINES ||
+            logger_bin_decode(BIN_FILE, BIN_TEXT, false) != BIN_LINES ||
+            !bin_check_text(BIN_TEXT, BIN_LINES, false) ||
+            logger_bin_decode(BIN_FILE, BIN_TEXT, true) != BIN_LINES ||
+            !bin_check_text(BIN_TEXT, BIN_LINES, true)) {
+                printf("logger binary round trip failed!\n");
+                res = 702;
+                goto exit;
+        }
+
+        /* a record cut off at the end is left out, a cut header or string
+         * table makes the file unreadable */
+        FILE *f = fopen(BIN_FILE, "rb");
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+        if (!bin_cut(size - 1) ||
+            logger_bin_decode(BIN_CUT, BIN_TEXT, false) != BIN_LINES - 1 ||
+            !bin_check_text(BIN_TEXT, BIN_LINES - 1, false) ||
+            !bin_cut(sizeof(logger_bin_hdr_t) - 1) ||
+            logger_bin_decode(BIN_CUT, BIN_TEXT, false) != -1 ||
+            !bin_cut(sizeof(logger_bin_hdr_t) + 6) ||
+            logger_bin_decode(BIN_CUT, BIN_TEXT, false) != -1) {
+                printf("logger binary cut file decoded wrong!\n");
+                res = 703;
+        }
+
+exit:
+        logger_free(bin_logger);
+        logger_free(txt_logger);
+        remove(BIN_CUT);
+        return res;
+}
+
+
+/* every format string is one table entry, identified by its address */
+static char bin_fmts[LOGGER_BIN_FMTS + 1][16];
+
+
+static int test_binary_fmts(void)
+{
+        logger_t *logger = test_setup(logger_init_binary(1 << 20, fake_time));
+        if (!logger) {
+                printf("logger binary init failed!\n");
+                return 801;
+        }
+
+        for (int i = 0; i <= LOGGER_BIN_FMTS; i++) {
+                snprintf(bin_fmts[i], sizeof(bin_fmts[i]), "fmt %d: %%d", i);
+                logger_info(logger, 0, bin_fmts[i], i);
+        }
+        /* known formats still work with a full table */
+        logger_info(logger, 0, bin_fmts[0], -1);
+
+        int res = EXIT_SUCCESS;
+        char line[64];
+        if (logger_dropped(logger) != 1 ||
+            logger_save_binary(logger, BIN_FILE) != LOGGER_BIN_FMTS + 1 ||
+            logger_bin_decode(BIN_FILE, BIN_TEXT, false) !=
+                LOGGER_BIN_FMTS + 1) {
+                printf("logger binary full table failed!\n");
+                res = 802;
+                goto exit;
+        }
+
+        FILE *f = fopen(BIN_TEXT, "r");
+        for (int i = 0; f && i <= LOGGER_BIN_FMTS; i++) {
+                char expect[64];
+                int id = i < LOGGER_BIN_FMTS ? i : 0;
+                snprintf(expect, sizeof(expect), "INFO: TEST: fmt %d: %d\n",
+                         id, i < LOGGER_BIN_FMTS ? i : -1);
+                if (!fgets(line, sizeof(line), f) || strcmp(line, expect)) {
+                        printf("logger binary line %d wrong!\n", i);
+                        res = 803;
+                        break;
+                }
+        }
+        if (f) {
+                fclose(f);
+        }
+
+exit:
+        logger_free(logger);
+        remove(BIN_FILE);
+        remove(BIN_TEXT);
+        return res;
+}
+
+
+#define TBUF_THREADS 4
+#define TBUF_MSGS    500
+
+static logger_t *tbuf_logger;
+static uint64_t tbuf_clock;
+
+
+/* one clock for all threads, every time stamp is unique */
+static uint64_t tbuf_time(void)
+{
+        return x_atomic_fetch_add64(&tbuf_clock, 1);
+}
+
+
+X_THREAD_FUNC(tbuf_thread)
+{
+        int id = (int)(intptr_t)p;
+
+        for (int i = 0; i < TBUF_MSGS; i++) {
+                logger_info(tbuf_logger, 0, "thread %d msg %d", id, i);
+        }
+        return NULL;
+}
+
+
+static int test_threaded(void)
+{
+        static bool seen[TBUF_THREADS][TBUF_MSGS];
+        x_thread_t t[TBUF_THREADS];
+        log_entry_t e;
+
+        tbuf_logger = test_setup(logger_init_threaded(TBUF_MSGS, tbuf_time));
+        if (!tbuf_logger) {
+                printf("logger threaded init failed!\n");
+                return 901;
+        }
+
+        for (int i = 0; i < TBUF_THREADS; i++) {
+                t[i] = x_thread_create(tbuf_thread, (void *)(intptr_t)i);
+        }
+        for (int i = 0; i < TBUF_THREADS; i++) {
+                x_thread_wait_infinite(t[i]);
+        }
+
+        /* every message once, merged in time stamp order */
+        int res       = EXIT_SUCCESS;
+        uint64_t last = 0;
+        int n         = 0;
+        for (; logger_next(tbuf_logger, &e); n++) {
+                int id, msg;
+                if (sscanf(e.msg, "INFO: TEST: thread %d msg %d", &id, &msg) !=
+                        2 ||
+                    id < 0 || id >= TBUF_THREADS || msg < 0 ||
+                    msg >= TBUF_MSGS || seen[id][msg] ||
+                    (n && e.time_stamp < last)) {
+                        printf("logger next entry %d wrong: %s", n, e.msg);
+                        res = 902;
+                        goto exit;
+                }
+                seen[id][msg] = true;
+                last          = e.time_stamp;
+        }
+        if (n != TBUF_THREADS * TBUF_MSGS || logger_dropped(tbuf_logger)) {
+                printf("logger next gave %d, dropped %llu!\n", n,
+                       (unsigned long long)logger_dropped(tbuf_logger));
+                res = 903;
+        }
+
+exit:
+        logger_free(tbuf_logger);
+        return res;
+}
+
+
+static int test_threaded_dropped(void)
+{
+        logger_t *logger = test_setup(logger_init_threaded(16, tbuf_time));
+        if (!logger) {
+                printf("logger threaded init failed!\n");
+                return 1001;
+        }
+
+        /* the ring holds 16, the rest is dropped until it is read */
+        for (int i = 0; i < 20; i++) {
+                logger_info(logger, 0, "msg %d", i);
+        }
+
+        int res = EXIT_SUCCESS;
+        int n   = 0;
+        char expect[LOG_MSG_LENGTH];
+        log_entry_t e;
+        for (; logger_next(logger, &e); n++) {
+                snprintf(expect, sizeof(expect), "INFO: TEST: msg %d\n", n);
+                if (strcmp(e.msg, expect)) {
+                        break;
+                }
+        }
+        if (n != 16 || logger_dropped(logger) != 4) {
+                printf("logger threaded kept %d, dropped %llu!\n", n,
+                       (unsigned long long)logger_dropped(logger));
+                res = 1002;
+                goto exit;
+        }
+
+        logger_info(logger, 0, "msg %d", 0);
+        if (!logger_next(logger, &e) || strcmp(e.msg, "INFO: TEST: msg 0\n")) {
+                printf("logger threaded ring not reusable!\n");
+                res = 1003;
+        }
+
+exit:
+        logger_free(logger);
+        return res;
+}
+
+
+static uint64_t rl_now;
+
+
+static uint64_t rl_time(void)
+{
+        return rl_now;
+}
+
+
+/* one call site for all messages */
+static void rl_log(logger_t *logger, int i)
+{
+        LOGGER_INFO_LIMITED(logger, 0, "msg %d", i);
+}
+
+
+static int test_rate_limit(void)
+{
+        static const char *expect[] = {
+            "msg 0", "msg 1", "msg 2",            /* burst at 0 */
+            "message repeated 2 times", "msg 5",  /* at 10 */
+            "message repeated 1 times",           /* at 100 */
+            "msg 7", "msg 8", "msg 9",
+            "other 0", "other 1", "other 2",      /* own site */
+            "msg 11", "msg 12",                   /* limit off */
+        };
+        char line[LOG_MSG_LENGTH];
+
+        rl_now           = 0;
+        logger_t *logger = test_setup(logger_init(64, rl_time));
+        if (!logger) {
+                printf("logger init failed!\n");
+                return 1101;
+        }
+
+        /* 3 at once, then one every 10 */
+        logger_set_rate_limit(logger, 3, 10);
+        for (int i = 0; i < 5; i++) {
+                rl_log(logger, i);
+        }
+        rl_now = 10;
+        rl_log(logger, 5);
+        rl_log(logger, 6);
+        /* the bucket is full again after 3 intervals */
+        rl_now = 100;
+        for (int i = 7; i < 11; i++) {
+                rl_log(logger, i);
+        }
+        /* the suppressed "other 3" is never reported, no later message of
+         * that site passes */
+        for (int i = 0; i < 4; i++) {
+                LOGGER_INFO_LIMITED(logger, 0, "other %d", i);
+        }
+
+        logger_set_rate_limit(logger, 0, 0);
+        rl_log(logger, 11);
+        rl_log(logger, 12);
+
+        int res    = EXIT_SUCCESS;
+        size_t num = logger->log_mem - logger->log_base;
+        if (num != sizeof(expect) / sizeof(expect[0])) {
+                printf("logger rate limit stored %zu messages!\n", num);
+                res = 1102;
+                goto exit;
+        }
+        for (size_t i = 0; i < num; i++) {
+                snprintf(line, sizeof(line), "INFO: TEST: %s\n", expect[i]);
+                if (strcmp(logger->log_base[i].msg, line)) {
+                        printf("logger rate limit entry %zu: %s", i,
+                               logger->log_base[i].msg);
+                        res = 1103;
+                        break;
+                }
+        }
+
+exit:
+        logger_free(logger);
+        return res;
+}
+
+
+int main(void)
+{
+        printf("------ Testing logger ------\n");
+
+        int res = test_args();
+        if (res == EXIT_SUCCESS) {
+                res = test_async();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_async_dropped();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_wrap();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_wrap_late();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_sink_mem();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_flusher();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_binary();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_binary_fmts();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_threaded();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_threaded_dropped();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_rate_limit();
+        }
+
+        printf("------ Testing logger done ------\n");
+
+        return res;
+}
@@ -0,0 +1,102 @@
+#if !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE)
+#        define _DEFAULT_SOURCE /* struct timeval in net_api.h */
+#endif
+#include "../logger.h"
+#include "../logger_sink.h"
+#include "../../net-core/net_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_UDP_PORT 45679
+
+
+static uint64_t get_time_stamp(void)
+{
+        return 0;
+}
+
+static const char *test_prefixes[] = {"TEST"};
+
+
+static void net_log_quiet(char *msg, va_list args)
+{
+        (void)msg, (void)args;
+}
+
+
+/* the udp sink sends every line to a server on the loopback interface */
+static int test_sink_udp(void)
+{
+        net_api_t server, client;
+        net_addr_t from;
+        char buf[LOG_MSG_LENGTH + 8];
+
+        net_set_log_info_func(net_log_quiet);
+        if (net_core_init() != NET_CORE_OK ||
+            net_server_init(&server, SOCK_TYPE_UDP, INADDR_LOOPBACK,
+                            TEST_UDP_PORT) != NET_CORE_OK ||
+            net_client_init(&client, SOCK_TYPE_UDP, INADDR_LOOPBACK,
+                            TEST_UDP_PORT) != NET_CORE_OK) {
+                printf("net init failed!\n");
+                return 101;
+        }
+        server.state.recv_timeout.tv_sec = 1;
+        client.state.send_timeout.tv_sec = 1;
+
+        logger_t *logger   = logger_init(8, get_time_stamp);
+        logger_sink_t *udp = logger_sink_udp(&client);
+        if (!logger || !udp) {
+                printf("logger sink udp init failed!\n");
+                return 102;
+        }
+        logger_set_prefixes(logger, test_prefixes);
+        logger_set_level(logger, LOG_LEVEL_INFO);
+        logger_enable_all(logger);
+        logger_add_sink(logger, udp);
+
+        logger_info(logger, 0, "msg %d", 1);
+        logger_err(logger, 0, "msg %d", 2);
+        logger_flush_sinks(logger);
+
+        /* facility user, severity info and error, no new-line */
+        static const char *expect[] = {"<14>INFO: TEST: msg 1",
+                                       "<11>ERROR: TEST: msg 2"};
+
+        int res = EXIT_SUCCESS;
+        for (int i = 0; i < 2; i++) {
+                ssize_t n =
+                    net_recv_single(&server, &from, buf, sizeof(buf) - 1);
+                if (n <= 0) {
+                        printf("logger sink udp got nothing!\n");
+                        res = 103;
+                        break;
+                }
+                buf[n] = '\0';
+                if (strcmp(buf, expect[i])) {
+                        printf("logger sink udp got %s!\n", buf);
+                        res = 104;
+                        break;
+                }
+        }
+
+        logger_free(logger);
+        net_close_socket(client.client_addr.sock);
+        net_close_socket(server.server_addr.sock);
+        net_core_shutdown();
+
+        return res;
+}
+
+
+int main(void)
+{
+        printf("------ Testing logger net sink ------\n");
+
+        int res = test_sink_udp();
+
+        printf("------ Testing logger net sink done ------\n");
+
+        return res;
+}
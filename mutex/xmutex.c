@@ -1,30 +1,286 @@
+#if defined(__gnu_linux__) && !defined(_GNU_SOURCE) && \
+    !defined(_DEFAULT_SOURCE)
+#        define _DEFAULT_SOURCE /* syscall */
+#endif
+
 #include "xmutex.h"
 #include "../threads/x-atomic.h"
 #include "../threads/x-threads.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+#if !defined(X_MUTEX_SPINLOCK) && !defined(X_MUTEX_TICKET) && \
+    !defined(X_MUTEX_MCS)
+#        define X_MUTEX_ADAPTIVE
+#endif
 
+#if !defined(X_MUTEX_NO_THREAD_YIELD) && defined(X_MUTEX_ADAPTIVE)
+#        if defined(__gnu_linux__)
+#                include <linux/futex.h>
+#                include <sys/syscall.h>
+#                include <unistd.h>
+#                define X_MUTEX_FUTEX
+#        elif defined(_WIN32)
+#                pragma comment(lib, "Synchronization.lib")
+#                define X_MUTEX_WAIT_ADDRESS
+#        endif
+#endif
+
+
+#ifdef X_MUTEX_SPINLOCK
 void xmutex_init(xmutex_t *mtx)
 {
-        x_atomic_clear64(&mtx->lock);
+        x_atomic_store32(&mtx->lock, 0);
+        mtx->reserved = 0;
 }
 
 
 void xmutex_lock(xmutex_t *mtx)
 {
-        while (x_atomic_test_set64(&mtx->lock)) {
-#if !defined(X_MUTEX_NO_THREAD_YIELD) && defined(X_THREAD_SUPPORT)
+        uint32_t c = 0;
+
+        while (!x_atomic_cas32(&mtx->lock, &c, 1)) {
+                c = 0;
+#        if !defined(X_MUTEX_NO_THREAD_YIELD) && defined(X_THREAD_SUPPORT)
                 x_thread_yield();
+#        endif
+        }
+}
+
+
+void xmutex_unlock(xmutex_t *mtx)
+{
+        x_atomic_store32(&mtx->lock, 0);
+}
+#endif
+
+
+#if defined(X_MUTEX_TICKET) || defined(X_MUTEX_MCS)
+/* waiting in a FIFO lock after the spin rounds */
+static inline void xmutex_wait_turn(int *round)
+{
+#        if !defined(X_MUTEX_NO_THREAD_YIELD) && defined(X_THREAD_SUPPORT)
+        if (*round >= X_MUTEX_SPIN_ROUNDS) {
+                x_thread_yield();
+                return;
+        }
+        (*round)++;
+#        else
+        (void)round;
+#        endif
+        x_cpu_relax();
+}
+#endif
+
+
+#ifdef X_MUTEX_TICKET
+void xmutex_init(xmutex_t *mtx)
+{
+        x_atomic_store32(&mtx->next, 0);
+        x_atomic_store32(&mtx->owner, 0);
+}
+
+
+void xmutex_lock(xmutex_t *mtx)
+{
+        uint32_t ticket = x_atomic_fetch_add32(&mtx->next, 1);
+        uint32_t owner;
+        int round = 0;
+
+        while ((owner = x_atomic_load32(&mtx->owner)) != ticket) {
+                /* the further back in the queue, the longer the pause, so
+                 * the line is not read by every waiter on each hand over */
+                uint32_t ahead = ticket - owner;
+                for (uint32_t i = 1; i < ahead && i < X_MUTEX_BACKOFF_MAX;
+                     i++) {
+                        x_cpu_relax();
+                }
+                xmutex_wait_turn(&round);
+        }
+}
+
+
+void xmutex_unlock(xmutex_t *mtx)
+{
+        /* only the holder writes owner */
+        x_atomic_store32(&mtx->owner, mtx->owner + 1);
+}
+#endif
+
+
+#ifdef X_MUTEX_MCS
+#        ifdef _MSC_VER
+#                define X_MUTEX_TLS        __declspec(thread)
+#                define X_MUTEX_LINE_ALIGN __declspec(align(64))
+#        else
+#                define X_MUTEX_TLS        __thread
+#                define X_MUTEX_LINE_ALIGN __attribute__((aligned(64)))
+#        endif
+
+/* queue node, on a line of its own since its waiter spins on it */
+typedef struct X_MUTEX_LINE_ALIGN xmutex_node {
+        uint64_t next;
+        uint32_t locked;
+        uint32_t used;
+        uint8_t pad[64 - 2 * sizeof(uint64_t)];
+} xmutex_node_t;
+
+static X_MUTEX_TLS xmutex_node_t tls_nodes[X_MUTEX_MCS_NODES];
+
+
+/* one node per lock held or waited for by this thread */
+static xmutex_node_t *xmutex_node_get(void)
+{
+        for (int i = 0; i < X_MUTEX_MCS_NODES; i++) {
+                if (!tls_nodes[i].used) {
+                        tls_nodes[i].used = 1;
+                        return &tls_nodes[i];
+                }
+        }
+
+        /* more than X_MUTEX_MCS_NODES locks held at once. No node will ever
+         * be freed while this thread waits, fail instead of hanging. */
+        abort();
+}
+
+
+void xmutex_init(xmutex_t *mtx)
+{
+        x_atomic_store64(&mtx->tail, 0);
+        mtx->owner = 0;
+}
+
+
+void xmutex_lock(xmutex_t *mtx)
+{
+        xmutex_node_t *node = xmutex_node_get();
+        int round           = 0;
+
+        node->next = 0;
+        x_atomic_store32(&node->locked, 1);
+
+        xmutex_node_t *pred = (xmutex_node_t *)(uintptr_t)x_atomic_xchg64(
+            &mtx->tail, (uint64_t)(uintptr_t)node);
+        if (pred) {
+                x_atomic_store64(&pred->next, (uint64_t)(uintptr_t)node);
+                while (x_atomic_load32(&node->locked)) {
+                        xmutex_wait_turn(&round);
+                }
+        }
+
+        mtx->owner = (uint64_t)(uintptr_t)node;
+}
+
+
+void xmutex_unlock(xmutex_t *mtx)
+{
+        xmutex_node_t *node = (xmutex_node_t *)(uintptr_t)mtx->owner;
+        uint64_t next       = x_atomic_load64(&node->next);
+
+        if (!next) {
+                uint64_t self = (uint64_t)(uintptr_t)node;
+                if (x_atomic_cas64(&mtx->tail, &self, 0)) {
+                        node->used = 0;
+                        return;
+                }
+                /* a successor swapped the tail but has not linked yet */
+                while (!(next = x_atomic_load64(&node->next))) {
+                        x_cpu_relax();
+                }
+        }
+
+        x_atomic_store32(&((xmutex_node_t *)(uintptr_t)next)->locked, 0);
+        node->used = 0;
+}
 #endif
+
+
+#ifdef X_MUTEX_ADAPTIVE
+/* blocks while the lock word is 2. Without a way to sleep, waits on plain
+ * loads until the lock looks free, so the waiters do not keep taking the
+ * line exclusive with their xchg (test-and-test-and-set). */
+static void xmutex_park(xmutex_t *mtx)
+{
+#        if defined(X_MUTEX_FUTEX)
+        syscall(SYS_futex, &mtx->lock, FUTEX_WAIT, 2, NULL, NULL, 0);
+#        elif defined(X_MUTEX_WAIT_ADDRESS)
+        uint32_t parked = 2;
+        WaitOnAddress(&mtx->lock, &parked, sizeof(parked), INFINITE);
+#        else
+        while (x_atomic_load32(&mtx->lock)) {
+#                if !defined(X_MUTEX_NO_THREAD_YIELD) && \
+                    defined(X_THREAD_SUPPORT)
+                x_thread_yield();
+#                else
+                x_cpu_relax();
+#                endif
+        }
+#        endif
+}
+
+
+static void xmutex_wake(xmutex_t *mtx)
+{
+#        if defined(X_MUTEX_FUTEX)
+        syscall(SYS_futex, &mtx->lock, FUTEX_WAKE, 1, NULL, NULL, 0);
+#        elif defined(X_MUTEX_WAIT_ADDRESS)
+        WakeByAddressSingle(&mtx->lock);
+#        else
+        (void)mtx;
+#        endif
+}
+
+
+void xmutex_init(xmutex_t *mtx)
+{
+        x_atomic_store32(&mtx->lock, 0);
+        mtx->reserved = 0;
+}
+
+
+void xmutex_lock(xmutex_t *mtx)
+{
+        uint32_t backoff = 1;
+        uint32_t c       = 0;
+
+        if (x_atomic_cas32(&mtx->lock, &c, 1)) {
+                return;
+        }
+
+        /* spin on a plain load, the cache line stays shared until the lock
+         * looks free */
+        for (int round = 0; round < X_MUTEX_SPIN_ROUNDS; round++) {
+                for (uint32_t i = 0; i < backoff; i++) {
+                        x_cpu_relax();
+                }
+                if (backoff < X_MUTEX_BACKOFF_MAX) {
+                        backoff <<= 1;
+                }
+
+                c = 0;
+                if (!x_atomic_load32(&mtx->lock) &&
+                    x_atomic_cas32(&mtx->lock, &c, 1)) {
+                        return;
+                }
+        }
+
+        /* mark the lock as contended, an owner that leaves wakes one of the
+         * parked waiters. Taking it as 2 may cost an extra wake up but never
+         * loses one. */
+        while (x_atomic_xchg32(&mtx->lock, 2)) {
+                xmutex_park(mtx);
         }
 }
 
 
 void xmutex_unlock(xmutex_t *mtx)
 {
-        x_atomic_clear64(&mtx->lock);
+        if (x_atomic_xchg32(&mtx->lock, 0) == 2) {
+                xmutex_wake(mtx);
+        }
 }
+#endif
 
 
 void xsig_init(xsig_t *signal)
@@ -5,9 +5,54 @@
 #include <stdint.h>
 
 
+/* Adaptive lock: test-and-test-and-set with exponential backoff for
+ * X_MUTEX_SPIN_ROUNDS rounds, then the waiter parks until the owner leaves
+ * (futex on Linux, WaitOnAddress on Windows, thread yield elsewhere). The
+ * futex is not process private, so the lock works in shared memory.
+ * X_MUTEX_NO_THREAD_YIELD keeps waiters spinning.
+ *
+ * One of these selects another lock behind the same API at compile time:
+ *   X_MUTEX_SPINLOCK  plain test-and-set spinlock
+ *   X_MUTEX_TICKET    ticket lock, FIFO, waiters back off in proportion to
+ *                     their place in the queue
+ *   X_MUTEX_MCS       MCS queue lock, FIFO, every waiter spins on its own
+ *                     node. Nodes are thread local, so it cannot be shared
+ *                     between processes (no HEAPM32_SHM), and a thread can
+ *                     hold at most X_MUTEX_MCS_NODES locks at once, one
+ *                     more aborts.
+ * The FIFO locks yield after X_MUTEX_SPIN_ROUNDS rounds unless
+ * X_MUTEX_NO_THREAD_YIELD is set, a preempted waiter stalls all behind it. */
+#if (defined(X_MUTEX_SPINLOCK) + defined(X_MUTEX_TICKET) + \
+     defined(X_MUTEX_MCS)) > 1
+#        error "select at most one of X_MUTEX_SPINLOCK, _TICKET and _MCS"
+#endif
+
+#ifndef X_MUTEX_SPIN_ROUNDS
+#        define X_MUTEX_SPIN_ROUNDS 10
+#endif
+#ifndef X_MUTEX_BACKOFF_MAX
+#        define X_MUTEX_BACKOFF_MAX 64 /* pause instructions per round */
+#endif
+#ifndef X_MUTEX_MCS_NODES
+#        define X_MUTEX_MCS_NODES 16
+#endif
+
+#if defined(X_MUTEX_TICKET)
 typedef struct {
-        uint64_t lock;
+        uint32_t next;  /* ticket of the next thread to arrive */
+        uint32_t owner; /* ticket allowed to enter */
 } xmutex_t;
+#elif defined(X_MUTEX_MCS)
+typedef struct {
+        uint64_t tail;  /* last waiting node, 0 if free */
+        uint64_t owner; /* node of the holder */
+} xmutex_t;
+#else
+typedef struct {
+        uint32_t lock; /* 0 free, 1 locked, 2 locked with parked waiters */
+        uint32_t reserved;
+} xmutex_t;
+#endif
 
 
 void xmutex_init(xmutex_t *mtx);
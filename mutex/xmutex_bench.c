@@ -0,0 +1,134 @@
+/* Lock contention benchmark for xmutex and pthread_mutex.
+ *
+ * The same source is built once per lock: the adaptive xmutex, the
+ * X_MUTEX_SPINLOCK test-and-set lock with and without X_MUTEX_NO_THREAD_YIELD,
+ * the X_MUTEX_TICKET and X_MUTEX_MCS queue locks, or pthread_mutex with
+ * BENCH_PTHREAD. Every thread takes the lock LOOPS times, updates a shared
+ * counter inside and spins a little outside, so the lock is contended but not
+ * held all the time. Runs with more threads than CPUs show what a preempted
+ * owner costs the waiters. */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../threads/x-threads.h"
+
+#if defined(BENCH_PTHREAD)
+#        include <pthread.h>
+#        define BACKEND "pthread_mutex"
+typedef pthread_mutex_t bench_lock_t;
+#        define bench_init(L)   pthread_mutex_init(L, NULL)
+#        define bench_lock(L)   pthread_mutex_lock(L)
+#        define bench_unlock(L) pthread_mutex_unlock(L)
+#else
+#        include "xmutex.h"
+#        if defined(X_MUTEX_SPINLOCK) && defined(X_MUTEX_NO_THREAD_YIELD)
+#                define BACKEND "xmutex spinlock, no yield"
+#        elif defined(X_MUTEX_SPINLOCK)
+#                define BACKEND "xmutex spinlock"
+#        elif defined(X_MUTEX_TICKET)
+#                define BACKEND "xmutex ticket"
+#        elif defined(X_MUTEX_MCS)
+#                define BACKEND "xmutex mcs"
+#        else
+#                define BACKEND "xmutex adaptive"
+#        endif
+typedef xmutex_t bench_lock_t;
+#        define bench_init(L)   xmutex_init(L)
+#        define bench_lock(L)   xmutex_lock(L)
+#        define bench_unlock(L) xmutex_unlock(L)
+#endif
+
+#define LOOPS       200000
+#define MAX_THREADS 64
+#ifndef WORK_IN
+#        define WORK_IN 20 /* iterations inside the lock */
+#endif
+#ifndef WORK_OUT
+#        define WORK_OUT 20 /* iterations between two locks */
+#endif
+
+
+static bench_lock_t lock;
+static volatile uint64_t counter;
+
+
+static uint64_t get_time_stamp(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)(t.tv_sec) * 1000000000ull + (uint64_t)(t.tv_nsec);
+}
+
+
+static void work(int n)
+{
+        for (volatile int i = 0; i < n; i++) {
+        }
+}
+
+
+X_THREAD_FUNC(bench_thread)
+{
+        (void)p;
+
+        for (int i = 0; i < LOOPS; i++) {
+                bench_lock(&lock);
+                counter++;
+                work(WORK_IN);
+                bench_unlock(&lock);
+                work(WORK_OUT);
+        }
+
+        return NULL;
+}
+
+
+/* returns the wall time per lock/unlock pair in ns */
+static double bench_run(int nthreads)
+{
+        x_thread_t t[MAX_THREADS];
+
+        counter = 0;
+        bench_init(&lock);
+
+        uint64_t t0 = get_time_stamp();
+        for (int i = 0; i < nthreads; i++) {
+                t[i] = x_thread_create(bench_thread, NULL);
+        }
+        for (int i = 0; i < nthreads; i++) {
+                x_thread_wait_infinite(t[i]);
+        }
+        uint64_t ns = get_time_stamp() - t0;
+
+        if (counter != (uint64_t)nthreads * LOOPS) {
+                printf("lost updates: %llu of %llu\n",
+                       (unsigned long long)counter,
+                       (unsigned long long)nthreads * LOOPS);
+                exit(1);
+        }
+
+        return (double)ns / ((double)nthreads * LOOPS);
+}
+
+
+int main(void)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        printf("%s, %ld cpus\n", BACKEND, cpus);
+        printf("%-8s %12s\n", "threads", "per lock");
+
+        for (int n = 1; n <= MAX_THREADS; n *= 2) {
+                printf("%-8d %9.1f ns\n", n, bench_run(n));
+                if (n >= 4 * cpus && n >= 8) {
+                        break;
+                }
+        }
+
+        return 0;
+}
@@ -1,17 +1,185 @@
+#ifdef __gnu_linux__
+#        define _GNU_SOURCE
+#        include <unistd.h>
+#        include <sys/syscall.h>
+#endif
+
 #include "perf.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#        include <malloc.h>
+#        include <windows.h>
+#endif
+#ifdef _MSC_VER
+#        include <intrin.h>
+#endif
+
+#include "../threads/x-atomic.h"
+
+#ifdef _MSC_VER
+#        define PERF_TLS __declspec(thread)
+#else
+#        define PERF_TLS __thread
+#endif
+
+
+/* last perf_t used by this thread and its buffer */
+static PERF_TLS uint64_t tls_gen;
+static PERF_TLS perf_tbuf_t *tls_tbuf;
+/* thread id, 0 until first used */
+static PERF_TLS uint32_t tls_tid;
+/* number of open spans of this thread */
+static PERF_TLS uint16_t tls_depth;
+/* xorshift state for sampling, 0 until first used */
+static PERF_TLS uint64_t tls_rand;
+
+static uint64_t perf_gen;
+
+/* PERF_GET_CYCLES ticks per ns, set once by perf_calibrate */
+static double perf_cpns;
+
+#define PERF_CALIBRATE_NS 10000000ull
+
+
+static uint64_t perf_thread_id(void)
+{
+#if defined(_WIN32)
+        return GetCurrentThreadId();
+#elif defined(__gnu_linux__)
+        return (uint64_t)syscall(SYS_gettid);
+#else
+        return 0;
+#endif
+}
+
+
+/* cache line aligned, so that w and r do not share a line */
+static perf_tbuf_t *perf_tbuf_alloc(uint64_t num)
+{
+        size_t size = sizeof(perf_tbuf_t) + num * sizeof(perf_info_t);
+        void *tb;
+
+        size = (size + 63) & ~(size_t)63;
+#ifdef _WIN32
+        tb = _aligned_malloc(size, 64);
+#else
+        tb = aligned_alloc(64, size);
+#endif
+        if (tb) {
+                memset(tb, 0, sizeof(perf_tbuf_t));
+        }
+
+        return (perf_tbuf_t *)tb;
+}
+
+
+static void perf_tbuf_free(perf_tbuf_t *tb)
+{
+#ifdef _WIN32
+        _aligned_free(tb);
+#else
+        free(tb);
+#endif
+}
+
+
+#if !defined(SOC_AM65XX) && !defined(__aarch64__)
+/* reference clock for the calibration */
+static uint64_t perf_clock_ns(void)
+{
+#        if defined(_WIN32)
+        LARGE_INTEGER c, f;
+        QueryPerformanceCounter(&c);
+        QueryPerformanceFrequency(&f);
+        return (uint64_t)((double)c.QuadPart * 1e9 / (double)f.QuadPart);
+#        elif defined(CLOCK_MONOTONIC_RAW)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#        elif defined(CLOCK_MONOTONIC)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#        else
+        return 0;
+#        endif
+}
+#endif
+
+
+void perf_calibrate(void)
+{
+        double cpns;
+
+#if defined(SOC_AM65XX) && !defined(_WIN32)
+        cpns = CORE_FREQ;
+#elif defined(__GNUC__) && defined(__aarch64__)
+        /* the generic timer reports its own frequency */
+        uint64_t freq;
+        __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+        cpns = (double)freq / 1e9;
+#else
+        /* busy wait instead of sleeping, so that the cpu does not enter a
+         * low power state between the two readings */
+        uint64_t t0 = perf_clock_ns();
+        uint64_t c0 = PERF_GET_CYCLES;
+        uint64_t t1;
+
+        if (!t0) {
+                return;
+        }
+        do {
+                t1 = perf_clock_ns();
+        } while (t1 - t0 < PERF_CALIBRATE_NS);
+        uint64_t c1 = PERF_GET_CYCLES;
+
+        cpns = (double)(c1 - c0) / (double)(t1 - t0);
+#endif
+        perf_cpns = cpns;
+}
+
+
+double perf_cycles_per_ns(void)
+{
+        return perf_cpns;
+}
+
+
+uint64_t perf_cycles_to_ns(uint64_t cycles)
+{
+        if (perf_cpns <= 0.0) {
+                return 0;
+        }
+
+        return (uint64_t)((double)cycles / perf_cpns);
+}
 
 
 static perf_t *perf_init_common(perf_t *perf, size_t num, bool enable_all_ids)
 {
+        static uint64_t calibrated;
+
+        if (!x_atomic_load64(&calibrated)) {
+                perf_calibrate();
+                x_atomic_store64(&calibrated, 1);
+        }
 
         perf->entries_current = perf->entries_base;
         perf->entries_max     = perf->entries_base + num;
-        for (int i = 0; i < 16; i++) {
+        for (int i = 0; i < PERF_MAX_ID / 64; i++) {
                 perf->enabled_ids[i] = enable_all_ids ? UINT64_MAX : 0;
         }
+        perf->enabled_groups = UINT64_MAX;
+        memset(perf->group, 0, sizeof(perf->group));
+        memset(perf->sample, 0, sizeof(perf->sample));
+        perf->tbufs    = NULL;
+        perf->tbuf_num = 0;
+        perf->hists    = NULL;
+        perf->hist_num = 0;
+        perf->tbuf_gen = x_atomic_fetch_add64(&perf_gen, 1) + 1;
         xmutex_init(&perf->lock);
 
         return perf;
@@ -44,24 +212,227 @@ perf_t *perf_init_static(perf_t *perf, perf_info_t *entries, size_t num,
 }
 
 
+perf_t *perf_init_threaded(size_t num, bool enable_all_ids)
+{
+        perf_t *perf = (perf_t *)malloc(sizeof(perf_t));
+        if (!perf) {
+                return NULL;
+        }
+
+        perf->entries_base = NULL;
+        perf_init_common(perf, 0, enable_all_ids);
+
+        perf->tbuf_num = 1;
+        while (perf->tbuf_num < num) {
+                perf->tbuf_num <<= 1;
+        }
+
+        return perf;
+}
+
+
+perf_t *perf_init_hist(uint16_t max_id, bool enable_all_ids)
+{
+        /* without histograms samples would go to the missing entries */
+        if (!max_id) {
+                return NULL;
+        }
+
+        perf_t *perf = (perf_t *)malloc(sizeof(perf_t));
+        if (!perf) {
+                return NULL;
+        }
+
+        if (max_id > PERF_MAX_ID) {
+                max_id = PERF_MAX_ID;
+        }
+        perf->entries_base = NULL;
+        perf_init_common(perf, 0, enable_all_ids);
+
+        perf->hists = (perf_hist_t *)calloc(max_id, sizeof(perf_hist_t));
+        if (!perf->hists) {
+                free(perf);
+                return NULL;
+        }
+        for (uint16_t i = 0; i < max_id; i++) {
+                perf->hists[i].min = UINT64_MAX;
+        }
+        perf->hist_num = max_id;
+
+        return perf;
+}
+
+
 void perf_free(perf_t *perf)
 {
+        perf_tbuf_t *tb = perf->tbufs;
+
+        while (tb) {
+                perf_tbuf_t *next = tb->next;
+                perf_tbuf_free(tb);
+                tb = next;
+        }
+
+        free(perf->hists);
         free(perf->entries_base);
         free(perf);
 }
 
 
-void perf_create_entry(perf_t *perf, uint16_t id, uint64_t start, uint64_t end)
+/* finds or creates the buffer of the calling thread. The thread remembers
+ * the last perf_t it used, so only its first entry takes the lock. Buffers
+ * of exited threads stay in the list until perf_free, their entries may not
+ * have been drained yet */
+static perf_tbuf_t *perf_tbuf_get(perf_t *perf)
 {
-        if (!perf_is_enabled(perf, id)) {
+        if (tls_gen == perf->tbuf_gen) {
+                return tls_tbuf;
+        }
+
+        uint64_t tid = perf_thread_id();
+        perf_tbuf_t *tb;
+
+        xmutex_lock(&perf->lock);
+        for (tb = perf->tbufs; tb; tb = tb->next) {
+                if (tb->tid == tid) {
+                        break;
+                }
+        }
+
+        if (!tb) {
+                tb = perf_tbuf_alloc(perf->tbuf_num);
+                if (tb) {
+                        tb->entries = (perf_info_t *)(tb + 1);
+                        tb->num     = perf->tbuf_num;
+                        tb->tid     = tid;
+                        tb->next    = perf->tbufs;
+                        perf->tbufs = tb;
+                }
+        }
+        xmutex_unlock(&perf->lock);
+
+        tls_gen  = perf->tbuf_gen;
+        tls_tbuf = tb;
+
+        return tb;
+}
+
+
+static inline unsigned perf_msb(uint64_t v)
+{
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanReverse64(&i, v);
+        return (unsigned)i;
+#else
+        return 63 - (unsigned)__builtin_clzll(v);
+#endif
+}
+
+
+static inline unsigned perf_hist_index(uint64_t v)
+{
+        if (v < PERF_HIST_SUB) {
+                return (unsigned)v;
+        }
+
+        unsigned shift = perf_msb(v) - PERF_HIST_SUB_BITS;
+
+        return (shift + 1) * PERF_HIST_SUB +
+               (unsigned)(v >> shift) - PERF_HIST_SUB;
+}
+
+
+/* highest value counted by bucket i */
+static uint64_t perf_hist_value(unsigned i)
+{
+        if (i < PERF_HIST_SUB) {
+                return i;
+        }
+
+        unsigned shift = i / PERF_HIST_SUB - 1;
+        uint64_t top   = PERF_HIST_SUB + i % PERF_HIST_SUB;
+
+        return ((top + 1) << shift) - 1;
+}
+
+
+static void perf_hist_record(perf_hist_t *h, uint64_t v)
+{
+        x_atomic_fetch_add64(&h->buckets[perf_hist_index(v)], 1);
+        x_atomic_fetch_add64(&h->sum, v);
+
+        uint64_t cur = x_atomic_load64(&h->min);
+        while (v < cur && !x_atomic_cas64(&h->min, &cur, v)) {
+        }
+        cur = x_atomic_load64(&h->max);
+        while (v > cur && !x_atomic_cas64(&h->max, &cur, v)) {
+        }
+
+        /* count last, readers see count <= number of bucket entries */
+        x_atomic_fetch_add64(&h->count, 1);
+}
+
+
+static inline uint32_t perf_tls_tid(void)
+{
+        if (!tls_tid) {
+                tls_tid = (uint32_t)perf_thread_id();
+        }
+
+        return tls_tid;
+}
+
+
+static inline void perf_fill(perf_info_t *e, uint16_t id, uint64_t time_stamp,
+                             uint64_t cycles, uint32_t tid, uint16_t depth,
+                             uint16_t flags)
+{
+        e->time_stamp = time_stamp;
+        e->id         = id;
+        e->cycles     = cycles;
+        e->tid        = tid;
+        e->depth      = depth;
+        e->flags      = flags;
+}
+
+
+static void perf_append(perf_t *perf, uint16_t id, uint64_t time_stamp,
+                        uint64_t cycles, uint16_t depth, uint16_t flags)
+{
+        if (perf->hist_num) {
+                if (id && id <= perf->hist_num) {
+                        perf_hist_record(&perf->hists[id - 1], cycles);
+                }
+                return;
+        }
+
+        if (perf->tbuf_num) {
+                perf_tbuf_t *tb = perf_tbuf_get(perf);
+                if (!tb) {
+                        return;
+                }
+
+                uint64_t w = tb->w;
+                if (w - x_atomic_load64(&tb->r) >= tb->num) {
+                        tb->dropped++;
+                        return;
+                }
+
+                perf_fill(&tb->entries[w & (tb->num - 1)], id, time_stamp,
+                          cycles, (uint32_t)tb->tid, depth, flags);
+
+                /* a plain store on x86, no locked instruction */
+                x_atomic_store64(&tb->w, w + 1);
                 return;
         }
 
+        uint32_t tid = perf_tls_tid();
+
         xmutex_lock(&perf->lock);
 
-        perf->entries_current->time_stamp = end;
-        perf->entries_current->id         = id;
-        perf->entries_current->cycles     = end - start;
+        perf_fill(perf->entries_current, id, time_stamp, cycles, tid, depth,
+                  flags);
 
         perf->entries_current++;
 
@@ -72,45 +443,330 @@ void perf_create_entry(perf_t *perf, uint16_t id, uint64_t start, uint64_t end)
 }
 
 
+/* decides whether to record a sample of an enabled id */
+static inline bool perf_sampled(perf_t *perf, uint16_t id)
+{
+        uint32_t n = x_atomic_load32(&perf->sample[id - 1]);
+
+        if (n <= 1) {
+                return true;
+        }
+
+        uint64_t x = tls_rand;
+        if (!x) {
+                x = (perf_thread_id() + 1) * 0x9e3779b97f4a7c15ull;
+        }
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        tls_rand = x;
+
+        return x % n == 0;
+}
+
+
+void perf_create_entry(perf_t *perf, uint16_t id, uint64_t start, uint64_t end)
+{
+        if (!perf_is_enabled(perf, id) || !perf_sampled(perf, id)) {
+                return;
+        }
+
+        perf_append(perf, id, end, end - start, 0, 0);
+}
+
+
 void perf_create_entry_user(perf_t *perf, uint16_t id, uint64_t start,
                             uint64_t userdata)
 {
-        if (!perf_is_enabled(perf, id)) {
+        if (!perf_is_enabled(perf, id) || !perf_sampled(perf, id)) {
                 return;
         }
 
+        perf_append(perf, id, start, userdata, 0, PERF_INFO_USER);
+}
+
+
+perf_span_t perf_span_begin(perf_t *perf, uint16_t id)
+{
+        perf_span_t span;
+
+        span.perf  = NULL;
+        span.id    = id;
+        span.depth = tls_depth;
+        span.start = 0;
+
+        if (!perf_is_enabled(perf, id) || tls_depth >= PERF_SPAN_MAX_DEPTH ||
+            !perf_sampled(perf, id)) {
+                return span;
+        }
+
+        tls_depth++;
+        span.perf  = perf;
+        span.start = PERF_GET_CYCLES;
+
+        return span;
+}
+
+
+void perf_span_end(perf_span_t *span)
+{
+        uint64_t end = PERF_GET_CYCLES;
+
+        if (!span->perf) {
+                return;
+        }
+
+        tls_depth = span->depth;
+        perf_append(span->perf, span->id, end, end - span->start, span->depth,
+                    PERF_INFO_SPAN);
+        span->perf = NULL;
+}
+
+
+/* child time per open depth of one thread */
+typedef struct {
+        uint32_t tid;
+        uint64_t child[PERF_SPAN_MAX_DEPTH];
+} perf_span_thread_t;
+
+
+bool perf_span_aggregate(const perf_info_t *entries, size_t n,
+                         perf_span_stats_t *stats, uint16_t max_id)
+{
+        perf_span_thread_t *threads = NULL;
+        size_t num_threads          = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                const perf_info_t *e = &entries[i];
+
+                if (!(e->flags & PERF_INFO_SPAN) || !e->id || e->id > max_id ||
+                    e->depth >= PERF_SPAN_MAX_DEPTH) {
+                        continue;
+                }
+
+                perf_span_thread_t *th = NULL;
+                for (size_t t = 0; t < num_threads; t++) {
+                        if (threads[t].tid == e->tid) {
+                                th = &threads[t];
+                                break;
+                        }
+                }
+                if (!th) {
+                        perf_span_thread_t *tmp = (perf_span_thread_t *)realloc(
+                            threads, (num_threads + 1) * sizeof(*threads));
+                        if (!tmp) {
+                                free(threads);
+                                return false;
+                        }
+                        threads = tmp;
+                        th      = &threads[num_threads++];
+                        memset(th, 0, sizeof(*th));
+                        th->tid = e->tid;
+                }
+
+                /* nested spans end first, so all children of this span have
+                 * been added to its depth already */
+                uint64_t child = th->child[e->depth];
+                if (child > e->cycles) {
+                        child = e->cycles;
+                }
+                th->child[e->depth] = 0;
+                if (e->depth) {
+                        th->child[e->depth - 1] += e->cycles;
+                }
+
+                perf_span_stats_t *st = &stats[e->id - 1];
+                st->count++;
+                st->inclusive += e->cycles;
+                st->exclusive += e->cycles - child;
+        }
+
+        free(threads);
+
+        return true;
+}
+
+
+size_t perf_drain(perf_t *perf, perf_info_t *out, size_t max)
+{
+        size_t n = 0;
+
+        if (perf->hist_num) {
+                return 0;
+        }
+
         xmutex_lock(&perf->lock);
 
-        perf->entries_current->time_stamp = start;
-        perf->entries_current->id         = id;
-        perf->entries_current->cycles     = userdata;
+        if (!perf->tbuf_num) {
+                n = perf->entries_current - perf->entries_base;
+                if (n > max) {
+                        n = max;
+                }
+                memcpy(out, perf->entries_base, n * sizeof(perf_info_t));
+                memmove(perf->entries_base, perf->entries_base + n,
+                        (perf->entries_current - perf->entries_base - n) *
+                            sizeof(perf_info_t));
+                perf->entries_current -= n;
+
+                xmutex_unlock(&perf->lock);
+                return n;
+        }
 
-        perf->entries_current++;
+        /* k-way merge: each thread buffer is ordered by time stamp already,
+         * take the oldest head until out is full or all are empty */
+        while (n < max) {
+                perf_tbuf_t *best      = NULL;
+                perf_info_t *best_head = NULL;
+
+                for (perf_tbuf_t *tb = perf->tbufs; tb; tb = tb->next) {
+                        if (tb->r == x_atomic_load64(&tb->w)) {
+                                continue;
+                        }
+
+                        perf_info_t *head = &tb->entries[tb->r & (tb->num - 1)];
+                        if (!best ||
+                            head->time_stamp < best_head->time_stamp) {
+                                best      = tb;
+                                best_head = head;
+                        }
+                }
+
+                if (!best) {
+                        break;
+                }
+
+                out[n++] = *best_head;
+                x_atomic_store64(&best->r, best->r + 1);
+        }
 
-        if (perf->entries_current >= perf->entries_max) {
-                perf->entries_current = perf->entries_max - 1;
+        xmutex_unlock(&perf->lock);
+
+        return n;
+}
+
+
+uint64_t perf_dropped(perf_t *perf)
+{
+        uint64_t dropped = 0;
+
+        xmutex_lock(&perf->lock);
+        for (perf_tbuf_t *tb = perf->tbufs; tb; tb = tb->next) {
+                dropped += x_atomic_load64(&tb->dropped);
         }
         xmutex_unlock(&perf->lock);
+
+        return dropped;
+}
+
+
+static perf_hist_t *perf_hist_get(perf_t *perf, uint16_t id)
+{
+        if (!perf || !id || id > perf->hist_num) {
+                return NULL;
+        }
+
+        return &perf->hists[id - 1];
+}
+
+
+uint64_t perf_hist_percentile(perf_t *perf, uint16_t id, double p)
+{
+        perf_hist_t *h = perf_hist_get(perf, id);
+        if (!h) {
+                return 0;
+        }
+
+        uint64_t count = x_atomic_load64(&h->count);
+        if (!count) {
+                return 0;
+        }
+
+        /* rank of the sample that p percent of all samples do not exceed */
+        double r      = p / 100.0 * (double)count;
+        uint64_t rank = (uint64_t)r;
+        if ((double)rank < r) {
+                rank++;
+        }
+        if (rank < 1) {
+                rank = 1;
+        }
+
+        uint64_t max = x_atomic_load64(&h->max);
+        uint64_t sum = 0;
+
+        for (unsigned i = 0; i < PERF_HIST_BUCKETS; i++) {
+                sum += x_atomic_load64(&h->buckets[i]);
+                if (sum >= rank) {
+                        uint64_t v = perf_hist_value(i);
+                        return v < max ? v : max;
+                }
+        }
+
+        return max;
+}
+
+
+bool perf_hist_stats(perf_t *perf, uint16_t id, perf_stats_t *stats)
+{
+        perf_hist_t *h = perf_hist_get(perf, id);
+        if (!h) {
+                return false;
+        }
+
+        stats->count = x_atomic_load64(&h->count);
+        if (!stats->count) {
+                return false;
+        }
+
+        stats->min  = x_atomic_load64(&h->min);
+        stats->max  = x_atomic_load64(&h->max);
+        stats->mean = (double)x_atomic_load64(&h->sum) / (double)stats->count;
+        stats->p50  = perf_hist_percentile(perf, id, 50.0);
+        stats->p99  = perf_hist_percentile(perf, id, 99.0);
+        stats->p999 = perf_hist_percentile(perf, id, 99.9);
+
+        return true;
+}
+
+
+void perf_hist_reset(perf_t *perf, uint16_t id)
+{
+        perf_hist_t *h = perf_hist_get(perf, id);
+        if (!h) {
+                return;
+        }
+
+        x_atomic_store64(&h->count, 0);
+        for (unsigned i = 0; i < PERF_HIST_BUCKETS; i++) {
+                x_atomic_store64(&h->buckets[i], 0);
+        }
+        x_atomic_store64(&h->sum, 0);
+        x_atomic_store64(&h->min, UINT64_MAX);
+        x_atomic_store64(&h->max, 0);
 }
 
 
 void perf_enable(perf_t *perf, uint16_t id)
 {
-        if (id > PERF_MAX_ID) {
+        unsigned i = (unsigned)id - 1;
+
+        if (i >= PERF_MAX_ID) {
                 return;
         }
 
-        perf->enabled_ids[(id - 1) >> 6] |= (1ULL << ((id - 1) & 63));
+        x_atomic_fetch_or64(&perf->enabled_ids[i >> 6], 1ULL << (i & 63));
 }
 
 
 void perf_disable(perf_t *perf, uint16_t id)
 {
-        if (id > PERF_MAX_ID) {
+        unsigned i = (unsigned)id - 1;
+
+        if (i >= PERF_MAX_ID) {
                 return;
         }
 
-        perf->enabled_ids[(id - 1) >> 6] &= ~(1ULL << ((id - 1) & 63));
+        x_atomic_fetch_and64(&perf->enabled_ids[i >> 6], ~(1ULL << (i & 63)));
 }
 
 
@@ -119,8 +775,50 @@ bool perf_is_enabled(perf_t *perf, uint16_t id)
         if (!perf) {
                 return false;
         }
-        /* No extra check for id < PERF_MAX_ID,
-           if id > 64 below is always false anyway
-        */
-        return perf->enabled_ids[(id - 1) >> 6] & (1ULL << ((id - 1) & 63));
+
+        return perf_id_on(perf, id);
+}
+
+
+void perf_set_group(perf_t *perf, uint16_t id, uint8_t group)
+{
+        unsigned i = (unsigned)id - 1;
+
+        if (i >= PERF_MAX_ID || group >= PERF_MAX_GROUP) {
+                return;
+        }
+
+        x_atomic_store32(&perf->group[i], group);
+}
+
+
+void perf_enable_group(perf_t *perf, uint8_t group)
+{
+        if (group >= PERF_MAX_GROUP) {
+                return;
+        }
+
+        x_atomic_fetch_or64(&perf->enabled_groups, 1ULL << group);
+}
+
+
+void perf_disable_group(perf_t *perf, uint8_t group)
+{
+        if (group >= PERF_MAX_GROUP) {
+                return;
+        }
+
+        x_atomic_fetch_and64(&perf->enabled_groups, ~(1ULL << group));
+}
+
+
+void perf_set_sampling(perf_t *perf, uint16_t id, uint32_t n)
+{
+        unsigned i = (unsigned)id - 1;
+
+        if (i >= PERF_MAX_ID) {
+                return;
+        }
+
+        x_atomic_store32(&perf->sample[i], n);
 }
@@ -6,14 +6,14 @@
  ************************************************************************/
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "../mutex/xmutex.h"
+#include "../threads/x-atomic.h"
 
 #define PERF_MAX_ID 1024
 
-#if defined(_WIN32) || !defined(SOC_AM65XX)
-#        define PERF_GET_CYCLES 0
-#else
+#if defined(SOC_AM65XX) && !defined(_WIN32)
 /* On AM65 plattform use the cpu cycle count stored in the PMCCNTR_EL0
    register.
    Important: this requires a prior initialization of these performance counters
@@ -27,63 +27,232 @@
                 })
 #        define CORE_FREQ       0.8f
 #        define PERF_GET_CYCLES CYCLES
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#        include <intrin.h>
+static __inline uint64_t perf_cycles(void)
+{
+        unsigned int aux;
+        return __rdtscp(&aux);
+}
+#        define PERF_GET_CYCLES perf_cycles()
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* rdtscp waits for all earlier instructions, so the measured code cannot
+ * leak past a PERF_STOP. The TSC is assumed to be invariant, which holds for
+ * all x86-64 CPUs of the last decade */
+static inline uint64_t perf_cycles(void)
+{
+        unsigned int aux;
+        return __builtin_ia32_rdtscp(&aux);
+}
+#        define PERF_GET_CYCLES perf_cycles()
+#elif defined(__GNUC__) && defined(__aarch64__)
+/* generic timer virtual count, the isb keeps it from being read early */
+static inline uint64_t perf_cycles(void)
+{
+        uint64_t rval;
+        __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0"
+                             : "=r"(rval)::"memory");
+        return rval;
+}
+#        define PERF_GET_CYCLES perf_cycles()
+#elif defined(__unix__)
+#        include <time.h>
+static inline uint64_t perf_cycles(void)
+{
+        struct timespec ts;
+#        ifdef CLOCK_MONOTONIC_RAW
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#        else
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+#        endif
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#        define PERF_GET_CYCLES perf_cycles()
+#else
+#        define PERF_GET_CYCLES 0
 #endif
 
 #define PERF_START(PERF, ID) uint64_t cycles_start_##ID = PERF_GET_CYCLES
 
+/* the macros only call into perf.c if id and its group are enabled */
 #define PERF_STOP(PERF, ID)                                        \
-        if (PERF && ((PERF)->enabled_ids[(ID - 1) >> 6] &          \
-                     (1ULL << ((((ID)&63)) - 1)))) {               \
+        if (PERF && perf_id_on((PERF), (ID))) {                    \
                 perf_create_entry((PERF), (ID), cycles_start_##ID, \
                                   PERF_GET_CYCLES);                \
         }
 
 #define PERF_MARK(PERF, ID)                                      \
-        if (PERF && ((PERF)->enabled_ids[(ID - 1) >> 6] &        \
-                     (1ULL << (((ID)&63) - 1)))) {               \
+        if (PERF && perf_id_on((PERF), (ID))) {                  \
                 perf_create_entry((PERF), (ID), PERF_GET_CYCLES, \
                                   PERF_GET_CYCLES);              \
         }
 
 #define PERF_USER(PERF, ID, USERDATA)                                 \
-        if (PERF && ((PERF)->enabled_ids[(ID - 1) >> 6] &             \
-                     (1ULL << (((ID)&63) - 1)))) {                    \
+        if (PERF && perf_id_on((PERF), (ID))) {                       \
                 perf_create_entry_user((PERF), (ID), PERF_GET_CYCLES, \
                                        USERDATA);                     \
         }
 
 
+/* perf_info_t flags */
+#define PERF_INFO_USER 0x1 /* cycles holds user data, time_stamp the start */
+#define PERF_INFO_SPAN 0x2 /* recorded by a span, depth is valid */
+
 #pragma pack(push, 1)
 typedef struct {
         uint64_t id;
         uint64_t time_stamp;
         uint64_t cycles;
+        uint32_t tid;   /* thread that recorded the entry */
+        uint16_t depth; /* span nesting level of the thread, 0 = outermost */
+        uint16_t flags;
 } perf_info_t;
+#pragma pack(pop)
+
+/* per thread buffer, only the owning thread appends, perf_drain consumes.
+ * w and r are free running, num is a power of 2 */
+typedef struct perf_tbuf {
+        struct perf_tbuf *next;
+        perf_info_t *entries;
+        uint64_t num;
+        uint64_t tid;
+        uint64_t w;
+        uint64_t dropped;
+        uint8_t pad[64 - 6 * sizeof(uint64_t)];
+        uint64_t r;
+} perf_tbuf_t;
+
+/* log-linear histogram: values below PERF_HIST_SUB are counted exactly,
+ * above each power of 2 is split into PERF_HIST_SUB buckets, so a bucket
+ * is at most 1/16 of its value wide over the full uint64 range */
+#define PERF_HIST_SUB_BITS 4
+#define PERF_HIST_SUB      (1 << PERF_HIST_SUB_BITS)
+#define PERF_HIST_BUCKETS  ((64 - PERF_HIST_SUB_BITS + 1) * PERF_HIST_SUB)
+
+typedef struct perf_hist {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        uint64_t buckets[PERF_HIST_BUCKETS];
+} perf_hist_t;
 
+/* summary of one histogram, values in PERF_GET_CYCLES units */
+typedef struct perf_stats {
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        double mean;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t p999;
+} perf_stats_t;
+
+#define PERF_MAX_GROUP 64
+
+/* not packed, the bitsets are accessed atomically */
 typedef struct perf {
         xmutex_t lock;
         perf_info_t *entries_base;
         perf_info_t *entries_current;
         perf_info_t *entries_max;
-        uint64_t enabled_ids[16]; /*todo: make this atomic?*/
+        uint64_t enabled_ids[PERF_MAX_ID / 64];
+        uint64_t enabled_groups;      /* bit n enables the ids of group n */
+        uint32_t group[PERF_MAX_ID];  /* group of id - 1, 0 by default */
+        uint32_t sample[PERF_MAX_ID]; /* record 1 in sample[id - 1] */
+        perf_tbuf_t *tbufs;           /* per thread mode if tbuf_num != 0 */
+        uint64_t tbuf_num;
+        uint64_t tbuf_gen;            /* tells apart perf_t at one address */
+        perf_hist_t *hists;           /* histogram mode if hist_num != 0 */
+        uint64_t hist_num;
 } perf_t;
-#pragma pack(pop)
 
 
+/* checks the enabled bit of id and of its group, ids outside 1..PERF_MAX_ID
+ * are never enabled */
+static inline bool perf_id_on(perf_t *perf, uint16_t id)
+{
+        unsigned i = (unsigned)id - 1;
+
+        if (i >= PERF_MAX_ID) {
+                return false;
+        }
+
+        return ((x_atomic_load64(&perf->enabled_ids[i >> 6]) >> (i & 63)) &
+                (x_atomic_load64(&perf->enabled_groups) >>
+                 x_atomic_load32(&perf->group[i])) &
+                1);
+}
+
+
+/* all init functions calibrate the cycle counter against the system clock
+ * once per process, which takes about 10 ms */
 perf_t *perf_init(size_t num, bool enable_all_ids);
 perf_t *perf_init_static(perf_t *perf, perf_info_t *entries, size_t num,
                          bool enable_all_ids);
+/* per thread mode: every thread appends to its own buffer of num entries
+ * without locking, perf_drain merges them by time stamp. Samples are dropped
+ * (and counted) while a thread's buffer is full. Buffers are keyed by the OS
+ * thread id and only released by perf_free, a thread which exits keeps its
+ * buffer, which a later thread with the same id reuses. With short lived
+ * threads memory grows by one buffer per distinct thread id, so use this
+ * mode with thread pools or re-create the perf_t now and then. */
+perf_t *perf_init_threaded(size_t num, bool enable_all_ids);
+/* histogram mode: samples of ids 1..max_id are aggregated into one
+ * perf_hist_t per id instead of being stored, memory use stays constant.
+ * Recording is lock free, higher ids are ignored. max_id 0 returns NULL. */
+perf_t *perf_init_hist(uint16_t max_id, bool enable_all_ids);
 void perf_free(perf_t *perf);
 
-/* enables perf measurement for id. Not threadsafe! */
+/* moves up to max of the oldest entries to out, ordered by time stamp, and
+ * returns their number. Safe against concurrent perf_create_entry calls.
+ * Always 0 in histogram mode. */
+size_t perf_drain(perf_t *perf, perf_info_t *out, size_t max);
+
+/* number of samples dropped by full per thread buffers */
+uint64_t perf_dropped(perf_t *perf);
+
+/* value (cycles or user data) below which p percent of the samples of id
+ * are, e.g. p = 99.9. Exact to 1/16 of the value, 0 if there are none */
+uint64_t perf_hist_percentile(perf_t *perf, uint16_t id, double p);
+
+/* fills stats for id, returns false if perf is not in histogram mode or
+ * id has no samples */
+bool perf_hist_stats(perf_t *perf, uint16_t id, perf_stats_t *stats);
+
+/* clears the histogram of id, samples recorded concurrently may be lost */
+void perf_hist_reset(perf_t *perf, uint16_t id);
+
+/* measures the PERF_GET_CYCLES rate, called by the init functions */
+void perf_calibrate(void);
+/* converts a PERF_GET_CYCLES difference to nanoseconds */
+uint64_t perf_cycles_to_ns(uint64_t cycles);
+/* PERF_GET_CYCLES ticks per nanosecond, 0 if there is no cycle source */
+double perf_cycles_per_ns(void);
+
+/* Runtime control, all functions are threadsafe and may be called while
+ * other threads record. An id records if it is enabled and its group is
+ * enabled; all groups are enabled after init. */
+
+/* enables perf measurement for id */
 void perf_enable(perf_t *perf, uint16_t id);
-/* disables perf measurement for id. Not threadsafe! */
+/* disables perf measurement for id */
 void perf_disable(perf_t *perf, uint16_t id);
-/* checks if perf measurement is enabled for id. Not threadsafe! */
+/* checks if perf measurement is enabled for id and its group */
 bool perf_is_enabled(perf_t *perf, uint16_t id);
 
+/* moves id to group (0..PERF_MAX_GROUP-1) */
+void perf_set_group(perf_t *perf, uint16_t id, uint8_t group);
+/* enables or disables all ids of group at once */
+void perf_enable_group(perf_t *perf, uint8_t group);
+void perf_disable_group(perf_t *perf, uint8_t group);
+
+/* records on average 1 in n samples of id, n <= 1 records all. The choice
+ * is random per thread, so it does not correlate with call patterns. */
+void perf_set_sampling(perf_t *perf, uint16_t id, uint32_t n);
+
 /* creates a perf_info_t entry in perf buffer. Stays at last if buffer is full!
-   Note: Do not concurrently call perf_enable/disable! */
+ */
 void perf_create_entry(perf_t *perf, uint16_t id, uint64_t start, uint64_t end);
 
 /* creates a perf_info_t entry in perf buffer. Instead of end time, and time
@@ -91,4 +260,48 @@ void perf_create_entry(perf_t *perf, uint16_t id, uint64_t start, uint64_t end);
 void perf_create_entry_user(perf_t *perf, uint16_t id, uint64_t start,
                             uint64_t userdata);
 
+
+/* Spans are START/STOP pairs that also record the nesting depth within
+ * their thread, so that inclusive and exclusive times can be computed.
+ * PERF_SPAN closes the span when the enclosing scope is left, on every
+ * return path (GCC cleanup attribute). Elsewhere PERF_SPAN_BEGIN/END have to
+ * be paired manually. Spans always use the built-in PERF_GET_CYCLES. */
+typedef struct perf_span {
+        perf_t *perf; /* NULL if the id was disabled at begin */
+        uint64_t start;
+        uint16_t id;
+        uint16_t depth;
+} perf_span_t;
+
+#define PERF_SPAN_MAX_DEPTH 64
+
+#define PERF_SPAN_BEGIN(PERF, ID) \
+        perf_span_t perf_span_##ID = perf_span_begin((PERF), (ID))
+#define PERF_SPAN_END(ID) perf_span_end(&perf_span_##ID)
+
+#ifdef __GNUC__
+#        define PERF_SPAN(PERF, ID)                                        \
+                perf_span_t perf_span_##ID __attribute__((cleanup(         \
+                    perf_span_end))) = perf_span_begin((PERF), (ID))
+#endif
+
+/* opens a span of id in the calling thread */
+perf_span_t perf_span_begin(perf_t *perf, uint16_t id);
+/* records the span and closes it, spans must be ended in reverse order */
+void perf_span_end(perf_span_t *span);
+
+/* time of all spans of one id */
+typedef struct perf_span_stats {
+        uint64_t count;
+        uint64_t inclusive; /* cycles including nested spans */
+        uint64_t exclusive; /* cycles without nested spans */
+} perf_span_stats_t;
+
+/* accumulates the span entries of entries (as returned by perf_drain) into
+ * stats, indexed by id - 1 and holding max_id elements. Other entries and
+ * higher ids are skipped. A span must be passed in the same call as the
+ * spans nested in it. Returns false if out of memory. */
+bool perf_span_aggregate(const perf_info_t *entries, size_t n,
+                         perf_span_stats_t *stats, uint16_t max_id);
+
 #endif
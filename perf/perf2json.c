@@ -0,0 +1,29 @@
+/* Converts a binary perf trace into Chrome Trace Event JSON.
+ *
+ * usage: perf2json <trace> <json> [cycles per ns] */
+
+#include "perf_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+int main(int argc, char **argv)
+{
+        if (argc < 3) {
+                fprintf(stderr, "usage: %s <trace> <json> [cycles per ns]\n",
+                        argv[0]);
+                return 1;
+        }
+
+        double cpns = argc > 3 ? atof(argv[3]) : 0.0;
+        int64_t n   = perf_trace_to_json(argv[1], argv[2], cpns);
+
+        if (n < 0) {
+                fprintf(stderr, "%s: cannot convert %s\n", argv[0], argv[1]);
+                return 1;
+        }
+        printf("%lld events\n", (long long)n);
+
+        return 0;
+}
@@ -0,0 +1,218 @@
+#include "perf_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../threads/x-atomic.h"
+#include "../threads/x-threads.h"
+
+#if defined(X_THREAD_SUPPORT) && !defined(X_THREADS_TIRTOS)
+#        define PERF_TRACE_THREAD
+#endif
+
+#define PERF_TRACE_FILE_BUF (1 << 16)
+
+
+struct perf_trace {
+        perf_t *perf;
+        FILE *f;
+        unsigned int period_ms;
+        uint64_t stop;
+        uint64_t written;
+        uint64_t error;
+#ifdef PERF_TRACE_THREAD
+        x_thread_t thread;
+#endif
+        perf_info_t chunk[PERF_TRACE_CHUNK];
+};
+
+
+/* drains until perf is empty, returns the number of entries written */
+static size_t perf_trace_drain(perf_trace_t *t)
+{
+        size_t total = 0;
+        size_t n;
+
+        do {
+                n = perf_drain(t->perf, t->chunk, PERF_TRACE_CHUNK);
+                if (n && fwrite(t->chunk, sizeof(perf_info_t), n, t->f) != n) {
+                        x_atomic_store64(&t->error, 1);
+                }
+                total += n;
+        } while (n == PERF_TRACE_CHUNK);
+
+        if (total) {
+                x_atomic_fetch_add64(&t->written, total);
+                /* readers of the file see whole records */
+                if (fflush(t->f)) {
+                        x_atomic_store64(&t->error, 1);
+                }
+        }
+
+        return total;
+}
+
+
+#ifdef PERF_TRACE_THREAD
+X_THREAD_FUNC(perf_trace_thread)
+{
+        perf_trace_t *t = (perf_trace_t *)p;
+
+        for (;;) {
+                /* read stop first, so the last drain sees all entries
+                 * created before perf_trace_stop */
+                uint64_t stop = x_atomic_load64(&t->stop);
+
+                if (!perf_trace_drain(t) && !stop) {
+                        x_thread_sleep_ms(t->period_ms);
+                }
+                if (stop) {
+                        break;
+                }
+        }
+
+#        ifdef __gnu_linux__
+        return NULL;
+#        endif
+}
+#endif
+
+
+perf_trace_t *perf_trace_start(perf_t *perf, const char *path,
+                               unsigned int period_ms)
+{
+#ifdef PERF_TRACE_THREAD
+        perf_trace_t *t = (perf_trace_t *)malloc(sizeof(perf_trace_t));
+        if (!t) {
+                return NULL;
+        }
+
+        t->f = fopen(path, "wb");
+        if (!t->f) {
+                free(t);
+                return NULL;
+        }
+        setvbuf(t->f, NULL, _IOFBF, PERF_TRACE_FILE_BUF);
+
+        perf_trace_hdr_t hdr;
+        hdr.magic         = PERF_TRACE_MAGIC;
+        hdr.version       = PERF_TRACE_VERSION;
+        hdr.record_size   = sizeof(perf_info_t);
+        hdr.cycles_per_ns = perf_cycles_per_ns();
+
+        t->perf      = perf;
+        t->period_ms = period_ms;
+        t->stop      = 0;
+        t->written   = 0;
+        t->error     = fwrite(&hdr, sizeof(hdr), 1, t->f) != 1;
+
+        t->thread = x_thread_create(perf_trace_thread, t);
+        if (!t->thread) {
+                fclose(t->f);
+                free(t);
+                return NULL;
+        }
+
+        return t;
+#else
+        (void)perf, (void)path, (void)period_ms;
+        return NULL;
+#endif
+}
+
+
+int perf_trace_stop(perf_trace_t *trace)
+{
+        if (!trace) {
+                return -1;
+        }
+
+#ifdef PERF_TRACE_THREAD
+        x_atomic_store64(&trace->stop, 1);
+        x_thread_wait_infinite(trace->thread);
+#endif
+
+        int res = trace->error ? -1 : 0;
+        if (fclose(trace->f)) {
+                res = -1;
+        }
+        free(trace);
+
+        return res;
+}
+
+
+uint64_t perf_trace_written(perf_trace_t *trace)
+{
+        return x_atomic_load64(&trace->written);
+}
+
+
+int64_t perf_trace_to_json(const char *in, const char *out,
+                           double cycles_per_ns)
+{
+        FILE *fi = fopen(in, "rb");
+        if (!fi) {
+                return -1;
+        }
+
+        perf_trace_hdr_t hdr;
+        if (fread(&hdr, sizeof(hdr), 1, fi) != 1 ||
+            hdr.magic != PERF_TRACE_MAGIC ||
+            hdr.version != PERF_TRACE_VERSION ||
+            hdr.record_size != sizeof(perf_info_t)) {
+                fclose(fi);
+                return -1;
+        }
+
+        FILE *fo = fopen(out, "w");
+        if (!fo) {
+                fclose(fi);
+                return -1;
+        }
+
+        if (cycles_per_ns <= 0.0) {
+                cycles_per_ns = hdr.cycles_per_ns;
+        }
+        if (cycles_per_ns <= 0.0) {
+                cycles_per_ns = 1.0;
+        }
+        /* trace event times are in microseconds */
+        double us_per_cycle = 1.0 / (cycles_per_ns * 1000.0);
+
+        perf_info_t e;
+        int64_t n = 0;
+
+        fprintf(fo, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        /* a partially written record at the end is ignored */
+        while (fread(&e, sizeof(e), 1, fi) == 1) {
+                if (e.flags & PERF_INFO_USER) {
+                        fprintf(fo,
+                                "%s\n{\"name\":\"perf %llu\",\"ph\":\"C\","
+                                "\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                                "\"args\":{\"value\":%llu}}",
+                                n ? "," : "", (unsigned long long)e.id, e.tid,
+                                (double)e.time_stamp * us_per_cycle,
+                                (unsigned long long)e.cycles);
+                } else {
+                        uint64_t start = e.time_stamp - e.cycles;
+
+                        fprintf(fo,
+                                "%s\n{\"name\":\"perf %llu\",\"ph\":\"X\","
+                                "\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                                "\"dur\":%.3f}",
+                                n ? "," : "", (unsigned long long)e.id, e.tid,
+                                (double)start * us_per_cycle,
+                                (double)e.cycles * us_per_cycle);
+                }
+                n++;
+        }
+        fprintf(fo, "\n]}\n");
+
+        fclose(fi);
+        if (fclose(fo)) {
+                return -1;
+        }
+
+        return n;
+}
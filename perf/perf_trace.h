@@ -0,0 +1,65 @@
+#ifndef HELPERS_PERF_TRACE_H
+#define HELPERS_PERF_TRACE_H
+/************************************************************************
+ *                Continuous export of perf samples
+ *
+ * A drain thread periodically moves the samples of a perf_t into a binary
+ * trace file, so buffers never overflow and the application does not block
+ * on I/O. The file is a perf_trace_hdr_t followed by perf_info_t records
+ * in perf_drain order. perf_trace_to_json converts it into the Chrome Trace
+ * Event format, which chrome://tracing and ui.perfetto.dev can open, also
+ * while the trace is still being written.
+ ************************************************************************/
+
+#include <stdint.h>
+#include "perf.h"
+
+#define PERF_TRACE_MAGIC   0x3143525446524550ULL /* "PERFTRC1" */
+#define PERF_TRACE_VERSION 2
+#define PERF_TRACE_CHUNK   4096 /* entries per perf_drain call */
+
+#pragma pack(push, 1)
+typedef struct perf_trace_hdr {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t record_size; /* sizeof(perf_info_t) */
+        double cycles_per_ns; /* perf_cycles_per_ns() of the writer */
+} perf_trace_hdr_t;
+#pragma pack(pop)
+
+typedef struct perf_trace perf_trace_t;
+
+
+/*! @brief creates path and starts a thread draining perf into it
+ *  @param perf       perf_t in buffer or per thread mode
+ *  @param path       trace file, truncated if it exists
+ *  @param period_ms  time between drains while the buffers are empty
+ *  @return           trace handle or NULL
+ */
+perf_trace_t *perf_trace_start(perf_t *perf, const char *path,
+                               unsigned int period_ms);
+
+/*! @brief stops the drain thread after a last drain and closes the file
+ *  @param trace  handle from perf_trace_start, freed
+ *  @return       0 or -1 if a write failed
+ */
+int perf_trace_stop(perf_trace_t *trace);
+
+/*! @brief number of samples written so far */
+uint64_t perf_trace_written(perf_trace_t *trace);
+
+/*! @brief converts a binary trace into Chrome Trace Event JSON
+ *
+ * Every sample becomes a complete ("X") event named "perf <id>" on the
+ * track of its thread that ends at its time stamp and lasts its cycles.
+ * PERF_USER samples become counter ("C") events of their user data.
+ *  @param in             binary trace file
+ *  @param out            JSON file
+ *  @param cycles_per_ns  time base, 0 for the one stored in the trace. Pass
+ *                        1 if PERF_GET_CYCLES was redefined to nanoseconds
+ *  @return               number of events or -1 on error
+ */
+int64_t perf_trace_to_json(const char *in, const char *out,
+                           double cycles_per_ns);
+
+#endif
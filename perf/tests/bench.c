@@ -0,0 +1,105 @@
+/* Instrumentation overhead of PERF_START/PERF_STOP.
+ *
+ * Every thread runs LOOPS empty START/STOP pairs. The time per pair is
+ * reported for a disabled id, for the shared buffer (perf_init, one xmutex),
+ * for per thread buffers (perf_init_threaded) and for histograms
+ * (perf_init_hist). Buffers are large enough that no sample is dropped or
+ * overwritten. */
+
+#define _POSIX_C_SOURCE 199309L
+#include "../perf.h"
+#include "../../threads/x-threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOPS       (1 << 18)
+#define MAX_THREADS 8
+
+
+static uint64_t get_time_stamp(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)(t.tv_sec) * 1000000000ull + (uint64_t)(t.tv_nsec);
+}
+
+typedef struct {
+        perf_t *perf;
+        uint64_t ns;
+} bench_ctx_t;
+
+
+X_THREAD_FUNC(bench_thread)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        perf_t *perf     = ctx->perf;
+
+        uint64_t t0 = get_time_stamp();
+        for (int i = 0; i < LOOPS; i++) {
+                PERF_START(perf, 1);
+                PERF_STOP(perf, 1);
+        }
+        ctx->ns = get_time_stamp() - t0;
+
+        return 0;
+}
+
+
+static double bench_run(perf_t *perf, int nthreads)
+{
+        bench_ctx_t ctx[MAX_THREADS];
+        x_thread_t t[MAX_THREADS];
+        uint64_t ns = 0;
+
+        for (int i = 0; i < nthreads; i++) {
+                ctx[i].perf = perf;
+                t[i]        = x_thread_create(bench_thread, &ctx[i]);
+        }
+        for (int i = 0; i < nthreads; i++) {
+                x_thread_wait_infinite(t[i]);
+                ns += ctx[i].ns;
+        }
+
+        return (double)ns / ((double)nthreads * LOOPS);
+}
+
+
+int main(void)
+{
+        printf("%-8s %12s %12s %12s %12s\n", "threads", "disabled", "shared",
+               "per-thread", "histogram");
+
+        for (int n = 1; n <= MAX_THREADS; n *= 2) {
+                perf_t *off    = perf_init(1, false);
+                perf_t *shared = perf_init((size_t)n * LOOPS, true);
+                perf_t *tbuf   = perf_init_threaded(LOOPS, true);
+                perf_t *hist   = perf_init_hist(1, true);
+
+                if (!off || !shared || !tbuf || !hist) {
+                        printf("perf init failed!\n");
+                        return 1;
+                }
+
+                double d = bench_run(off, n);
+                double s = bench_run(shared, n);
+                double t = bench_run(tbuf, n);
+                double h = bench_run(hist, n);
+
+                printf("%-8d %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n", n, d, s,
+                       t, h);
+
+                if (perf_dropped(tbuf)) {
+                        printf("per-thread buffers dropped samples!\n");
+                        return 1;
+                }
+
+                perf_free(off);
+                perf_free(shared);
+                perf_free(tbuf);
+                perf_free(hist);
+        }
+
+        return 0;
+}
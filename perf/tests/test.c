@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 199309L
 #include "../perf.h"
+#include "../perf_trace.h"
+#include "../../threads/x-threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +31,12 @@ uint64_t get_time_stamp()
 
 perf_t *test_perf = NULL;
 
+/* the cycle source of perf.h, before it is replaced below */
+static uint64_t test_cycles(void)
+{
+        return PERF_GET_CYCLES;
+}
+
 #undef PERF_GET_CYCLES
 #define PERF_GET_CYCLES get_time_stamp()
 
@@ -49,6 +57,378 @@ void test_function(perf_t *perf)
         PERF_STOP(test_perf, 1);
 }
 
+#define THREAD_ENTRIES 1000
+
+
+X_THREAD_FUNC(thread_function)
+{
+        perf_t *perf = (perf_t *)p;
+
+        for (int i = 0; i < THREAD_ENTRIES; ++i) {
+                PERF_START(perf, 3);
+                PERF_STOP(perf, 3);
+        }
+        return 0;
+}
+
+
+static int test_threaded(void)
+{
+        const int nthreads = 4;
+        x_thread_t t[4];
+        perf_t *perf = perf_init_threaded(THREAD_ENTRIES, true);
+
+        if (!perf) {
+                printf("perf threaded init failed!\n");
+                return 6;
+        }
+
+        for (int i = 0; i < nthreads; ++i) {
+                t[i] = x_thread_create(thread_function, perf);
+        }
+        for (int i = 0; i < nthreads; ++i) {
+                x_thread_wait_infinite(t[i]);
+        }
+
+        perf_info_t *out = malloc(sizeof(perf_info_t) * nthreads *
+                                  THREAD_ENTRIES);
+        size_t n = perf_drain(perf, out, nthreads * THREAD_ENTRIES);
+        int res  = EXIT_SUCCESS;
+
+        if (n != (size_t)nthreads * THREAD_ENTRIES || perf_dropped(perf)) {
+                printf("perf drain returned %zu entries!\n", n);
+                res = 7;
+        }
+        for (size_t i = 1; i < n; ++i) {
+                if (out[i].time_stamp < out[i - 1].time_stamp) {
+                        printf("perf drain not ordered at %zu!\n", i);
+                        res = 8;
+                        break;
+                }
+        }
+        if (perf_drain(perf, out, 1) != 0) {
+                printf("perf drain did not empty buffers!\n");
+                res = 9;
+        }
+
+        free(out);
+        perf_free(perf);
+
+        return res;
+}
+
+
+static double span_busy(void)
+{
+        double val = 0.0;
+        for (int j = 0; j < 100000; ++j) {
+                val += tanh(val + 0.1);
+        }
+        return val;
+}
+
+
+static void span_inner(perf_t *perf)
+{
+        PERF_SPAN(perf, 2);
+        span_busy();
+}
+
+
+/* closes its span on both return paths */
+static int span_outer(perf_t *perf, bool early)
+{
+        PERF_SPAN(perf, 1);
+        span_busy();
+        span_inner(perf);
+        if (early) {
+                return 1;
+        }
+        span_inner(perf);
+        return 0;
+}
+
+
+static int test_spans(void)
+{
+        perf_t *perf = perf_init(100, true);
+        perf_info_t out[100];
+        perf_span_stats_t st[2] = {0};
+        int res = EXIT_SUCCESS;
+
+        if (!perf) {
+                printf("perf init failed!\n");
+                return 21;
+        }
+
+        span_outer(perf, false);
+        span_outer(perf, true);
+
+        size_t n = perf_drain(perf, out, 100);
+        if (n != 5) {
+                printf("perf spans recorded %zu entries!\n", n);
+                res = 22;
+                goto exit;
+        }
+        for (size_t i = 0; i < n; ++i) {
+                if (!(out[i].flags & PERF_INFO_SPAN) || !out[i].tid ||
+                    out[i].depth != (out[i].id == 1 ? 0 : 1)) {
+                        printf("perf span %zu has wrong depth or tid!\n", i);
+                        res = 23;
+                        goto exit;
+                }
+        }
+
+        if (!perf_span_aggregate(out, n, st, 2) || st[0].count != 2 ||
+            st[1].count != 3 || st[1].exclusive != st[1].inclusive ||
+            st[0].exclusive != st[0].inclusive - st[1].inclusive) {
+                printf("perf span aggregation wrong!\n");
+                res = 24;
+        }
+
+exit:
+        perf_free(perf);
+
+        return res;
+}
+
+
+X_THREAD_FUNC(toggle_function)
+{
+        perf_t *perf = (perf_t *)p;
+
+        for (int i = 0; i < THREAD_ENTRIES; ++i) {
+                perf_disable(perf, 3);
+                perf_enable(perf, 3);
+                perf_disable_group(perf, 1);
+                perf_enable_group(perf, 1);
+        }
+        return 0;
+}
+
+
+static int test_control(void)
+{
+        perf_t *perf = perf_init_hist(PERF_MAX_ID, false);
+        perf_stats_t st;
+        x_thread_t t[2];
+        int res = EXIT_SUCCESS;
+
+        if (!perf) {
+                printf("perf hist init failed!\n");
+                return 25;
+        }
+
+        /* ids that are multiples of 64 used a negative shift */
+        perf_enable(perf, 64);
+        perf_enable(perf, 128);
+        perf_enable(perf, PERF_MAX_ID);
+        PERF_MARK(perf, 64);
+        PERF_MARK(perf, 128);
+        PERF_MARK(perf, PERF_MAX_ID);
+        PERF_MARK(perf, 65);
+        if (!perf_hist_stats(perf, 64, &st) ||
+            !perf_hist_stats(perf, 128, &st) ||
+            !perf_hist_stats(perf, PERF_MAX_ID, &st) ||
+            perf_hist_stats(perf, 65, &st) || perf_is_enabled(perf, 0) ||
+            perf_is_enabled(perf, PERF_MAX_ID + 1)) {
+                printf("perf ids at 64 bit boundaries wrong!\n");
+                res = 26;
+                goto exit;
+        }
+
+        perf_enable(perf, 5);
+        perf_set_group(perf, 5, 3);
+        perf_disable_group(perf, 3);
+        if (perf_is_enabled(perf, 5) || !perf_is_enabled(perf, 64)) {
+                printf("perf group disable wrong!\n");
+                res = 27;
+                goto exit;
+        }
+        perf_enable_group(perf, 3);
+        if (!perf_is_enabled(perf, 5)) {
+                printf("perf group enable wrong!\n");
+                res = 28;
+                goto exit;
+        }
+
+        perf_set_sampling(perf, 5, 10);
+        for (int i = 0; i < 10000; ++i) {
+                PERF_MARK(perf, 5);
+        }
+        if (!perf_hist_stats(perf, 5, &st) || st.count < 800 ||
+            st.count > 1200) {
+                printf("perf sampled %llu of 10000!\n",
+                       (unsigned long long)st.count);
+                res = 29;
+                goto exit;
+        }
+
+        /* toggle while recording */
+        perf_enable(perf, 3);
+        perf_set_group(perf, 3, 1);
+        t[0] = x_thread_create(thread_function, perf);
+        t[1] = x_thread_create(toggle_function, perf);
+        x_thread_wait_infinite(t[0]);
+        x_thread_wait_infinite(t[1]);
+        if (!perf_is_enabled(perf, 3)) {
+                printf("perf id 3 not enabled after toggling!\n");
+                res = 30;
+        }
+
+exit:
+        perf_free(perf);
+
+        return res;
+}
+
+
+static bool test_near(uint64_t v, uint64_t expect)
+{
+        return v <= expect + expect / 16 && v + expect / 16 >= expect;
+}
+
+
+static int test_hist(void)
+{
+        const int nthreads = 4;
+        x_thread_t t[4];
+        perf_stats_t st;
+        perf_t *perf = perf_init_hist(3, true);
+
+        if (!perf || perf_init_hist(0, true)) {
+                printf("perf hist init failed!\n");
+                return 12;
+        }
+
+        for (uint64_t v = 1; v <= 10000; ++v) {
+                perf_create_entry(perf, 1, 0, v);
+        }
+        perf_create_entry(perf, 4, 0, 1);
+
+        if (!perf_hist_stats(perf, 1, &st) || st.count != 10000 ||
+            st.min != 1 || st.max != 10000 || st.mean != 5000.5 ||
+            !test_near(st.p50, 5000) || !test_near(st.p99, 9900) ||
+            !test_near(st.p999, 9990)) {
+                printf("perf hist stats wrong!\n");
+                return 13;
+        }
+        if (perf_hist_stats(perf, 2, &st) || perf_hist_stats(perf, 4, &st)) {
+                printf("perf hist has samples of unused id!\n");
+                return 14;
+        }
+
+        for (int i = 0; i < nthreads; ++i) {
+                t[i] = x_thread_create(thread_function, perf);
+        }
+        for (int i = 0; i < nthreads; ++i) {
+                x_thread_wait_infinite(t[i]);
+        }
+
+        if (!perf_hist_stats(perf, 3, &st) ||
+            st.count != (uint64_t)nthreads * THREAD_ENTRIES) {
+                printf("perf hist lost threaded samples!\n");
+                return 15;
+        }
+
+        perf_hist_reset(perf, 1);
+        if (perf_hist_stats(perf, 1, &st)) {
+                printf("perf hist not reset!\n");
+                return 16;
+        }
+
+        perf_free(perf);
+
+        return EXIT_SUCCESS;
+}
+
+
+static int test_trace(void)
+{
+        const char *bin  = "perf_trace.bin";
+        const char *json = "perf_trace.json";
+        perf_t *perf     = perf_init_threaded(THREAD_ENTRIES, true);
+        int res          = EXIT_SUCCESS;
+
+        if (!perf) {
+                printf("perf init failed!\n");
+                return 17;
+        }
+
+        perf_trace_t *trace = perf_trace_start(perf, bin, 1);
+        if (!trace) {
+                printf("perf trace start failed!\n");
+                perf_free(perf);
+                return 18;
+        }
+
+        /* more entries than perf holds, what the drain thread misses is
+         * dropped and counted */
+        for (int i = 0; i < 10 * THREAD_ENTRIES; ++i) {
+                perf_create_entry(perf, 1 + i % 3, 0, i);
+                if (i % 100 == 99) {
+                        x_thread_sleep_ms(2);
+                }
+        }
+
+        if (perf_trace_stop(trace)) {
+                printf("perf trace write failed!\n");
+                res = 19;
+        }
+
+        int64_t n = perf_trace_to_json(bin, json, 1.0);
+        if (n < THREAD_ENTRIES ||
+            n + (int64_t)perf_dropped(perf) != 10 * THREAD_ENTRIES) {
+                printf("perf trace has %lld events, %llu dropped!\n",
+                       (long long)n, (unsigned long long)perf_dropped(perf));
+                res = 20;
+        }
+
+        remove(bin);
+        remove(json);
+        perf_free(perf);
+
+        return res;
+}
+
+
+/* converted cycles of a 50 ms busy wait must match the wall clock */
+static int test_calibration(void)
+{
+        if (perf_cycles_per_ns() <= 0.0) {
+                printf("perf has no cycle source, skipping calibration\n");
+                return EXIT_SUCCESS;
+        }
+
+        uint64_t t0 = get_time_stamp();
+        uint64_t c0 = test_cycles();
+        uint64_t prev = c0;
+        uint64_t t1;
+
+        do {
+                uint64_t c = test_cycles();
+                if (c < prev) {
+                        printf("perf cycles not monotonic!\n");
+                        return 10;
+                }
+                prev = c;
+                t1   = get_time_stamp();
+        } while (t1 - t0 < 50000000);
+
+        uint64_t ns = perf_cycles_to_ns(test_cycles() - c0);
+        double err  = fabs((double)ns - (double)(t1 - t0)) / (double)(t1 - t0);
+
+        printf("perf %.3f cycles/ns, 50 ms measured as %llu ns\n",
+               perf_cycles_per_ns(), (unsigned long long)ns);
+        if (err > 0.1) {
+                printf("perf calibration off by %.1f%%!\n", err * 100.0);
+                return 11;
+        }
+
+        return EXIT_SUCCESS;
+}
+
+
 int main(void)
 {
         printf("------ Testing perf util ------\n");
@@ -113,6 +493,22 @@ int main(void)
                 printf("Entry %lli: id=%lli, ts=%lli cycles=%lli\n", i,
                        first[i].id, first[i].time_stamp, first[i].cycles);
         }
+        res = test_threaded();
+        if (res == EXIT_SUCCESS) {
+                res = test_calibration();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_hist();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_trace();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_spans();
+        }
+        if (res == EXIT_SUCCESS) {
+                res = test_control();
+        }
 exit:
         perf_free(perf);
 
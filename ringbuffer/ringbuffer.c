@@ -94,19 +94,50 @@ void *h_ringbuff_alloc(uint64_t size_el, uint64_t num_el, uint64_t header_size)
 }
 
 
-void *h_ringbuff_aligned_alloc(size_t alignment, uint64_t size_el,
-                               uint64_t num_el, uint64_t header_size)
+uint64_t h_ringbuff_round_pow2(uint64_t n)
+{
+        uint64_t p = 1;
+
+        while (p < n) {
+                p <<= 1;
+        }
+
+        return p;
+}
+
+
+void *h_ringbuff_mem_alloc(size_t alignment, size_t size)
 {
-        void *buff;
 #ifdef _WIN32
-        buff = _aligned_malloc(
-            h_ringbuff_alloc_size(size_el, num_el, header_size), alignment);
+        return _aligned_malloc(size, alignment);
 #elif defined(SOC_AM65XX)
+        (void)alignment, (void)size;
         return NULL;
 #else
-        buff = aligned_alloc(
-            alignment, h_ringbuff_alloc_size(size_el, num_el, header_size));
+        /* aligned_alloc wants a multiple of the alignment */
+        size = (size + alignment - 1) & ~(alignment - 1);
+        return aligned_alloc(alignment, size);
+#endif
+}
+
+
+void h_ringbuff_mem_free(void *mem)
+{
+#ifdef _WIN32
+        _aligned_free(mem);
+#elif defined(SOC_AM65XX)
+        (void)mem;
+#else
+        free(mem);
 #endif
+}
+
+
+void *h_ringbuff_aligned_alloc(size_t alignment, uint64_t size_el,
+                               uint64_t num_el, uint64_t header_size)
+{
+        void *buff = h_ringbuff_mem_alloc(
+            alignment, h_ringbuff_alloc_size(size_el, num_el, header_size));
 
         if (!buff) {
                 return buff;
@@ -121,13 +152,7 @@ void *h_ringbuff_aligned_alloc(size_t alignment, uint64_t size_el,
 
 void h_ringbuff_aligned_free(void *buffer)
 {
-#ifdef _WIN32
-        _aligned_free(buffer);
-#elif defined(SOC_AM65XX)
-        return;
-#else
-        free(buffer);
-#endif
+        h_ringbuff_mem_free(buffer);
 }
 
 
@@ -279,6 +304,224 @@ int h_ringbuff_pop(void *buffer, uint64_t size)
 }
 
 
+uint64_t h_ringbuff_push_n(void *buffer, const void *data, uint64_t n)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        uint64_t size_el = rbh->size_el;
+        uint64_t ring    = rbh->ring_size;
+        uint64_t w       = rbh->w - rbh->header_size;
+        uint64_t r       = x_atomic_load64(&rbh->r) - rbh->header_size;
+        uint64_t space   = ((r - w - size_el + ring) % ring) / size_el;
+
+        if (n > space) {
+                n = space;
+        }
+        if (!n) {
+                return 0;
+        }
+
+        /* at most two copies: up to the end of the ring, then from the
+         * start */
+        uint64_t bytes = n * size_el;
+        uint64_t first = ring - w;
+        if (first > bytes) {
+                first = bytes;
+        }
+
+        char *ring_start = (char *)buffer + rbh->header_size;
+        memcpy(ring_start + w, data, first);
+        if (bytes > first) {
+                memcpy(ring_start, (const char *)data + first, bytes - first);
+        }
+
+        w += bytes;
+        if (w >= ring) {
+                w -= ring;
+        }
+
+        x_atomic_store64(&rbh->w, w + rbh->header_size);
+
+        if (rbh->push_hook) {
+                for (uint64_t i = 0; i < n; i++) {
+                        rbh->push_hook((uint8_t *)data + i * size_el,
+                                       (size_t)size_el);
+                }
+        }
+        return n;
+}
+
+
+uint64_t h_ringbuff_pop_n(void *buffer, void *data, uint64_t n)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        uint64_t size_el = rbh->size_el;
+        uint64_t i;
+
+        if (rbh->looping_read || rbh->dynlist_enabled) {
+                /* wrap limit and reference counts are per element */
+                for (i = 0; i < n; i++) {
+                        void *next = h_ringbuff_read(buffer, size_el);
+                        if (!next) {
+                                break;
+                        }
+                        if (data) {
+                                memcpy((char *)data + i * size_el, next,
+                                       size_el);
+                        }
+                        if (h_ringbuff_pop(buffer, size_el) != RINGBUFF_OK) {
+                                break;
+                        }
+                }
+                return i;
+        }
+
+        uint64_t ring = rbh->ring_size;
+        uint64_t w    = x_atomic_load64(&rbh->w) - rbh->header_size;
+        uint64_t r    = rbh->r - rbh->header_size;
+        uint64_t used = ((w - r + ring) % ring) / size_el;
+
+        if (n > used) {
+                n = used;
+        }
+        if (!n) {
+                return 0;
+        }
+
+        uint64_t bytes = n * size_el;
+
+        if (data) {
+                uint64_t first = ring - r;
+                if (first > bytes) {
+                        first = bytes;
+                }
+
+                char *ring_start = (char *)buffer + rbh->header_size;
+                memcpy(data, ring_start + r, first);
+                if (bytes > first) {
+                        memcpy((char *)data + first, ring_start,
+                               bytes - first);
+                }
+        }
+
+        r += bytes;
+        if (r >= ring) {
+                r -= ring;
+        }
+
+        x_atomic_store64(&rbh->r, r + rbh->header_size);
+
+        return n;
+}
+
+
+void *h_ringbuff_peek(void *buffer, uint64_t *n)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        uint64_t cur_w = x_atomic_load64(&rbh->w);
+        uint64_t end   = rbh->header_size + rbh->ring_size;
+
+        if (cur_w == rbh->r) {
+                *n = 0;
+                return NULL;
+        }
+
+        if (rbh->looping_read) {
+                end -= rbh->size_el;
+        }
+        if (cur_w > rbh->r) {
+                end = cur_w;
+        }
+
+        *n = (end - rbh->r) / rbh->size_el;
+
+        return (char *)buffer + rbh->r;
+}
+
+
+/* free bytes at the write pointer that can be written without wrapping */
+static uint64_t reserve_space(h_ringbuff_header_t *rbh)
+{
+        uint64_t ring  = rbh->ring_size;
+        uint64_t w     = rbh->w - rbh->header_size;
+        uint64_t r     = x_atomic_load64(&rbh->r) - rbh->header_size;
+        uint64_t space = (r - w - rbh->size_el + ring) % ring;
+
+        if (space > ring - w) {
+                space = ring - w;
+        }
+
+        return space;
+}
+
+
+void *h_ringbuff_reserve(void *buffer, uint64_t size)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        if (!size || size > reserve_space(rbh)) {
+                return NULL;
+        }
+
+        return (char *)buffer + rbh->w;
+}
+
+
+void *h_ringbuff_reserve_n(void *buffer, uint64_t *n)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        *n = reserve_space(rbh) / rbh->size_el;
+        if (!*n) {
+                return NULL;
+        }
+
+        return (char *)buffer + rbh->w;
+}
+
+
+void h_ringbuff_commit(void *buffer, uint64_t size)
+{
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        uint8_t *data = (uint8_t *)buffer + rbh->w;
+        uint64_t w    = rbh->w - rbh->header_size + size;
+
+        if (w >= rbh->ring_size) {
+                w = 0;
+        }
+
+        x_atomic_store64(&rbh->w, w + rbh->header_size);
+
+        if (rbh->push_hook) {
+                rbh->push_hook(data, (size_t)size);
+        }
+}
+
+
+void *h_ringbuff_acquire(void *buffer, uint64_t size)
+{
+        uint64_t n;
+        h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
+
+        void *span = h_ringbuff_peek(buffer, &n);
+
+        if (!size || size > n * rbh->size_el) {
+                return NULL;
+        }
+
+        return span;
+}
+
+
+int h_ringbuff_release(void *buffer, uint64_t size)
+{
+        return h_ringbuff_pop(buffer, size);
+}
+
+
 bool h_ringbuff_is_empty(void *buffer)
 {
         h_ringbuff_header_t *rbh = (h_ringbuff_header_t *)buffer;
@@ -8,6 +8,9 @@
 #define RINGBUFF_OK         0
 #define RINGBUFF_EMPTY      1
 #define RINGBUFF_REFERENCED 2
+#define RINGBUFF_TIMEOUT    3
+
+#define H_RINGBUFF_CACHE_LINE 64
 
 
 typedef void (*ring_push_hook_t)(uint8_t *data, size_t size);
@@ -82,6 +85,22 @@ void h_ringbuff_free(void *buffer);
  */
 void h_ringbuff_aligned_free(void *buffer);
 
+/*! @brief allocates memory aligned to alignment, shared by the ringbuffer
+ *         variants
+ *  @param alignment  alignment value (must be integer power of 2)
+ *  @param size       size in bytes, rounded up to a multiple of alignment
+ *  @return           pointer for h_ringbuff_mem_free or NULL
+ */
+void *h_ringbuff_mem_alloc(size_t alignment, size_t size);
+
+/*! @brief frees memory of h_ringbuff_mem_alloc
+ *  @param mem  pointer to the memory
+ */
+void h_ringbuff_mem_free(void *mem);
+
+/*! @brief returns the smallest integer power of 2 >= n */
+uint64_t h_ringbuff_round_pow2(uint64_t n);
+
 /*! @brief Aligns a ringbuffer so that its size is multiples of the element size
  *  @param buffer  Pointer to initialized ringbuffer
  *  @param size_el New size in bytes of the ringbuffer element
@@ -99,6 +118,74 @@ void *h_ringbuff_push_ref(void *buffer, void *data);
 void *h_ringbuff_read(void *buffer, uint64_t size);
 int h_ringbuff_pop(void *buffer, uint64_t size);
 
+/*! @brief copies up to n elements of size_el into the buffer and publishes
+ *         them with a single update of the write pointer
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param data    n consecutive elements
+ *  @param n       number of elements
+ *  @return        number of elements pushed, less than n if the buffer filled
+ */
+uint64_t h_ringbuff_push_n(void *buffer, const void *data, uint64_t n);
+
+/*! @brief removes up to n elements of size_el with a single update of the
+ *         read pointer
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param data    receives the elements, may be NULL to drop them
+ *  @param n       number of elements
+ *  @return        number of elements removed
+ */
+uint64_t h_ringbuff_pop_n(void *buffer, void *data, uint64_t n);
+
+/*! @brief returns the longest run of elements that can be read without
+ *         wrapping, release them with h_ringbuff_pop(buffer, n * size_el)
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param n       receives the number of contiguous elements
+ *  @return        pointer to the oldest element or NULL if empty
+ */
+void *h_ringbuff_peek(void *buffer, uint64_t *n);
+
+/*! @brief reserves size bytes at the write pointer so that a record can be
+ *         built in place, then published with h_ringbuff_commit. Only one
+ *         reservation may be outstanding. Near the end of the ring a size
+ *         that does not fit before it fails even on an empty ring, use
+ *         h_ringbuff_reserve_n if the amount written may be smaller.
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param size    multiple of size_el, must fit before the end of the ring
+ *  @return        pointer into the ring or NULL if there is not enough
+ *                 contiguous space
+ */
+void *h_ringbuff_reserve(void *buffer, uint64_t size);
+
+/*! @brief reserves the longest run of free elements that can be written
+ *         without wrapping, e.g. for recv(). Commit k <= n elements with
+ *         h_ringbuff_commit(buffer, k * size_el), a commit up to the end of
+ *         the ring lets the next reservation start at its beginning.
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param n       receives the number of contiguous free elements
+ *  @return        pointer into the ring or NULL if it is full
+ */
+void *h_ringbuff_reserve_n(void *buffer, uint64_t *n);
+
+/*! @brief publishes size bytes of a reservation
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param size    bytes written, at most the reserved size
+ */
+void h_ringbuff_commit(void *buffer, uint64_t size);
+
+/*! @brief gives access to size contiguous bytes at the read pointer without
+ *         copying, release them with h_ringbuff_release
+ *  @param buffer  pointer to initialized ringbuffer
+ *  @param size    multiple of size_el
+ *  @return        pointer into the ring or NULL if less than size bytes can
+ *                 be read without wrapping
+ */
+void *h_ringbuff_acquire(void *buffer, uint64_t size);
+
+/*! @brief releases size bytes obtained by h_ringbuff_acquire
+ *  @return RINGBUFF_OK, RINGBUFF_EMPTY or RINGBUFF_REFERENCED
+ */
+int h_ringbuff_release(void *buffer, uint64_t size);
+
 void h_ringbuff_size_init(h_ringbuff_header_t *rbh, uint64_t size_el,
                           uint64_t num_el, uint64_t header_size);
 
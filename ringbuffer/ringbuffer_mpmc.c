@@ -0,0 +1,154 @@
+#include "ringbuffer_mpmc.h"
+
+#include <string.h>
+
+#include "../threads/x-atomic.h"
+
+
+/* the sequence number is the first 8 bytes of a slot, data follows */
+static inline uint64_t *mpmc_slot(h_ringbuff_mpmc_t *rbh, uint64_t idx)
+{
+        return (uint64_t *)((char *)rbh + rbh->header_size +
+                            (idx & rbh->mask) * rbh->slot_size);
+}
+
+
+static uint64_t mpmc_slot_size(uint64_t size_el)
+{
+        return sizeof(uint64_t) + ((size_el + 7) & ~(uint64_t)7);
+}
+
+
+size_t h_ringbuff_mpmc_alloc_size(uint64_t size_el, uint64_t num_el)
+{
+        return sizeof(h_ringbuff_mpmc_t) +
+               mpmc_slot_size(size_el) * h_ringbuff_round_pow2(num_el);
+}
+
+
+void h_ringbuff_mpmc_size_init(h_ringbuff_mpmc_t *rbh, uint64_t size_el,
+                               uint64_t num_el)
+{
+        rbh->header_size = sizeof(h_ringbuff_mpmc_t);
+        rbh->mask        = h_ringbuff_round_pow2(num_el) - 1;
+        rbh->size_el     = size_el;
+        rbh->slot_size   = mpmc_slot_size(size_el);
+}
+
+
+void *h_ringbuff_mpmc_alloc(uint64_t size_el, uint64_t num_el)
+{
+        void *buff = h_ringbuff_mem_alloc(
+            H_RINGBUFF_CACHE_LINE, h_ringbuff_mpmc_alloc_size(size_el, num_el));
+
+        if (!buff) {
+                return buff;
+        }
+
+        h_ringbuff_mpmc_size_init((h_ringbuff_mpmc_t *)buff, size_el, num_el);
+
+        return buff;
+}
+
+
+void h_ringbuff_mpmc_free(void *buffer)
+{
+        h_ringbuff_mem_free(buffer);
+}
+
+
+void h_ringbuff_mpmc_init(void *buffer)
+{
+        h_ringbuff_mpmc_t *rbh = (h_ringbuff_mpmc_t *)buffer;
+
+        if (!rbh) {
+                return;
+        }
+
+        for (uint64_t i = 0; i <= rbh->mask; i++) {
+                *mpmc_slot(rbh, i) = i;
+        }
+
+        rbh->w = 0;
+        rbh->r = 0;
+}
+
+
+uint64_t h_ringbuff_mpmc_push(void *buffer, const void *data)
+{
+        h_ringbuff_mpmc_t *rbh = (h_ringbuff_mpmc_t *)buffer;
+
+        uint64_t pos = x_atomic_load64(&rbh->w);
+        uint64_t *slot;
+
+        while (1) {
+                slot         = mpmc_slot(rbh, pos);
+                int64_t diff = (int64_t)(x_atomic_load64(slot) - pos);
+
+                if (diff == 0) {
+                        /* slot is free, try to claim it */
+                        if (x_atomic_cas64(&rbh->w, &pos, pos + 1)) {
+                                break;
+                        }
+                } else if (diff < 0) {
+                        /* slot still holds the element of the last lap */
+                        return 1;
+                } else {
+                        pos = x_atomic_load64(&rbh->w);
+                }
+        }
+
+        memcpy(slot + 1, data, rbh->size_el);
+
+        x_atomic_store64(slot, pos + 1);
+
+        return 0;
+}
+
+
+int h_ringbuff_mpmc_pop(void *buffer, void *data)
+{
+        h_ringbuff_mpmc_t *rbh = (h_ringbuff_mpmc_t *)buffer;
+
+        uint64_t pos = x_atomic_load64(&rbh->r);
+        uint64_t *slot;
+
+        while (1) {
+                slot         = mpmc_slot(rbh, pos);
+                int64_t diff = (int64_t)(x_atomic_load64(slot) - (pos + 1));
+
+                if (diff == 0) {
+                        if (x_atomic_cas64(&rbh->r, &pos, pos + 1)) {
+                                break;
+                        }
+                } else if (diff < 0) {
+                        return RINGBUFF_EMPTY;
+                } else {
+                        pos = x_atomic_load64(&rbh->r);
+                }
+        }
+
+        memcpy(data, slot + 1, rbh->size_el);
+
+        /* hand the slot to the producer of the next lap */
+        x_atomic_store64(slot, pos + rbh->mask + 1);
+
+        return RINGBUFF_OK;
+}
+
+
+uint64_t h_ringbuff_mpmc_count(void *buffer)
+{
+        h_ringbuff_mpmc_t *rbh = (h_ringbuff_mpmc_t *)buffer;
+
+        uint64_t cur_r = x_atomic_load64(&rbh->r);
+        uint64_t cur_w = x_atomic_load64(&rbh->w);
+
+        return cur_w > cur_r ? cur_w - cur_r : 0;
+}
+
+
+bool h_ringbuff_mpmc_is_empty(void *buffer)
+{
+        return h_ringbuff_mpmc_count(buffer) == 0;
+}
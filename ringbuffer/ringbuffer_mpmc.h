@@ -0,0 +1,85 @@
+#ifndef HELPERS_RINGBUFFER_MPMC_H
+#define HELPERS_RINGBUFFER_MPMC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+/* Multi producer / multi consumer ringbuffer with per slot sequence numbers
+ * (D. Vyukov's bounded queue).
+ *
+ * Every slot starts with a sequence number. A producer may fill slot
+ * pos & mask when its sequence equals pos, a consumer may empty it when the
+ * sequence equals pos + 1. Producers and consumers claim positions with a
+ * CAS on their own counter, which lives on its own cache line. Elements are
+ * copied in and out, since a slot can be reused as soon as it is popped. */
+typedef struct h_ringbuff_mpmc {
+        /* read-only after init */
+        uint64_t header_size;
+        uint64_t mask;
+        uint64_t size_el;
+        uint64_t slot_size;
+        uint8_t pad0[H_RINGBUFF_CACHE_LINE - 4 * sizeof(uint64_t)];
+        /* claimed by producers */
+        uint64_t w;
+        uint8_t pad1[H_RINGBUFF_CACHE_LINE - sizeof(uint64_t)];
+        /* claimed by consumers */
+        uint64_t r;
+        uint8_t pad2[H_RINGBUFF_CACHE_LINE - sizeof(uint64_t)];
+} h_ringbuff_mpmc_t;
+
+
+/*! @brief returns the number of bytes needed for a mpmc ringbuffer
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ *  @return         size in bytes including header and sequence numbers
+ */
+size_t h_ringbuff_mpmc_alloc_size(uint64_t size_el, uint64_t num_el);
+
+/*! @brief sets up element size and count of a mpmc ringbuffer header, for
+ *         buffers that are not allocated with h_ringbuff_mpmc_alloc
+ *  @param rbh      pointer to memory of h_ringbuff_mpmc_alloc_size bytes
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ */
+void h_ringbuff_mpmc_size_init(h_ringbuff_mpmc_t *rbh, uint64_t size_el,
+                               uint64_t num_el);
+
+/*! @brief allocates cache line aligned memory for a mpmc ringbuffer
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ *  @return         pointer to allocated ringbuffer
+ */
+void *h_ringbuff_mpmc_alloc(uint64_t size_el, uint64_t num_el);
+
+/*! @brief frees a ringbuffer allocated with h_ringbuff_mpmc_alloc
+ *  @param buffer  pointer to the ringbuffer
+ */
+void h_ringbuff_mpmc_free(void *buffer);
+
+/*! @brief initializes (empties) a mpmc ringbuffer, not thread safe
+ *  @param buffer  pointer to an allocated buffer
+ */
+void h_ringbuff_mpmc_init(void *buffer);
+
+/*! @brief copies one element into the buffer, any thread
+ *  @param buffer  pointer to the ringbuffer
+ *  @param data    element of size_el bytes
+ *  @return        0 on success, 1 if the buffer is full
+ */
+uint64_t h_ringbuff_mpmc_push(void *buffer, const void *data);
+
+/*! @brief removes the oldest element, any thread
+ *  @param buffer  pointer to the ringbuffer
+ *  @param data    receives the element, size_el bytes
+ *  @return        RINGBUFF_OK or RINGBUFF_EMPTY
+ */
+int h_ringbuff_mpmc_pop(void *buffer, void *data);
+
+/* only approximate while other threads push or pop */
+uint64_t h_ringbuff_mpmc_count(void *buffer);
+bool h_ringbuff_mpmc_is_empty(void *buffer);
+
+#endif
@@ -0,0 +1,240 @@
+#ifdef __gnu_linux__
+#        ifndef _GNU_SOURCE
+#                define _GNU_SOURCE
+#        endif
+#        include <fcntl.h>
+#        include <sys/mman.h>
+#        include <sys/stat.h>
+#        include <unistd.h>
+#endif
+
+#include "ringbuffer_shm.h"
+#include "ringbuffer_spsc.h"
+#include "ringbuffer_mpmc.h"
+#include "ringbuffer_var.h"
+
+#include <string.h>
+
+#include "../threads/x-atomic.h"
+
+#define H_RINGBUFF_SHM_MAGIC 0x6d68736666756272ULL
+
+/* the ring follows the header at a fixed, cache line aligned offset */
+typedef char shm_hdr_fits[sizeof(h_ringbuff_shm_t) <= H_RINGBUFF_SHM_HDR ? 1
+                                                                         : -1];
+
+
+static inline h_ringbuff_shm_t *shm_hdr(void *buffer)
+{
+        return (h_ringbuff_shm_t *)((char *)buffer - H_RINGBUFF_SHM_HDR);
+}
+
+
+static size_t shm_ring_size(h_ringbuff_shm_kind_t kind, uint64_t size_el,
+                            uint64_t num_el)
+{
+        switch (kind) {
+        case H_RINGBUFF_SHM_FIXED:
+                return h_ringbuff_alloc_size(size_el, num_el, 0);
+        case H_RINGBUFF_SHM_SPSC:
+                return h_ringbuff_spsc_alloc_size(size_el, num_el);
+        case H_RINGBUFF_SHM_MPMC:
+                return h_ringbuff_mpmc_alloc_size(size_el, num_el);
+        case H_RINGBUFF_SHM_VAR:
+                return h_ringbuff_var_alloc_size(size_el * num_el);
+        default: return 0;
+        }
+}
+
+
+static void shm_ring_init(void *ring, h_ringbuff_shm_kind_t kind,
+                          uint64_t size_el, uint64_t num_el)
+{
+        switch (kind) {
+        case H_RINGBUFF_SHM_FIXED:
+                h_ringbuff_size_init(ring, size_el, num_el,
+                                     sizeof(h_ringbuff_header_t));
+                h_ringbuff_init(ring);
+                break;
+        case H_RINGBUFF_SHM_SPSC:
+                h_ringbuff_spsc_size_init(ring, size_el, num_el);
+                h_ringbuff_spsc_init(ring);
+                break;
+        case H_RINGBUFF_SHM_MPMC:
+                h_ringbuff_mpmc_size_init(ring, size_el, num_el);
+                h_ringbuff_mpmc_init(ring);
+                break;
+        case H_RINGBUFF_SHM_VAR:
+                h_ringbuff_var_size_init(ring, size_el * num_el);
+                h_ringbuff_var_init(ring);
+                break;
+        }
+}
+
+
+#ifdef __gnu_linux__
+/* sizes fd, maps it and initializes header and ring */
+static void *shm_map_new(int fd, h_ringbuff_shm_kind_t kind, uint64_t size_el,
+                         uint64_t num_el)
+{
+        size_t ring_size = shm_ring_size(kind, size_el, num_el);
+        size_t map_size  = H_RINGBUFF_SHM_HDR + ring_size;
+
+        if (!ring_size || ftruncate(fd, (off_t)map_size) < 0) {
+                return NULL;
+        }
+
+        char *base =
+            mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+
+        h_ringbuff_shm_t *hdr = (h_ringbuff_shm_t *)base;
+        hdr->kind             = kind;
+        hdr->map_size         = map_size;
+        h_ringbuff_wait_init(&hdr->wait, 0, false);
+
+        shm_ring_init(base + H_RINGBUFF_SHM_HDR, kind, size_el, num_el);
+
+        /* publish the ring, attach fails until the magic is present */
+        x_atomic_store64(&hdr->magic, H_RINGBUFF_SHM_MAGIC);
+
+        return base + H_RINGBUFF_SHM_HDR;
+}
+
+
+static void *shm_map_existing(int fd, h_ringbuff_shm_kind_t kind)
+{
+        struct stat st;
+
+        if (fstat(fd, &st) < 0 || st.st_size < H_RINGBUFF_SHM_HDR) {
+                return NULL;
+        }
+
+        char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+
+        h_ringbuff_shm_t *hdr = (h_ringbuff_shm_t *)base;
+        if (x_atomic_load64(&hdr->magic) != H_RINGBUFF_SHM_MAGIC ||
+            hdr->kind != (uint64_t)kind ||
+            hdr->map_size != (uint64_t)st.st_size) {
+                munmap(base, st.st_size);
+                return NULL;
+        }
+
+        return base + H_RINGBUFF_SHM_HDR;
+}
+#endif
+
+
+void *h_ringbuff_shm_create(const char *name, h_ringbuff_shm_kind_t kind,
+                            uint64_t size_el, uint64_t num_el)
+{
+#ifdef __gnu_linux__
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+                return NULL;
+        }
+
+        void *ring = shm_map_new(fd, kind, size_el, num_el);
+        close(fd);
+        if (!ring) {
+                shm_unlink(name);
+        }
+
+        return ring;
+#else
+        (void)name, (void)kind, (void)size_el, (void)num_el;
+        return NULL;
+#endif
+}
+
+
+void *h_ringbuff_shm_attach(const char *name, h_ringbuff_shm_kind_t kind)
+{
+#ifdef __gnu_linux__
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+                return NULL;
+        }
+
+        void *ring = shm_map_existing(fd, kind);
+        close(fd);
+
+        return ring;
+#else
+        (void)name, (void)kind;
+        return NULL;
+#endif
+}
+
+
+void *h_ringbuff_shm_create_fd(int *fd, h_ringbuff_shm_kind_t kind,
+                               uint64_t size_el, uint64_t num_el)
+{
+#ifdef __gnu_linux__
+        *fd = memfd_create("h_ringbuff_shm", 0);
+        if (*fd < 0) {
+                return NULL;
+        }
+
+        void *ring = shm_map_new(*fd, kind, size_el, num_el);
+        if (!ring) {
+                close(*fd);
+                *fd = -1;
+        }
+
+        return ring;
+#else
+        (void)kind, (void)size_el, (void)num_el;
+        *fd = -1;
+        return NULL;
+#endif
+}
+
+
+void *h_ringbuff_shm_attach_fd(int fd, h_ringbuff_shm_kind_t kind)
+{
+#ifdef __gnu_linux__
+        return shm_map_existing(fd, kind);
+#else
+        (void)fd, (void)kind;
+        return NULL;
+#endif
+}
+
+
+void h_ringbuff_shm_detach(void *buffer)
+{
+#ifdef __gnu_linux__
+        if (!buffer) {
+                return;
+        }
+
+        h_ringbuff_shm_t *hdr = shm_hdr(buffer);
+        munmap(hdr, hdr->map_size);
+#else
+        (void)buffer;
+#endif
+}
+
+
+int h_ringbuff_shm_unlink(const char *name)
+{
+#ifdef __gnu_linux__
+        return shm_unlink(name);
+#else
+        (void)name;
+        return -1;
+#endif
+}
+
+
+h_ringbuff_wait_t *h_ringbuff_shm_wait(void *buffer)
+{
+        return &shm_hdr(buffer)->wait;
+}
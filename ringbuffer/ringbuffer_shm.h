@@ -0,0 +1,80 @@
+#ifndef HELPERS_RINGBUFFER_SHM_H
+#define HELPERS_RINGBUFFER_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+#include "ringbuffer_wait.h"
+
+/* Ringbuffers in shared memory, for queues between processes.
+ *
+ * All ring variants store offsets only, so they work at any mapping
+ * address. The shared object starts with an h_ringbuff_shm_t, followed by
+ * the ring at H_RINGBUFF_SHM_HDR. The pointer returned by create/attach
+ * is the ring itself and is passed to the functions of the chosen variant:
+ *   H_RINGBUFF_SHM_FIXED  h_ringbuff_*       (spsc)
+ *   H_RINGBUFF_SHM_SPSC   h_ringbuff_spsc_*
+ *   H_RINGBUFF_SHM_MPMC   h_ringbuff_mpmc_*  (also for mpsc)
+ *   H_RINGBUFF_SHM_VAR    h_ringbuff_var_*   (size_el * num_el bytes)
+ *
+ * The header contains a wait object for blocking across processes, its
+ * eventfd is not used since descriptors are per process. Linux only. */
+
+#define H_RINGBUFF_SHM_HDR 128
+
+typedef enum h_ringbuff_shm_kind {
+        H_RINGBUFF_SHM_FIXED = 1,
+        H_RINGBUFF_SHM_SPSC,
+        H_RINGBUFF_SHM_MPMC,
+        H_RINGBUFF_SHM_VAR
+} h_ringbuff_shm_kind_t;
+
+typedef struct h_ringbuff_shm {
+        uint64_t magic; /* written last by the creator */
+        uint64_t kind;
+        uint64_t map_size;
+        h_ringbuff_wait_t wait;
+} h_ringbuff_shm_t;
+
+
+/*! @brief creates a named shared memory object (shm_open) holding a ring
+ *  @param name     shared memory name, "/name"
+ *  @param kind     ring variant
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements
+ *  @return         pointer to the initialized ring or NULL
+ */
+void *h_ringbuff_shm_create(const char *name, h_ringbuff_shm_kind_t kind,
+                            uint64_t size_el, uint64_t num_el);
+
+/*! @brief maps the ring of a named shared memory object
+ *  @param name  shared memory name
+ *  @param kind  expected ring variant
+ *  @return      pointer to the ring or NULL if missing or not yet created
+ */
+void *h_ringbuff_shm_attach(const char *name, h_ringbuff_shm_kind_t kind);
+
+/*! @brief creates an anonymous ring in a memfd, to be passed to children or
+ *         via SCM_RIGHTS
+ *  @param fd  receives the file descriptor, close it when no longer needed
+ *  @return    pointer to the initialized ring or NULL
+ */
+void *h_ringbuff_shm_create_fd(int *fd, h_ringbuff_shm_kind_t kind,
+                               uint64_t size_el, uint64_t num_el);
+
+/*! @brief maps the ring of a descriptor from h_ringbuff_shm_create_fd */
+void *h_ringbuff_shm_attach_fd(int fd, h_ringbuff_shm_kind_t kind);
+
+/*! @brief unmaps a ring obtained from create or attach
+ *  @param buffer  pointer to the ring
+ */
+void h_ringbuff_shm_detach(void *buffer);
+
+/*! @brief removes the name of a shared memory object, mappings stay valid */
+int h_ringbuff_shm_unlink(const char *name);
+
+/*! @brief returns the wait object shared by all users of the ring */
+h_ringbuff_wait_t *h_ringbuff_shm_wait(void *buffer);
+
+#endif
@@ -0,0 +1,154 @@
+#include "ringbuffer_spsc.h"
+
+#include <string.h>
+
+#include "../threads/x-atomic.h"
+
+
+static inline void *spsc_slot(h_ringbuff_spsc_t *rbh, uint64_t idx)
+{
+        return (char *)rbh + rbh->header_size +
+               (idx & rbh->mask) * rbh->size_el;
+}
+
+
+size_t h_ringbuff_spsc_alloc_size(uint64_t size_el, uint64_t num_el)
+{
+        return sizeof(h_ringbuff_spsc_t) +
+               size_el * h_ringbuff_round_pow2(num_el);
+}
+
+
+void h_ringbuff_spsc_size_init(h_ringbuff_spsc_t *rbh, uint64_t size_el,
+                               uint64_t num_el)
+{
+        rbh->header_size = sizeof(h_ringbuff_spsc_t);
+        rbh->mask        = h_ringbuff_round_pow2(num_el) - 1;
+        rbh->size_el     = size_el;
+}
+
+
+void *h_ringbuff_spsc_alloc(uint64_t size_el, uint64_t num_el)
+{
+        void *buff = h_ringbuff_mem_alloc(
+            H_RINGBUFF_CACHE_LINE, h_ringbuff_spsc_alloc_size(size_el, num_el));
+
+        if (!buff) {
+                return buff;
+        }
+
+        h_ringbuff_spsc_size_init((h_ringbuff_spsc_t *)buff, size_el, num_el);
+
+        return buff;
+}
+
+
+void h_ringbuff_spsc_free(void *buffer)
+{
+        h_ringbuff_mem_free(buffer);
+}
+
+
+void h_ringbuff_spsc_init(void *buffer)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        if (!rbh) {
+                return;
+        }
+
+        rbh->w       = 0;
+        rbh->r_cache = 0;
+        rbh->r       = 0;
+        rbh->w_cache = 0;
+}
+
+
+uint64_t h_ringbuff_spsc_push(void *buffer, const void *data)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        uint64_t w = rbh->w;
+
+        if (w - rbh->r_cache > rbh->mask) {
+                /* looks full, refresh the consumer position */
+                rbh->r_cache = x_atomic_load64(&rbh->r);
+                if (w - rbh->r_cache > rbh->mask) {
+                        return 1;
+                }
+        }
+
+        memcpy(spsc_slot(rbh, w), data, rbh->size_el);
+
+        x_atomic_store64(&rbh->w, w + 1);
+
+        return 0;
+}
+
+
+void *h_ringbuff_spsc_read(void *buffer)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        uint64_t r = rbh->r;
+
+        if (r == rbh->w_cache) {
+                /* looks empty, refresh the producer position */
+                rbh->w_cache = x_atomic_load64(&rbh->w);
+                if (r == rbh->w_cache) {
+                        return NULL;
+                }
+        }
+
+        return spsc_slot(rbh, r);
+}
+
+
+int h_ringbuff_spsc_pop(void *buffer)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        uint64_t r = rbh->r;
+
+        if (r == rbh->w_cache) {
+                rbh->w_cache = x_atomic_load64(&rbh->w);
+                if (r == rbh->w_cache) {
+                        return RINGBUFF_EMPTY;
+                }
+        }
+
+        x_atomic_store64(&rbh->r, r + 1);
+
+        return RINGBUFF_OK;
+}
+
+
+uint64_t h_ringbuff_spsc_count(void *buffer)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        uint64_t cur_r = x_atomic_load64(&rbh->r);
+        uint64_t cur_w = x_atomic_load64(&rbh->w);
+
+        return cur_w - cur_r;
+}
+
+
+uint64_t h_ringbuff_spsc_avail(void *buffer)
+{
+        h_ringbuff_spsc_t *rbh = (h_ringbuff_spsc_t *)buffer;
+
+        return rbh->mask + 1 - h_ringbuff_spsc_count(buffer);
+}
+
+
+bool h_ringbuff_spsc_is_empty(void *buffer)
+{
+        return h_ringbuff_spsc_count(buffer) == 0;
+}
+
+
+bool h_ringbuff_spsc_is_full(void *buffer)
+{
+        return h_ringbuff_spsc_avail(buffer) == 0;
+}
@@ -0,0 +1,92 @@
+#ifndef HELPERS_RINGBUFFER_SPSC_H
+#define HELPERS_RINGBUFFER_SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+/* Single producer / single consumer ringbuffer.
+ *
+ * w and r are free running element counters, the slot is found by masking
+ * them with the power of two element count. Producer and consumer state live
+ * on separate cache lines, each side additionally keeps a cached copy of the
+ * other side's counter, so the shared line is only touched when the cached
+ * value says the buffer is full or empty. The buffer must be aligned to
+ * H_RINGBUFF_CACHE_LINE, which h_ringbuff_spsc_alloc takes care of. */
+typedef struct h_ringbuff_spsc {
+        /* read-only after init */
+        uint64_t header_size;
+        uint64_t mask;
+        uint64_t size_el;
+        uint8_t pad0[H_RINGBUFF_CACHE_LINE - 3 * sizeof(uint64_t)];
+        /* written by the producer */
+        uint64_t w;
+        uint64_t r_cache;
+        uint8_t pad1[H_RINGBUFF_CACHE_LINE - 2 * sizeof(uint64_t)];
+        /* written by the consumer */
+        uint64_t r;
+        uint64_t w_cache;
+        uint8_t pad2[H_RINGBUFF_CACHE_LINE - 2 * sizeof(uint64_t)];
+} h_ringbuff_spsc_t;
+
+
+/*! @brief returns the number of bytes needed for a spsc ringbuffer
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ *  @return         size in bytes including the header
+ */
+size_t h_ringbuff_spsc_alloc_size(uint64_t size_el, uint64_t num_el);
+
+/*! @brief sets up element size and count of a spsc ringbuffer header, for
+ *         buffers that are not allocated with h_ringbuff_spsc_alloc
+ *  @param rbh      pointer to memory of h_ringbuff_spsc_alloc_size bytes
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ */
+void h_ringbuff_spsc_size_init(h_ringbuff_spsc_t *rbh, uint64_t size_el,
+                               uint64_t num_el);
+
+/*! @brief allocates cache line aligned memory for a spsc ringbuffer
+ *  @param size_el  size in bytes of the ringbuffer elements
+ *  @param num_el   max number of elements, rounded up to a power of 2
+ *  @return         pointer to allocated ringbuffer
+ */
+void *h_ringbuff_spsc_alloc(uint64_t size_el, uint64_t num_el);
+
+/*! @brief frees a ringbuffer allocated with h_ringbuff_spsc_alloc
+ *  @param buffer  pointer to the ringbuffer
+ */
+void h_ringbuff_spsc_free(void *buffer);
+
+/*! @brief initializes (empties) a previously allocated spsc ringbuffer
+ *  @param buffer  pointer to an allocated buffer
+ */
+void h_ringbuff_spsc_init(void *buffer);
+
+/*! @brief copies one element into the buffer, producer side only
+ *  @param buffer  pointer to the ringbuffer
+ *  @param data    element of size_el bytes
+ *  @return        0 on success, 1 if the buffer is full
+ */
+uint64_t h_ringbuff_spsc_push(void *buffer, const void *data);
+
+/*! @brief returns the oldest element without removing it, consumer side only
+ *  @param buffer  pointer to the ringbuffer
+ *  @return        pointer to the element or NULL if the buffer is empty
+ */
+void *h_ringbuff_spsc_read(void *buffer);
+
+/*! @brief removes the oldest element, consumer side only
+ *  @param buffer  pointer to the ringbuffer
+ *  @return        RINGBUFF_OK or RINGBUFF_EMPTY
+ */
+int h_ringbuff_spsc_pop(void *buffer);
+
+uint64_t h_ringbuff_spsc_count(void *buffer);
+uint64_t h_ringbuff_spsc_avail(void *buffer);
+bool h_ringbuff_spsc_is_empty(void *buffer);
+bool h_ringbuff_spsc_is_full(void *buffer);
+
+#endif
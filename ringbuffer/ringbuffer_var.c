@@ -0,0 +1,208 @@
+#include "ringbuffer_var.h"
+
+#include <string.h>
+
+#include "../threads/x-atomic.h"
+
+
+/* data size of a ring, at least one record header */
+static uint64_t var_data_size(uint64_t size)
+{
+        return h_ringbuff_round_pow2(size > H_RINGBUFF_VAR_ALIGN
+                                         ? size
+                                         : H_RINGBUFF_VAR_ALIGN);
+}
+
+
+static inline uint64_t var_rec_size(uint32_t len)
+{
+        return (sizeof(h_ringbuff_var_rec_t) + (uint64_t)len +
+                H_RINGBUFF_VAR_ALIGN - 1) &
+               ~(uint64_t)(H_RINGBUFF_VAR_ALIGN - 1);
+}
+
+
+static inline h_ringbuff_var_rec_t *var_rec(h_ringbuff_var_t *rbh,
+                                            uint64_t pos)
+{
+        return (h_ringbuff_var_rec_t *)((char *)rbh + rbh->header_size +
+                                        (pos & rbh->mask));
+}
+
+
+size_t h_ringbuff_var_alloc_size(uint64_t size)
+{
+        return sizeof(h_ringbuff_var_t) + var_data_size(size);
+}
+
+
+void h_ringbuff_var_size_init(h_ringbuff_var_t *rbh, uint64_t size)
+{
+        rbh->header_size = sizeof(h_ringbuff_var_t);
+        rbh->mask        = var_data_size(size) - 1;
+}
+
+
+void *h_ringbuff_var_alloc(uint64_t size)
+{
+        void *buff = h_ringbuff_mem_alloc(H_RINGBUFF_CACHE_LINE,
+                                          h_ringbuff_var_alloc_size(size));
+
+        if (!buff) {
+                return buff;
+        }
+
+        h_ringbuff_var_size_init((h_ringbuff_var_t *)buff, size);
+
+        return buff;
+}
+
+
+void h_ringbuff_var_free(void *buffer)
+{
+        h_ringbuff_mem_free(buffer);
+}
+
+
+void h_ringbuff_var_init(void *buffer)
+{
+        h_ringbuff_var_t *rbh = (h_ringbuff_var_t *)buffer;
+
+        if (!rbh) {
+                return;
+        }
+
+        rbh->w       = 0;
+        rbh->r_cache = 0;
+        rbh->w_rec   = 0;
+        rbh->r       = 0;
+        rbh->w_cache = 0;
+}
+
+
+void *h_ringbuff_var_reserve(void *buffer, uint32_t len)
+{
+        h_ringbuff_var_t *rbh = (h_ringbuff_var_t *)buffer;
+
+        uint64_t size = rbh->mask + 1;
+        uint64_t need = var_rec_size(len);
+        uint64_t w    = rbh->w;
+        uint64_t tail = size - (w & rbh->mask);
+        uint64_t skip = need > tail ? tail : 0;
+
+        if (need > size) {
+                return NULL;
+        }
+
+        if (w + skip + need - rbh->r_cache > size) {
+                rbh->r_cache = x_atomic_load64(&rbh->r);
+                if (w + skip + need - rbh->r_cache > size) {
+                        return NULL;
+                }
+        }
+
+        if (skip) {
+                /* the consumer jumps to the start of the ring */
+                var_rec(rbh, w)->len = H_RINGBUFF_VAR_PAD;
+        }
+
+        rbh->w_rec = w + skip;
+
+        return var_rec(rbh, rbh->w_rec) + 1;
+}
+
+
+void h_ringbuff_var_commit(void *buffer, uint32_t len)
+{
+        h_ringbuff_var_t *rbh = (h_ringbuff_var_t *)buffer;
+
+        var_rec(rbh, rbh->w_rec)->len = len;
+
+        x_atomic_store64(&rbh->w, rbh->w_rec + var_rec_size(len));
+}
+
+
+uint64_t h_ringbuff_var_push(void *buffer, const void *data, uint32_t len)
+{
+        void *payload = h_ringbuff_var_reserve(buffer, len);
+
+        if (!payload) {
+                return 1;
+        }
+
+        memcpy(payload, data, len);
+        h_ringbuff_var_commit(buffer, len);
+
+        return 0;
+}
+
+
+/* returns the oldest record, skipping a padding marker */
+static h_ringbuff_var_rec_t *var_head(h_ringbuff_var_t *rbh)
+{
+        uint64_t r = rbh->r;
+
+        if (r == rbh->w_cache) {
+                rbh->w_cache = x_atomic_load64(&rbh->w);
+                if (r == rbh->w_cache) {
+                        return NULL;
+                }
+        }
+
+        h_ringbuff_var_rec_t *rec = var_rec(rbh, r);
+
+        if (rec->len == H_RINGBUFF_VAR_PAD) {
+                /* a padding marker is always followed by a record */
+                r += rbh->mask + 1 - (r & rbh->mask);
+                x_atomic_store64(&rbh->r, r);
+                rec = var_rec(rbh, r);
+        }
+
+        return rec;
+}
+
+
+void *h_ringbuff_var_read(void *buffer, uint32_t *len)
+{
+        h_ringbuff_var_rec_t *rec = var_head((h_ringbuff_var_t *)buffer);
+
+        if (!rec) {
+                return NULL;
+        }
+
+        *len = rec->len;
+
+        return rec + 1;
+}
+
+
+int h_ringbuff_var_pop(void *buffer)
+{
+        h_ringbuff_var_t *rbh     = (h_ringbuff_var_t *)buffer;
+        h_ringbuff_var_rec_t *rec = var_head(rbh);
+
+        if (!rec) {
+                return RINGBUFF_EMPTY;
+        }
+
+        x_atomic_store64(&rbh->r, rbh->r + var_rec_size(rec->len));
+
+        return RINGBUFF_OK;
+}
+
+
+uint64_t h_ringbuff_var_used(void *buffer)
+{
+        h_ringbuff_var_t *rbh = (h_ringbuff_var_t *)buffer;
+
+        uint64_t cur_r = x_atomic_load64(&rbh->r);
+        uint64_t cur_w = x_atomic_load64(&rbh->w);
+
+        return cur_w - cur_r;
+}
+
+
+bool h_ringbuff_var_is_empty(void *buffer)
+{
+        return h_ringbuff_var_used(buffer) == 0;
+}
@@ -0,0 +1,110 @@
+#ifndef HELPERS_RINGBUFFER_VAR_H
+#define HELPERS_RINGBUFFER_VAR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+/* Single producer / single consumer ringbuffer for variable length records.
+ *
+ * Every record starts with an h_ringbuff_var_rec_t and is padded to
+ * H_RINGBUFF_VAR_ALIGN bytes, so payloads are 8 byte aligned. A record never
+ * wraps: if it does not fit before the end of the ring, the rest of the ring
+ * is marked with H_RINGBUFF_VAR_PAD and the record starts at offset 0.
+ * Hence only records of up to half the ring size, header included, are sure
+ * to fit into an empty ring.
+ * w and r are free running byte counters, the ring size is a power of 2.
+ * Cache line layout is the same as for h_ringbuff_spsc_t. */
+
+#define H_RINGBUFF_VAR_ALIGN 8
+#define H_RINGBUFF_VAR_PAD   0xFFFFFFFFu
+
+typedef struct h_ringbuff_var_rec {
+        uint32_t len;
+        uint32_t reserved;
+} h_ringbuff_var_rec_t;
+
+typedef struct h_ringbuff_var {
+        /* read-only after init */
+        uint64_t header_size;
+        uint64_t mask;
+        uint8_t pad0[H_RINGBUFF_CACHE_LINE - 2 * sizeof(uint64_t)];
+        /* written by the producer */
+        uint64_t w;
+        uint64_t r_cache;
+        uint64_t w_rec; /* start of the reserved record */
+        uint8_t pad1[H_RINGBUFF_CACHE_LINE - 3 * sizeof(uint64_t)];
+        /* written by the consumer */
+        uint64_t r;
+        uint64_t w_cache;
+        uint8_t pad2[H_RINGBUFF_CACHE_LINE - 2 * sizeof(uint64_t)];
+} h_ringbuff_var_t;
+
+
+/*! @brief returns the number of bytes needed for a variable length ringbuffer
+ *  @param size  ring size in bytes, rounded up to a power of 2
+ *  @return      size in bytes including the header
+ */
+size_t h_ringbuff_var_alloc_size(uint64_t size);
+
+/*! @brief sets up the ring size of a header, for buffers that are not
+ *         allocated with h_ringbuff_var_alloc
+ *  @param rbh   pointer to memory of h_ringbuff_var_alloc_size bytes
+ *  @param size  ring size in bytes, rounded up to a power of 2
+ */
+void h_ringbuff_var_size_init(h_ringbuff_var_t *rbh, uint64_t size);
+
+/*! @brief allocates cache line aligned memory for a variable length
+ *         ringbuffer
+ *  @param size  ring size in bytes, rounded up to a power of 2
+ *  @return      pointer to allocated ringbuffer
+ */
+void *h_ringbuff_var_alloc(uint64_t size);
+
+/*! @brief frees a ringbuffer allocated with h_ringbuff_var_alloc
+ *  @param buffer  pointer to the ringbuffer
+ */
+void h_ringbuff_var_free(void *buffer);
+
+/*! @brief initializes (empties) a variable length ringbuffer
+ *  @param buffer  pointer to an allocated buffer
+ */
+void h_ringbuff_var_init(void *buffer);
+
+/*! @brief reserves space for a record of up to len bytes, producer side only
+ *  @param buffer  pointer to the ringbuffer
+ *  @param len     max payload length
+ *  @return        pointer to the payload or NULL if the buffer is full
+ */
+void *h_ringbuff_var_reserve(void *buffer, uint32_t len);
+
+/*! @brief publishes the reserved record
+ *  @param buffer  pointer to the ringbuffer
+ *  @param len     actual payload length, at most the reserved length
+ */
+void h_ringbuff_var_commit(void *buffer, uint32_t len);
+
+/*! @brief copies a record into the buffer, producer side only
+ *  @return        0 on success, 1 if the buffer is full
+ */
+uint64_t h_ringbuff_var_push(void *buffer, const void *data, uint32_t len);
+
+/*! @brief returns the oldest record without removing it, consumer side only
+ *  @param buffer  pointer to the ringbuffer
+ *  @param len     receives the payload length
+ *  @return        pointer to the payload or NULL if the buffer is empty
+ */
+void *h_ringbuff_var_read(void *buffer, uint32_t *len);
+
+/*! @brief removes the oldest record, consumer side only
+ *  @return        RINGBUFF_OK or RINGBUFF_EMPTY
+ */
+int h_ringbuff_var_pop(void *buffer);
+
+/* bytes in use, including record headers and padding */
+uint64_t h_ringbuff_var_used(void *buffer);
+bool h_ringbuff_var_is_empty(void *buffer);
+
+#endif
@@ -0,0 +1,192 @@
+#ifdef __gnu_linux__
+#        ifndef _GNU_SOURCE
+#                define _GNU_SOURCE
+#        endif
+#        include <sys/mman.h>
+#        include <unistd.h>
+#endif
+
+#include "ringbuffer_vm.h"
+
+#include <string.h>
+
+#include "../threads/x-atomic.h"
+
+
+static inline char *vm_data(h_ringbuff_vm_t *rbh, uint64_t pos)
+{
+        return (char *)rbh + rbh->header_size + (pos & rbh->mask);
+}
+
+
+void *h_ringbuff_vm_alloc(uint64_t size)
+{
+#ifdef __gnu_linux__
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t ring = page;
+
+        while (ring < size) {
+                ring <<= 1;
+        }
+
+        int fd = memfd_create("h_ringbuff_vm", MFD_CLOEXEC);
+        if (fd < 0) {
+                return NULL;
+        }
+        if (ftruncate(fd, (off_t)(page + ring))) {
+                close(fd);
+                return NULL;
+        }
+
+        /* reserve the address range, then map header + data and the data
+         * mirror over it */
+        char *base = mmap(NULL, page + 2 * ring, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+                close(fd);
+                return NULL;
+        }
+
+        if (mmap(base, page + ring, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(base + page + ring, ring, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, (off_t)page) == MAP_FAILED) {
+                munmap(base, page + 2 * ring);
+                close(fd);
+                return NULL;
+        }
+
+        /* the mappings keep the memory alive */
+        close(fd);
+
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)base;
+        rbh->header_size     = page;
+        rbh->mask            = ring - 1;
+
+        return base;
+#else
+        (void)size;
+        return NULL;
+#endif
+}
+
+
+void h_ringbuff_vm_free(void *buffer)
+{
+#ifdef __gnu_linux__
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        if (!rbh) {
+                return;
+        }
+
+        munmap(buffer, rbh->header_size + 2 * (rbh->mask + 1));
+#else
+        (void)buffer;
+#endif
+}
+
+
+void h_ringbuff_vm_init(void *buffer)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        if (!rbh) {
+                return;
+        }
+
+        rbh->w = 0;
+        rbh->r = 0;
+}
+
+
+uint64_t h_ringbuff_vm_size(void *buffer)
+{
+        return ((h_ringbuff_vm_t *)buffer)->mask + 1;
+}
+
+
+uint64_t h_ringbuff_vm_writable(void *buffer)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        return rbh->mask + 1 - (rbh->w - x_atomic_load64(&rbh->r));
+}
+
+
+uint64_t h_ringbuff_vm_readable(void *buffer)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        return x_atomic_load64(&rbh->w) - rbh->r;
+}
+
+
+void *h_ringbuff_vm_reserve(void *buffer, uint64_t size)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        if (!size || size > h_ringbuff_vm_writable(buffer)) {
+                return NULL;
+        }
+
+        return vm_data(rbh, rbh->w);
+}
+
+
+void h_ringbuff_vm_commit(void *buffer, uint64_t size)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        x_atomic_store64(&rbh->w, rbh->w + size);
+}
+
+
+void *h_ringbuff_vm_acquire(void *buffer, uint64_t size)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        if (!size || size > h_ringbuff_vm_readable(buffer)) {
+                return NULL;
+        }
+
+        return vm_data(rbh, rbh->r);
+}
+
+
+void h_ringbuff_vm_release(void *buffer, uint64_t size)
+{
+        h_ringbuff_vm_t *rbh = (h_ringbuff_vm_t *)buffer;
+
+        x_atomic_store64(&rbh->r, rbh->r + size);
+}
+
+
+uint64_t h_ringbuff_vm_push(void *buffer, const void *data, uint64_t size)
+{
+        void *dst = h_ringbuff_vm_reserve(buffer, size);
+
+        if (!dst) {
+                return 1;
+        }
+
+        memcpy(dst, data, size);
+        h_ringbuff_vm_commit(buffer, size);
+
+        return 0;
+}
+
+
+int h_ringbuff_vm_pop(void *buffer, void *data, uint64_t size)
+{
+        void *src = h_ringbuff_vm_acquire(buffer, size);
+
+        if (!src) {
+                return RINGBUFF_EMPTY;
+        }
+
+        memcpy(data, src, size);
+        h_ringbuff_vm_release(buffer, size);
+
+        return RINGBUFF_OK;
+}
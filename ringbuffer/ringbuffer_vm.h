@@ -0,0 +1,95 @@
+#ifndef HELPERS_RINGBUFFER_VM_H
+#define HELPERS_RINGBUFFER_VM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+/* Double mapped ("magic") single producer / single consumer byte ring.
+ *
+ * The data pages are mapped twice, back to back, directly after a header
+ * page. Every byte at ring offset x is also visible at x + size, so any
+ * span of up to size bytes starting inside the ring is contiguous in memory,
+ * whatever the wrap. Writers and readers work with one memcpy, and ring data
+ * can be passed to send()/writev() directly.
+ *
+ * w and r are free running byte counters, the size is a power of 2 and a
+ * multiple of the page size. Only available on Linux (memfd). */
+
+typedef struct h_ringbuff_vm {
+        /* read-only after init */
+        uint64_t header_size; /* one page, data starts here */
+        uint64_t mask;
+        uint8_t pad0[H_RINGBUFF_CACHE_LINE - 2 * sizeof(uint64_t)];
+        /* written by the producer */
+        uint64_t w;
+        uint8_t pad1[H_RINGBUFF_CACHE_LINE - sizeof(uint64_t)];
+        /* written by the consumer */
+        uint64_t r;
+        uint8_t pad2[H_RINGBUFF_CACHE_LINE - sizeof(uint64_t)];
+} h_ringbuff_vm_t;
+
+
+/*! @brief maps a double mapped ringbuffer
+ *  @param size  ring size in bytes, rounded up to a power of 2 of at least
+ *               one page
+ *  @return      pointer to the ringbuffer header or NULL
+ */
+void *h_ringbuff_vm_alloc(uint64_t size);
+
+/*! @brief unmaps a ringbuffer created with h_ringbuff_vm_alloc
+ *  @param buffer  pointer to the ringbuffer
+ */
+void h_ringbuff_vm_free(void *buffer);
+
+/*! @brief initializes (empties) a double mapped ringbuffer
+ *  @param buffer  pointer to the ringbuffer
+ */
+void h_ringbuff_vm_init(void *buffer);
+
+/*! @brief returns the ring size in bytes */
+uint64_t h_ringbuff_vm_size(void *buffer);
+
+/*! @brief number of bytes that can be written, producer side */
+uint64_t h_ringbuff_vm_writable(void *buffer);
+
+/*! @brief number of bytes that can be read, consumer side */
+uint64_t h_ringbuff_vm_readable(void *buffer);
+
+/*! @brief returns a contiguous span of size free bytes
+ *  @param buffer  pointer to the ringbuffer
+ *  @param size    bytes to reserve
+ *  @return        pointer to write to or NULL if less than size bytes are
+ *                 free or size is 0
+ */
+void *h_ringbuff_vm_reserve(void *buffer, uint64_t size);
+
+/*! @brief publishes size bytes written to the reserved span */
+void h_ringbuff_vm_commit(void *buffer, uint64_t size);
+
+/*! @brief returns a contiguous span of size readable bytes
+ *  @param buffer  pointer to the ringbuffer
+ *  @param size    bytes to read
+ *  @return        pointer to the data or NULL if less than size bytes are
+ *                 available or size is 0
+ */
+void *h_ringbuff_vm_acquire(void *buffer, uint64_t size);
+
+/*! @brief releases size bytes obtained with h_ringbuff_vm_acquire */
+void h_ringbuff_vm_release(void *buffer, uint64_t size);
+
+/*! @brief copies size bytes into the ring
+ *  @return        0 on success, 1 if there is not enough space or size
+ *                 is 0
+ */
+uint64_t h_ringbuff_vm_push(void *buffer, const void *data, uint64_t size);
+
+/*! @brief copies size bytes out of the ring
+ *  @return        RINGBUFF_OK or RINGBUFF_EMPTY if less than size bytes are
+ *                 available or size is 0
+ */
+int h_ringbuff_vm_pop(void *buffer, void *data, uint64_t size);
+
+#endif
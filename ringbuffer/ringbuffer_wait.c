@@ -0,0 +1,207 @@
+#if !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE)
+#        define _DEFAULT_SOURCE /* clock_gettime, syscall */
+#endif
+
+#include "ringbuffer_wait.h"
+
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#ifdef _WIN32
+#        include <windows.h>
+#endif
+#ifdef __gnu_linux__
+#        include <unistd.h>
+#        include <linux/futex.h>
+#        include <sys/eventfd.h>
+#        include <sys/syscall.h>
+#endif
+
+#include "../threads/x-atomic.h"
+#include "../threads/x-threads.h"
+
+
+static uint64_t wait_now_ms(void)
+{
+#ifdef _WIN32
+        return GetTickCount64();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+
+#ifdef __gnu_linux__
+static void wait_futex(uint32_t *addr, uint32_t val, int timeout_ms)
+{
+        struct timespec ts;
+        struct timespec *pts = NULL;
+
+        if (timeout_ms >= 0) {
+                ts.tv_sec  = timeout_ms / 1000;
+                ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+                pts        = &ts;
+        }
+
+        /* not FUTEX_PRIVATE, the wait object may live in shared memory */
+        syscall(SYS_futex, addr, FUTEX_WAIT, val, pts, NULL, 0);
+}
+
+
+static void wake_futex(uint32_t *addr)
+{
+        syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+
+int h_ringbuff_wait_init(h_ringbuff_wait_t *w, uint32_t spin, bool use_eventfd)
+{
+        memset(w, 0, sizeof(h_ringbuff_wait_t));
+        w->spin = spin ? spin : H_RINGBUFF_WAIT_SPIN;
+        w->efd  = -1;
+
+        if (use_eventfd) {
+#ifdef __gnu_linux__
+                w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+                if (w->efd < 0) {
+                        return -1;
+                }
+        }
+
+        return 0;
+}
+
+
+void h_ringbuff_wait_destroy(h_ringbuff_wait_t *w)
+{
+#ifdef __gnu_linux__
+        if (w->efd >= 0) {
+                close(w->efd);
+        }
+#endif
+        w->efd = -1;
+}
+
+
+int h_ringbuff_wait(h_ringbuff_wait_t *w, h_ringbuff_cond_t cond,
+                    void *buffer, int timeout_ms)
+{
+        for (uint32_t i = 0; i < w->spin; i++) {
+                if (cond(buffer)) {
+                        return RINGBUFF_OK;
+                }
+                x_cpu_relax();
+        }
+
+        uint64_t deadline = wait_now_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+
+#ifdef __gnu_linux__
+        while (1) {
+                /* read seq before registering: a notify after our check of
+                 * cond changes seq and makes the futex wait return at once */
+                uint32_t seq = x_atomic_load32(&w->seq);
+                x_atomic_fetch_add64(&w->waiters, 1);
+                x_atomic_fence();
+
+                if (cond(buffer)) {
+                        x_atomic_fetch_sub64(&w->waiters, 1);
+                        return RINGBUFF_OK;
+                }
+
+                int left = -1;
+                if (timeout_ms >= 0) {
+                        uint64_t now = wait_now_ms();
+                        left = now < deadline ? (int)(deadline - now) : 0;
+                }
+                if (left) {
+                        wait_futex(&w->seq, seq, left);
+                }
+                x_atomic_fetch_sub64(&w->waiters, 1);
+
+                if (cond(buffer)) {
+                        return RINGBUFF_OK;
+                }
+                if (!left) {
+                        return RINGBUFF_TIMEOUT;
+                }
+        }
+#else
+        while (!cond(buffer)) {
+                if (timeout_ms >= 0 && wait_now_ms() >= deadline) {
+                        return RINGBUFF_TIMEOUT;
+                }
+#        ifdef X_THREAD_SUPPORT
+                x_thread_yield();
+#        endif
+        }
+        return RINGBUFF_OK;
+#endif
+}
+
+
+static bool wait_not_empty(void *buffer)
+{
+        return !h_ringbuff_is_empty(buffer);
+}
+
+
+int h_ringbuff_wait_readable(h_ringbuff_wait_t *w, void *buffer,
+                             int timeout_ms)
+{
+        return h_ringbuff_wait(w, wait_not_empty, buffer, timeout_ms);
+}
+
+
+void h_ringbuff_notify(h_ringbuff_wait_t *w)
+{
+        /* orders the caller's index store before the waiters check, pairs
+         * with the fence in h_ringbuff_wait */
+        x_atomic_fence();
+
+        if (!x_atomic_load64(&w->waiters)) {
+                return;
+        }
+
+        x_atomic_fetch_add32(&w->seq, 1);
+#ifdef __gnu_linux__
+        wake_futex(&w->seq);
+
+        if (w->efd >= 0) {
+                uint64_t one = 1;
+                ssize_t res  = write(w->efd, &one, sizeof(one));
+                (void)res;
+        }
+#endif
+}
+
+
+int h_ringbuff_wait_fd(h_ringbuff_wait_t *w)
+{
+        return w->efd;
+}
+
+
+void h_ringbuff_wait_prepare(h_ringbuff_wait_t *w)
+{
+        x_atomic_fetch_add64(&w->waiters, 1);
+        x_atomic_fence();
+}
+
+
+void h_ringbuff_wait_finish(h_ringbuff_wait_t *w)
+{
+        x_atomic_fetch_sub64(&w->waiters, 1);
+
+#ifdef __gnu_linux__
+        if (w->efd >= 0) {
+                uint64_t cnt;
+                ssize_t res = read(w->efd, &cnt, sizeof(cnt));
+                (void)res;
+        }
+#endif
+}
@@ -0,0 +1,79 @@
+#ifndef HELPERS_RINGBUFFER_WAIT_H
+#define HELPERS_RINGBUFFER_WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ringbuffer.h"
+
+/* Wait strategy for ringbuffer consumers (or producers waiting for space).
+ *
+ * A waiter spins for a bounded number of rounds, then registers itself in
+ * waiters and sleeps on the seq futex. The other side calls
+ * h_ringbuff_notify after every push (or pop), which only costs a load as
+ * long as nobody sleeps. With use_eventfd, notify also signals an eventfd
+ * that can be added to an epoll loop.
+ *
+ * The structure holds no pointers and uses shared futexes, so it may be
+ * placed in shared memory next to the ring. Without futex support (non
+ * Linux) sleeping falls back to yielding. */
+
+#define H_RINGBUFF_WAIT_SPIN 1000
+
+typedef struct h_ringbuff_wait {
+        uint32_t seq;
+        uint32_t spin;
+        uint64_t waiters;
+        int efd;
+} h_ringbuff_wait_t;
+
+/* condition to wait for, e.g. "buffer is not empty" */
+typedef bool (*h_ringbuff_cond_t)(void *buffer);
+
+
+/*! @brief initializes a wait object
+ *  @param w            wait object
+ *  @param spin         rounds to spin before sleeping, 0 for default
+ *  @param use_eventfd  also create an eventfd, see h_ringbuff_wait_fd
+ *  @return             0 on success, -1 if the eventfd could not be created
+ */
+int h_ringbuff_wait_init(h_ringbuff_wait_t *w, uint32_t spin, bool use_eventfd);
+
+/*! @brief closes the eventfd of a wait object */
+void h_ringbuff_wait_destroy(h_ringbuff_wait_t *w);
+
+/*! @brief waits until cond(buffer) is true
+ *  @param w           wait object
+ *  @param cond        condition, evaluated after every wakeup
+ *  @param buffer      passed to cond
+ *  @param timeout_ms  timeout in milliseconds, negative waits forever
+ *  @return            RINGBUFF_OK or RINGBUFF_TIMEOUT
+ */
+int h_ringbuff_wait(h_ringbuff_wait_t *w, h_ringbuff_cond_t cond,
+                    void *buffer, int timeout_ms);
+
+/*! @brief waits until a h_ringbuff ringbuffer is not empty */
+int h_ringbuff_wait_readable(h_ringbuff_wait_t *w, void *buffer,
+                             int timeout_ms);
+
+/*! @brief wakes all sleeping waiters, cheap if there are none
+ *  @param w  wait object
+ */
+void h_ringbuff_notify(h_ringbuff_wait_t *w);
+
+/*! @brief returns the eventfd for poll/epoll or -1
+ *
+ * Usage in an event loop:
+ *   h_ringbuff_wait_prepare(w);
+ *   if (!h_ringbuff_is_empty(buffer)) -> h_ringbuff_wait_finish, consume
+ *   else epoll_wait(), then h_ringbuff_wait_finish(w)
+ */
+int h_ringbuff_wait_fd(h_ringbuff_wait_t *w);
+
+/*! @brief registers the caller as waiter, so producers signal the eventfd */
+void h_ringbuff_wait_prepare(h_ringbuff_wait_t *w);
+
+/*! @brief unregisters the caller and clears the eventfd */
+void h_ringbuff_wait_finish(h_ringbuff_wait_t *w);
+
+#endif
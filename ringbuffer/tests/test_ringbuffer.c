@@ -4,10 +4,27 @@
 #        endif
 #endif
 
+#ifdef __gnu_linux__
+#        define _GNU_SOURCE
+#        include <sched.h>
+#        include <unistd.h>
+#        include <poll.h>
+#        include <sys/wait.h>
+#endif
+
 #include <criterion/criterion.h>
+#include <time.h>
 
 #include "../ringbuffer.h"
+#include "../ringbuffer_spsc.h"
+#include "../ringbuffer_mpmc.h"
+#include "../ringbuffer_var.h"
+#include "../ringbuffer_wait.h"
+#include "../ringbuffer_vm.h"
+#include "../ringbuffer_shm.h"
 #include "../../threads/x-threads.h"
+#include "../../threads/x-atomic.h"
+#include "../../mutex/xmutex.h"
 
 
 Test(HELPERS_RINGBUFFER, ringbuffer_dynamic_malloc_free)
@@ -143,6 +160,190 @@ Test(HELPERS_RINGBUFFER, ringbuffer_checkdata)
 }
 
 
+Test(HELPERS_RINGBUFFER, ringbuffer_push_pop_n)
+{
+        const uint32_t nr_elems = 16;
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), nr_elems, 0);
+        h_ringbuff_init(buffer);
+
+        uint32_t in[24], out[24];
+        uint32_t next_in = 0, next_out = 0;
+
+        /* batches of 5 walk the ring across its end several times */
+        for (int k = 0; k < 20; k++) {
+                for (int i = 0; i < 5; i++) {
+                        in[i] = next_in + i;
+                }
+                cr_assert_eq(h_ringbuff_push_n(buffer, in, 5), 5);
+                next_in += 5;
+
+                cr_assert_eq(h_ringbuff_pop_n(buffer, out, 5), 5);
+                for (int i = 0; i < 5; i++) {
+                        cr_assert_eq(out[i], next_out++);
+                }
+        }
+
+        /* partial batches when full or empty */
+        for (int i = 0; i < 24; i++) {
+                in[i] = next_in + i;
+        }
+        cr_expect(h_ringbuff_push_n(buffer, in, 24) == nr_elems);
+        cr_expect(h_ringbuff_is_full(buffer));
+        cr_expect(h_ringbuff_push_n(buffer, in, 1) == 0);
+        cr_expect(h_ringbuff_pop_n(buffer, NULL, 3) == 3);
+        next_out += 3;
+        cr_expect(h_ringbuff_pop_n(buffer, out, 24) == nr_elems - 3);
+        for (uint32_t i = 0; i < nr_elems - 3; i++) {
+                cr_assert_eq(out[i], next_out + i);
+        }
+        cr_expect(h_ringbuff_is_empty(buffer));
+        cr_expect(h_ringbuff_pop_n(buffer, out, 1) == 0);
+
+        h_ringbuff_free(buffer);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_peek)
+{
+        const uint32_t nr_elems = 8;
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), nr_elems, 0);
+        h_ringbuff_init(buffer);
+
+        uint32_t in[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+        uint64_t n;
+
+        cr_expect(h_ringbuff_peek(buffer, &n) == NULL);
+        cr_expect(n == 0);
+
+        /* 9 slots: move the read pointer to slot 6 */
+        cr_assert_eq(h_ringbuff_push_n(buffer, in, 6), 6);
+        cr_assert_eq(h_ringbuff_pop_n(buffer, NULL, 6), 6);
+
+        /* 5 elements, 3 before the end of the ring, 2 after */
+        cr_assert_eq(h_ringbuff_push_n(buffer, in, 5), 5);
+
+        uint32_t *span = h_ringbuff_peek(buffer, &n);
+        cr_assert_not_null(span);
+        cr_assert_eq(n, 3);
+        cr_expect(span[0] == 0 && span[2] == 2);
+        h_ringbuff_pop(buffer, n * sizeof(uint32_t));
+
+        span = h_ringbuff_peek(buffer, &n);
+        cr_assert_not_null(span);
+        cr_assert_eq(n, 2);
+        cr_expect(span[0] == 3 && span[1] == 4);
+        h_ringbuff_pop(buffer, n * sizeof(uint32_t));
+
+        cr_expect(h_ringbuff_is_empty(buffer));
+
+        h_ringbuff_free(buffer);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_reserve_commit)
+{
+        const uint32_t nr_elems = 8;
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), nr_elems, 0);
+        h_ringbuff_init(buffer);
+
+        cr_expect(h_ringbuff_acquire(buffer, sizeof(uint32_t)) == NULL);
+
+        /* build records in place, several times around the ring */
+        for (uint32_t k = 0; k < 4 * nr_elems; k++) {
+                uint32_t *slot = h_ringbuff_reserve(buffer, sizeof(uint32_t));
+                cr_assert_not_null(slot);
+                *slot = k;
+                cr_expect(h_ringbuff_is_empty(buffer));
+                h_ringbuff_commit(buffer, sizeof(uint32_t));
+
+                uint32_t *rec = h_ringbuff_acquire(buffer, sizeof(uint32_t));
+                cr_assert_not_null(rec);
+                cr_assert_eq(*rec, k);
+                cr_assert_eq(h_ringbuff_release(buffer, sizeof(uint32_t)),
+                             RINGBUFF_OK);
+        }
+
+        /* 9 slots, write and read pointer are at slot 5 now: a reservation
+         * must not run across the end of the ring */
+        cr_expect(h_ringbuff_reserve(buffer, 5 * sizeof(uint32_t)) == NULL);
+        uint32_t *slot = h_ringbuff_reserve(buffer, 4 * sizeof(uint32_t));
+        cr_assert_not_null(slot);
+        for (uint32_t i = 0; i < 4; i++) {
+                slot[i] = i;
+        }
+        h_ringbuff_commit(buffer, 4 * sizeof(uint32_t));
+
+        /* only 4 more fit, the last slot stays free */
+        slot = h_ringbuff_reserve(buffer, 4 * sizeof(uint32_t));
+        cr_assert_not_null(slot);
+        cr_expect(h_ringbuff_reserve(buffer, 5 * sizeof(uint32_t)) == NULL);
+        h_ringbuff_commit(buffer, 4 * sizeof(uint32_t));
+        cr_expect(h_ringbuff_is_full(buffer));
+        cr_expect(h_ringbuff_reserve(buffer, sizeof(uint32_t)) == NULL);
+
+        uint32_t *rec = h_ringbuff_acquire(buffer, 4 * sizeof(uint32_t));
+        cr_assert_not_null(rec);
+        cr_expect(rec[0] == 0 && rec[3] == 3);
+        cr_expect(h_ringbuff_acquire(buffer, 5 * sizeof(uint32_t)) == NULL);
+        h_ringbuff_release(buffer, 4 * sizeof(uint32_t));
+        cr_expect(h_ringbuff_acquire(buffer, 4 * sizeof(uint32_t)) != NULL);
+
+        h_ringbuff_free(buffer);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_reserve_near_end)
+{
+        const uint32_t nr_elems = 8;
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), nr_elems, 0);
+        h_ringbuff_init(buffer);
+        uint64_t n;
+
+        /* 9 slots, move write and read pointer to slot 6 */
+        for (uint32_t k = 0; k < 6; k++) {
+                h_ringbuff_commit(buffer, sizeof(uint32_t));
+                h_ringbuff_release(buffer, sizeof(uint32_t));
+        }
+        cr_expect(h_ringbuff_is_empty(buffer));
+
+        /* 4 elements do not fit before the end, the 3 that do are granted */
+        cr_expect(h_ringbuff_reserve(buffer, 4 * sizeof(uint32_t)) == NULL);
+        uint32_t *slot = h_ringbuff_reserve_n(buffer, &n);
+        cr_assert_not_null(slot);
+        cr_assert_eq(n, 3);
+        for (uint32_t i = 0; i < n; i++) {
+                slot[i] = i;
+        }
+        h_ringbuff_commit(buffer, n * sizeof(uint32_t));
+
+        /* the next reservation starts at the beginning of the ring, slot 5
+         * stays free to tell a full ring from an empty one */
+        uint32_t *next = h_ringbuff_reserve_n(buffer, &n);
+        cr_assert_not_null(next);
+        cr_expect(n == 5);
+        cr_expect(next < slot);
+        cr_expect(h_ringbuff_reserve(buffer, 4 * sizeof(uint32_t)) == next);
+        for (uint32_t i = 0; i < 4; i++) {
+                next[i] = 3 + i;
+        }
+        h_ringbuff_commit(buffer, 4 * sizeof(uint32_t));
+
+        uint32_t out[7];
+        cr_expect(h_ringbuff_pop_n(buffer, out, 7) == 7);
+        for (uint32_t i = 0; i < 7; i++) {
+                cr_expect(out[i] == i);
+        }
+
+        /* a full ring grants nothing */
+        for (uint32_t k = 0; k < nr_elems; k++) {
+                h_ringbuff_push(buffer, &k, sizeof(k));
+        }
+        cr_expect(h_ringbuff_reserve_n(buffer, &n) == NULL && n == 0);
+
+        h_ringbuff_free(buffer);
+}
+
+
 #define PRODUCER_COUNT 10000000
 
 
@@ -389,3 +590,955 @@ Test(HELPERS_RINGBUFFER, ringbuffer_dynlist_remove)
 
         h_ringbuff_free(buffer);
 }
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_spsc_layout)
+{
+        void *buffer = h_ringbuff_spsc_alloc(4, 10);
+        cr_assert_not_null(buffer);
+        h_ringbuff_spsc_init(buffer);
+
+        h_ringbuff_spsc_t *h = (h_ringbuff_spsc_t *)buffer;
+
+        cr_expect(((uint64_t)buffer & (H_RINGBUFF_CACHE_LINE - 1)) == 0);
+        cr_expect(offsetof(h_ringbuff_spsc_t, w) % H_RINGBUFF_CACHE_LINE == 0);
+        cr_expect(offsetof(h_ringbuff_spsc_t, r) % H_RINGBUFF_CACHE_LINE == 0);
+        cr_expect(offsetof(h_ringbuff_spsc_t, r) -
+                      offsetof(h_ringbuff_spsc_t, w) >=
+                  H_RINGBUFF_CACHE_LINE);
+        /* 10 is rounded up to 16 */
+        cr_expect(h->mask == 15);
+        cr_expect(h_ringbuff_spsc_avail(buffer) == 16);
+
+        h_ringbuff_spsc_free(buffer);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_spsc_checkdata)
+{
+        const uint32_t nr_elems = 16;
+        void *buffer = h_ringbuff_spsc_alloc(sizeof(uint32_t), nr_elems);
+        h_ringbuff_spsc_init(buffer);
+
+        cr_expect(h_ringbuff_spsc_is_empty(buffer));
+        cr_expect(h_ringbuff_spsc_read(buffer) == NULL);
+        cr_expect(h_ringbuff_spsc_pop(buffer) == RINGBUFF_EMPTY);
+
+        /* run several times around the ring */
+        for (uint32_t j = 0; j < 2 * nr_elems; j++) {
+                for (uint32_t i = 0; i < nr_elems; i++) {
+                        uint32_t val = i + nr_elems * j;
+                        cr_assert_eq(h_ringbuff_spsc_push(buffer, &val), 0);
+                }
+
+                cr_expect(h_ringbuff_spsc_is_full(buffer));
+                uint32_t val = 0;
+                cr_expect(h_ringbuff_spsc_push(buffer, &val) == 1);
+
+                for (uint32_t i = 0; i < nr_elems; i++) {
+                        uint32_t *next =
+                            (uint32_t *)h_ringbuff_spsc_read(buffer);
+                        cr_assert_not_null(next, "Next element is null");
+                        cr_assert_eq(*next, i + nr_elems * j);
+                        cr_assert_eq(h_ringbuff_spsc_pop(buffer),
+                                     RINGBUFF_OK);
+                }
+
+                cr_expect(h_ringbuff_spsc_is_empty(buffer));
+        }
+
+        h_ringbuff_spsc_free(buffer);
+}
+
+
+/* Cross-core throughput and latency benchmark of the spsc ringbuffer against
+ * the generic one. Producer and consumer are pinned to different cpus if
+ * there is more than one. */
+
+#define BENCH_COUNT     (1 << 23)
+#define BENCH_RTT_COUNT (1 << 16)
+#define BENCH_RING      1024
+
+
+typedef struct bench_ctx {
+        void *buf;
+        void *back;
+        bool spsc;
+        int cpu;
+        uint64_t sum;
+        uint64_t *rtt;
+} bench_ctx_t;
+
+
+static uint64_t bench_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void bench_pin(int cpu)
+{
+#ifdef __gnu_linux__
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+
+        if (ncpu < 2) {
+                return;
+        }
+        CPU_ZERO(&set);
+        CPU_SET(cpu % ncpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)cpu;
+#endif
+}
+
+
+static void bench_put(bench_ctx_t *ctx, void *buf, uint64_t *val)
+{
+        if (ctx->spsc) {
+                while (h_ringbuff_spsc_push(buf, val)) {
+                        x_thread_yield();
+                }
+        } else {
+                while (h_ringbuff_push(buf, val, sizeof(uint64_t))) {
+                        x_thread_yield();
+                }
+        }
+}
+
+
+static uint64_t bench_get(bench_ctx_t *ctx, void *buf)
+{
+        uint64_t *next;
+        uint64_t val;
+
+        if (ctx->spsc) {
+                while (!(next = h_ringbuff_spsc_read(buf))) {
+                        x_thread_yield();
+                }
+                val = *next;
+                h_ringbuff_spsc_pop(buf);
+        } else {
+                while (!(next = h_ringbuff_read(buf, sizeof(uint64_t)))) {
+                        x_thread_yield();
+                }
+                val = *next;
+                h_ringbuff_pop(buf, sizeof(uint64_t));
+        }
+
+        return val;
+}
+
+
+X_THREAD_FUNC(bench_producer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT; i++) {
+                ctx->sum += i;
+                bench_put(ctx, ctx->buf, &i);
+        }
+        return 0;
+}
+
+
+X_THREAD_FUNC(bench_consumer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT; i++) {
+                ctx->sum += bench_get(ctx, ctx->buf);
+        }
+        return 0;
+}
+
+
+/* echoes every element from buf back into back */
+X_THREAD_FUNC(bench_echo)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_RTT_COUNT; i++) {
+                uint64_t val = bench_get(ctx, ctx->buf);
+                bench_put(ctx, ctx->back, &val);
+        }
+        return 0;
+}
+
+
+static int bench_cmp(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+
+static void *bench_alloc(bool spsc)
+{
+        void *buf;
+
+        if (spsc) {
+                buf = h_ringbuff_spsc_alloc(sizeof(uint64_t), BENCH_RING);
+                h_ringbuff_spsc_init(buf);
+        } else {
+                buf = h_ringbuff_aligned_alloc(64, sizeof(uint64_t),
+                                               BENCH_RING, 0);
+                h_ringbuff_init(buf);
+        }
+
+        return buf;
+}
+
+
+static void bench_release(bool spsc, void *buf)
+{
+        if (spsc) {
+                h_ringbuff_spsc_free(buf);
+        } else {
+                h_ringbuff_aligned_free(buf);
+        }
+}
+
+
+static void bench_run(bool spsc)
+{
+        const char *name = spsc ? "spsc" : "generic";
+
+        /* throughput */
+        bench_ctx_t pctx = {.buf = bench_alloc(spsc), .spsc = spsc, .cpu = 0};
+        bench_ctx_t cctx = pctx;
+        cctx.cpu         = 1;
+
+        uint64_t t0 = bench_ns();
+        x_thread_t cthr = x_thread_create(bench_consumer, &cctx);
+        x_thread_t pthr = x_thread_create(bench_producer, &pctx);
+        x_thread_wait_infinite(pthr);
+        x_thread_wait_infinite(cthr);
+        uint64_t t1 = bench_ns();
+
+        cr_assert_eq(cctx.sum, pctx.sum, "%s: element sum is incorrect", name);
+        bench_release(spsc, pctx.buf);
+
+        /* round trip latency */
+        bench_ctx_t ectx = {.buf  = bench_alloc(spsc),
+                            .back = bench_alloc(spsc),
+                            .spsc = spsc,
+                            .cpu  = 1};
+        uint64_t *rtt    = malloc(BENCH_RTT_COUNT * sizeof(uint64_t));
+        cr_assert_not_null(rtt);
+
+        bench_pin(0);
+        x_thread_t ethr = x_thread_create(bench_echo, &ectx);
+        for (uint64_t i = 0; i < BENCH_RTT_COUNT; i++) {
+                uint64_t s = bench_ns();
+                bench_put(&ectx, ectx.buf, &i);
+                cr_assert_eq(bench_get(&ectx, ectx.back), i);
+                rtt[i] = bench_ns() - s;
+        }
+        x_thread_wait_infinite(ethr);
+        qsort(rtt, BENCH_RTT_COUNT, sizeof(uint64_t), bench_cmp);
+
+        cr_log_info("%-8s %8.2f Mops/s  rtt p50 %6llu ns  p99 %6llu ns", name,
+                    BENCH_COUNT * 1e3 / (double)(t1 - t0),
+                    (unsigned long long)rtt[BENCH_RTT_COUNT / 2],
+                    (unsigned long long)rtt[BENCH_RTT_COUNT * 99 / 100]);
+
+        free(rtt);
+        bench_release(spsc, ectx.buf);
+        bench_release(spsc, ectx.back);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_spsc_bench, .timeout = 120)
+{
+        bench_run(false);
+        bench_run(true);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_mpmc_checkdata)
+{
+        const uint32_t nr_elems = 16;
+        void *buffer = h_ringbuff_mpmc_alloc(sizeof(uint32_t), nr_elems);
+        cr_assert_not_null(buffer);
+        h_ringbuff_mpmc_init(buffer);
+
+        uint32_t val = 0;
+        cr_expect(h_ringbuff_mpmc_is_empty(buffer));
+        cr_expect(h_ringbuff_mpmc_pop(buffer, &val) == RINGBUFF_EMPTY);
+
+        for (uint32_t j = 0; j < 2 * nr_elems; j++) {
+                for (uint32_t i = 0; i < nr_elems; i++) {
+                        val = i + nr_elems * j;
+                        cr_assert_eq(h_ringbuff_mpmc_push(buffer, &val), 0);
+                }
+
+                cr_expect(h_ringbuff_mpmc_count(buffer) == nr_elems);
+                cr_expect(h_ringbuff_mpmc_push(buffer, &val) == 1);
+
+                for (uint32_t i = 0; i < nr_elems; i++) {
+                        cr_assert_eq(h_ringbuff_mpmc_pop(buffer, &val),
+                                     RINGBUFF_OK);
+                        cr_assert_eq(val, i + nr_elems * j);
+                }
+
+                cr_expect(h_ringbuff_mpmc_is_empty(buffer));
+        }
+
+        h_ringbuff_mpmc_free(buffer);
+}
+
+
+/* Contention benchmark: n producers and n consumers on one mpmc ringbuffer,
+ * compared against the generic ringbuffer guarded by an xmutex. */
+
+#define CONT_COUNT       (1 << 20)
+#define CONT_MAX_THREADS 32
+
+
+typedef struct cont_shared {
+        void *buf;
+        bool mpmc;
+        xmutex_t lock;
+        uint64_t per_producer;
+        uint64_t popped;
+        uint64_t total;
+} cont_shared_t;
+
+
+typedef struct cont_ctx {
+        cont_shared_t *sh;
+        uint64_t sum;
+} cont_ctx_t;
+
+
+static bool cont_push(cont_shared_t *sh, uint64_t *val)
+{
+        if (sh->mpmc) {
+                return h_ringbuff_mpmc_push(sh->buf, val) == 0;
+        }
+
+        xmutex_lock(&sh->lock);
+        bool ok = h_ringbuff_push(sh->buf, val, sizeof(uint64_t)) == 0;
+        xmutex_unlock(&sh->lock);
+
+        return ok;
+}
+
+
+static bool cont_pop(cont_shared_t *sh, uint64_t *val)
+{
+        if (sh->mpmc) {
+                return h_ringbuff_mpmc_pop(sh->buf, val) == RINGBUFF_OK;
+        }
+
+        xmutex_lock(&sh->lock);
+        uint64_t *next = h_ringbuff_read(sh->buf, sizeof(uint64_t));
+        if (next) {
+                *val = *next;
+                h_ringbuff_pop(sh->buf, sizeof(uint64_t));
+        }
+        xmutex_unlock(&sh->lock);
+
+        return next != NULL;
+}
+
+
+X_THREAD_FUNC(cont_producer)
+{
+        cont_ctx_t *ctx = (cont_ctx_t *)p;
+
+        for (uint64_t i = 0; i < ctx->sh->per_producer; i++) {
+                ctx->sum += i;
+                while (!cont_push(ctx->sh, &i)) {
+                        x_thread_yield();
+                }
+        }
+        return 0;
+}
+
+
+X_THREAD_FUNC(cont_consumer)
+{
+        cont_ctx_t *ctx = (cont_ctx_t *)p;
+        cont_shared_t *sh = ctx->sh;
+        uint64_t val;
+
+        while (x_atomic_load64(&sh->popped) < sh->total) {
+                if (!cont_pop(sh, &val)) {
+                        x_thread_yield();
+                        continue;
+                }
+                ctx->sum += val;
+                x_atomic_fetch_add64(&sh->popped, 1);
+        }
+        return 0;
+}
+
+
+static void cont_run(bool mpmc, int n)
+{
+        cont_shared_t sh = {.mpmc = mpmc, .per_producer = CONT_COUNT / n};
+        cont_ctx_t prod[CONT_MAX_THREADS] = {0};
+        cont_ctx_t cons[CONT_MAX_THREADS] = {0};
+        x_thread_t pthr[CONT_MAX_THREADS];
+        x_thread_t cthr[CONT_MAX_THREADS];
+
+        sh.total = sh.per_producer * n;
+        xmutex_init(&sh.lock);
+        if (mpmc) {
+                sh.buf = h_ringbuff_mpmc_alloc(sizeof(uint64_t), BENCH_RING);
+                h_ringbuff_mpmc_init(sh.buf);
+        } else {
+                sh.buf = h_ringbuff_aligned_alloc(64, sizeof(uint64_t),
+                                                  BENCH_RING, 0);
+                h_ringbuff_init(sh.buf);
+        }
+
+        uint64_t t0 = bench_ns();
+        for (int i = 0; i < n; i++) {
+                prod[i].sh = cons[i].sh = &sh;
+                cthr[i] = x_thread_create(cont_consumer, &cons[i]);
+                pthr[i] = x_thread_create(cont_producer, &prod[i]);
+        }
+        uint64_t psum = 0, csum = 0;
+        for (int i = 0; i < n; i++) {
+                x_thread_wait_infinite(pthr[i]);
+                x_thread_wait_infinite(cthr[i]);
+                psum += prod[i].sum;
+                csum += cons[i].sum;
+        }
+        uint64_t t1 = bench_ns();
+
+        cr_assert_eq(psum, csum, "element sum is incorrect");
+
+        cr_log_info("%-8s %2d+%-2d threads %8.2f Mops/s",
+                    mpmc ? "mpmc" : "xmutex", n, n,
+                    sh.total * 1e3 / (double)(t1 - t0));
+
+        if (mpmc) {
+                h_ringbuff_mpmc_free(sh.buf);
+        } else {
+                h_ringbuff_aligned_free(sh.buf);
+        }
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_mpmc_bench, .timeout = 300)
+{
+        for (int n = 1; n <= CONT_MAX_THREADS; n *= 2) {
+                cont_run(false, n);
+                cont_run(true, n);
+        }
+}
+
+
+/* batched transfer: one index update per batch on either side */
+
+#define BATCH_SIZE 32
+
+
+X_THREAD_FUNC(batch_producer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        uint64_t vals[BATCH_SIZE];
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT;) {
+                uint64_t n = BATCH_SIZE;
+                if (n > BENCH_COUNT - i) {
+                        n = BENCH_COUNT - i;
+                }
+                for (uint64_t k = 0; k < n; k++) {
+                        vals[k] = i + k;
+                }
+
+                uint64_t done = 0;
+                while (done < n) {
+                        uint64_t pushed =
+                            h_ringbuff_push_n(ctx->buf, vals + done, n - done);
+                        if (!pushed) {
+                                x_thread_yield();
+                        }
+                        done += pushed;
+                }
+                for (uint64_t k = 0; k < n; k++) {
+                        ctx->sum += i + k;
+                }
+                i += n;
+        }
+        return 0;
+}
+
+
+X_THREAD_FUNC(batch_consumer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT;) {
+                uint64_t n;
+                uint64_t *span = h_ringbuff_peek(ctx->buf, &n);
+                if (!span) {
+                        x_thread_yield();
+                        continue;
+                }
+                for (uint64_t k = 0; k < n; k++) {
+                        ctx->sum += span[k];
+                }
+                h_ringbuff_pop(ctx->buf, n * sizeof(uint64_t));
+                i += n;
+        }
+        return 0;
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_batch_bench, .timeout = 120)
+{
+        bench_ctx_t pctx = {.buf = bench_alloc(false), .cpu = 0};
+        bench_ctx_t cctx = pctx;
+        cctx.cpu         = 1;
+
+        uint64_t t0 = bench_ns();
+        x_thread_t cthr = x_thread_create(batch_consumer, &cctx);
+        x_thread_t pthr = x_thread_create(batch_producer, &pctx);
+        x_thread_wait_infinite(pthr);
+        x_thread_wait_infinite(cthr);
+        uint64_t t1 = bench_ns();
+
+        cr_assert_eq(cctx.sum, pctx.sum, "element sum is incorrect");
+        cr_expect(h_ringbuff_is_empty(pctx.buf));
+
+        cr_log_info("batch    %8.2f Mops/s",
+                    BENCH_COUNT * 1e3 / (double)(t1 - t0));
+
+        bench_release(false, pctx.buf);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_var_records)
+{
+        void *buffer = h_ringbuff_var_alloc(256);
+        cr_assert_not_null(buffer);
+        h_ringbuff_var_init(buffer);
+
+        uint8_t data[200];
+        uint32_t len;
+
+        for (uint32_t i = 0; i < sizeof(data); i++) {
+                data[i] = (uint8_t)i;
+        }
+
+        cr_expect(h_ringbuff_var_read(buffer, &len) == NULL);
+        cr_expect(h_ringbuff_var_pop(buffer) == RINGBUFF_EMPTY);
+
+        /* records of 1..100 bytes, so the ring end is hit at various
+         * offsets and needs padding markers */
+        uint32_t wlen = 1, rlen = 1;
+        for (int k = 0; k < 400; k++) {
+                while (h_ringbuff_var_push(buffer, data, wlen) == 0) {
+                        wlen = wlen % 100 + 1;
+                }
+                /* 256 bytes hold at most 32 headers */
+                cr_assert(h_ringbuff_var_used(buffer) <= 256);
+
+                /* with padding, a single big record may fill the ring */
+                for (int i = 0; i < 2; i++) {
+                        uint8_t *rec = h_ringbuff_var_read(buffer, &len);
+                        if (i && !rec) {
+                                break;
+                        }
+                        cr_assert_not_null(rec);
+                        cr_assert_eq(len, rlen);
+                        cr_assert(((uintptr_t)rec & 7) == 0);
+                        cr_assert(memcmp(rec, data, len) == 0);
+                        cr_assert_eq(h_ringbuff_var_pop(buffer), RINGBUFF_OK);
+                        rlen = rlen % 100 + 1;
+                }
+        }
+
+        while (h_ringbuff_var_read(buffer, &len)) {
+                cr_assert_eq(len, rlen);
+                h_ringbuff_var_pop(buffer);
+                rlen = rlen % 100 + 1;
+        }
+        cr_expect(rlen == wlen);
+        cr_expect(h_ringbuff_var_is_empty(buffer));
+
+        /* never fits */
+        cr_expect(h_ringbuff_var_reserve(buffer, 256) == NULL);
+
+        /* reserve the maximum, commit less */
+        uint8_t *p = h_ringbuff_var_reserve(buffer, 120);
+        cr_assert_not_null(p);
+        memcpy(p, "abc", 3);
+        h_ringbuff_var_commit(buffer, 3);
+        p = h_ringbuff_var_read(buffer, &len);
+        cr_assert_not_null(p);
+        cr_expect(len == 3 && memcmp(p, "abc", 3) == 0);
+
+        h_ringbuff_var_free(buffer);
+}
+
+
+X_THREAD_FUNC(var_producer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        uint64_t rec[4] = {0};
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT; i++) {
+                /* 8 to 32 byte records */
+                uint32_t len = 8 * (1 + (i & 3));
+                rec[0]       = i;
+                ctx->sum += i;
+                while (h_ringbuff_var_push(ctx->buf, rec, len)) {
+                        x_thread_yield();
+                }
+        }
+        return 0;
+}
+
+
+X_THREAD_FUNC(var_consumer)
+{
+        bench_ctx_t *ctx = (bench_ctx_t *)p;
+        bench_pin(ctx->cpu);
+
+        for (uint64_t i = 0; i < BENCH_COUNT; i++) {
+                uint64_t *rec;
+                uint32_t len;
+                while (!(rec = h_ringbuff_var_read(ctx->buf, &len))) {
+                        x_thread_yield();
+                }
+                if (len != 8 * (1 + (i & 3))) {
+                        ctx->sum = ~(uint64_t)0;
+                }
+                ctx->sum += rec[0];
+                h_ringbuff_var_pop(ctx->buf);
+        }
+        return 0;
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_var_bench, .timeout = 120)
+{
+        bench_ctx_t pctx = {.buf = h_ringbuff_var_alloc(BENCH_RING * 32),
+                            .cpu = 0};
+        h_ringbuff_var_init(pctx.buf);
+        bench_ctx_t cctx = pctx;
+        cctx.cpu         = 1;
+
+        uint64_t t0 = bench_ns();
+        x_thread_t cthr = x_thread_create(var_consumer, &cctx);
+        x_thread_t pthr = x_thread_create(var_producer, &pctx);
+        x_thread_wait_infinite(pthr);
+        x_thread_wait_infinite(cthr);
+        uint64_t t1 = bench_ns();
+
+        cr_assert_eq(cctx.sum, pctx.sum, "record sum is incorrect");
+
+        cr_log_info("var      %8.2f Mops/s",
+                    BENCH_COUNT * 1e3 / (double)(t1 - t0));
+
+        h_ringbuff_var_free(pctx.buf);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_wait_timeout)
+{
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), 16, 0);
+        h_ringbuff_init(buffer);
+
+        h_ringbuff_wait_t w;
+        cr_assert_eq(h_ringbuff_wait_init(&w, 10, false), 0);
+
+        uint64_t t0 = bench_ns();
+        cr_expect(h_ringbuff_wait_readable(&w, buffer, 20) ==
+                  RINGBUFF_TIMEOUT);
+        cr_expect(bench_ns() - t0 >= 15000000ull);
+        cr_expect(w.waiters == 0);
+
+        /* nobody waits: notify must not touch the futex */
+        h_ringbuff_notify(&w);
+        cr_expect(w.seq == 0);
+
+        uint32_t val = 1;
+        h_ringbuff_push(buffer, &val, sizeof(val));
+        cr_expect(h_ringbuff_wait_readable(&w, buffer, 0) == RINGBUFF_OK);
+
+        h_ringbuff_wait_destroy(&w);
+        h_ringbuff_free(buffer);
+}
+
+
+#define WAIT_COUNT 20000
+
+
+typedef struct wait_ctx {
+        void *buf;
+        h_ringbuff_wait_t *w;
+        uint64_t sum;
+} wait_ctx_t;
+
+
+X_THREAD_FUNC(wait_consumer)
+{
+        wait_ctx_t *ctx = (wait_ctx_t *)p;
+
+        for (uint32_t i = 0; i < WAIT_COUNT; i++) {
+                h_ringbuff_wait_readable(ctx->w, ctx->buf, -1);
+                uint32_t *next = h_ringbuff_read(ctx->buf, sizeof(uint32_t));
+                ctx->sum += *next;
+                h_ringbuff_pop(ctx->buf, sizeof(uint32_t));
+        }
+        return 0;
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_wait_notify)
+{
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), 16, 0);
+        h_ringbuff_init(buffer);
+
+        h_ringbuff_wait_t w;
+        h_ringbuff_wait_init(&w, 100, false);
+
+        wait_ctx_t ctx = {.buf = buffer, .w = &w, .sum = 0};
+        x_thread_t thr = x_thread_create(wait_consumer, &ctx);
+
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < WAIT_COUNT; i++) {
+                while (h_ringbuff_push(buffer, &i, sizeof(uint32_t))) {
+                        x_thread_yield();
+                }
+                h_ringbuff_notify(&w);
+                sum += i;
+                /* let the consumer fall asleep now and then */
+                if (i % 1000 == 0) {
+                        struct timespec ts = {0, 1000000};
+                        nanosleep(&ts, NULL);
+                }
+        }
+
+        x_thread_wait_infinite(thr);
+        cr_assert_eq(ctx.sum, sum);
+        cr_expect(w.waiters == 0);
+
+        h_ringbuff_wait_destroy(&w);
+        h_ringbuff_free(buffer);
+}
+
+
+#ifdef __gnu_linux__
+Test(HELPERS_RINGBUFFER, ringbuffer_wait_eventfd)
+{
+        void *buffer = h_ringbuff_alloc(sizeof(uint32_t), 16, 0);
+        h_ringbuff_init(buffer);
+
+        h_ringbuff_wait_t w;
+        cr_assert_eq(h_ringbuff_wait_init(&w, 0, true), 0);
+
+        struct pollfd pfd = {.fd = h_ringbuff_wait_fd(&w), .events = POLLIN};
+        cr_assert(pfd.fd >= 0);
+
+        /* no waiter registered, no event */
+        uint32_t val = 7;
+        h_ringbuff_push(buffer, &val, sizeof(val));
+        h_ringbuff_notify(&w);
+        cr_expect(poll(&pfd, 1, 0) == 0);
+        h_ringbuff_pop(buffer, sizeof(val));
+
+        h_ringbuff_wait_prepare(&w);
+        cr_expect(h_ringbuff_is_empty(buffer));
+        h_ringbuff_push(buffer, &val, sizeof(val));
+        h_ringbuff_notify(&w);
+        cr_expect(poll(&pfd, 1, 100) == 1);
+        h_ringbuff_wait_finish(&w);
+        cr_expect(poll(&pfd, 1, 0) == 0);
+        cr_expect(!h_ringbuff_is_empty(buffer));
+
+        h_ringbuff_wait_destroy(&w);
+        h_ringbuff_free(buffer);
+}
+#endif
+
+
+#ifdef __gnu_linux__
+Test(HELPERS_RINGBUFFER, ringbuffer_vm_mirror)
+{
+        void *buffer = h_ringbuff_vm_alloc(1);
+        cr_assert_not_null(buffer);
+        h_ringbuff_vm_init(buffer);
+
+        uint64_t size = h_ringbuff_vm_size(buffer);
+        cr_expect(size == (uint64_t)sysconf(_SC_PAGESIZE));
+        cr_expect(h_ringbuff_vm_writable(buffer) == size);
+
+        /* the byte after the ring is the first byte of the ring */
+        char *data = (char *)buffer + ((h_ringbuff_vm_t *)buffer)->header_size;
+        data[0]    = 'x';
+        cr_expect(data[size] == 'x');
+
+        /* records of 100 bytes hit the ring end at various offsets and
+         * are still read and written as one span */
+        char rec[100], out[100];
+        for (int k = 0; k < 1000; k++) {
+                memset(rec, k, sizeof(rec));
+                cr_assert_eq(h_ringbuff_vm_push(buffer, rec, sizeof(rec)), 0);
+                cr_assert_eq(h_ringbuff_vm_pop(buffer, out, sizeof(out)),
+                             RINGBUFF_OK);
+                cr_assert(memcmp(rec, out, sizeof(rec)) == 0);
+        }
+
+        cr_expect(h_ringbuff_vm_reserve(buffer, size + 1) == NULL);
+        cr_expect(h_ringbuff_vm_acquire(buffer, 1) == NULL);
+        cr_expect(h_ringbuff_vm_pop(buffer, out, 1) == RINGBUFF_EMPTY);
+        cr_expect(h_ringbuff_vm_reserve(buffer, 0) == NULL);
+        cr_expect(h_ringbuff_vm_acquire(buffer, 0) == NULL);
+        cr_expect(h_ringbuff_vm_push(buffer, rec, 0) == 1);
+
+        /* fill completely, then hand the whole content to write() */
+        char *w = h_ringbuff_vm_reserve(buffer, size);
+        cr_assert_not_null(w);
+        for (uint64_t i = 0; i < size; i++) {
+                w[i] = (char)(i * 7);
+        }
+        h_ringbuff_vm_commit(buffer, size);
+        cr_expect(h_ringbuff_vm_writable(buffer) == 0);
+
+        int fds[2];
+        cr_assert(pipe(fds) == 0);
+        char *r = h_ringbuff_vm_acquire(buffer, size);
+        cr_assert_not_null(r);
+        cr_assert(write(fds[1], r, size) == (ssize_t)size);
+        h_ringbuff_vm_release(buffer, size);
+
+        char *back = malloc(size);
+        cr_assert(read(fds[0], back, size) == (ssize_t)size);
+        for (uint64_t i = 0; i < size; i++) {
+                cr_assert_eq(back[i], (char)(i * 7));
+        }
+        free(back);
+        close(fds[0]);
+        close(fds[1]);
+
+        h_ringbuff_vm_free(buffer);
+}
+#endif
+
+
+#ifdef __gnu_linux__
+#        define SHM_COUNT 100000
+
+
+static bool shm_not_empty(void *buffer)
+{
+        return !h_ringbuff_mpmc_is_empty(buffer);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_shm_mpsc)
+{
+        const char *name = "/h_ringbuff_test";
+        const int nprod  = 2;
+
+        h_ringbuff_shm_unlink(name);
+        void *buffer =
+            h_ringbuff_shm_create(name, H_RINGBUFF_SHM_MPMC, sizeof(uint64_t),
+                                  256);
+        cr_assert_not_null(buffer);
+        cr_expect(h_ringbuff_shm_create(name, H_RINGBUFF_SHM_MPMC, 8, 8) ==
+                  NULL);
+        cr_expect(h_ringbuff_shm_attach(name, H_RINGBUFF_SHM_SPSC) == NULL);
+
+        for (int k = 0; k < nprod; k++) {
+                if (fork() == 0) {
+                        /* producer process, maps the ring by name */
+                        void *ring =
+                            h_ringbuff_shm_attach(name, H_RINGBUFF_SHM_MPMC);
+                        if (!ring) {
+                                _exit(1);
+                        }
+                        h_ringbuff_wait_t *w = h_ringbuff_shm_wait(ring);
+                        for (uint64_t i = 1; i <= SHM_COUNT; i++) {
+                                while (h_ringbuff_mpmc_push(ring, &i)) {
+                                        x_thread_yield();
+                                }
+                                h_ringbuff_notify(w);
+                        }
+                        h_ringbuff_shm_detach(ring);
+                        _exit(0);
+                }
+        }
+
+        h_ringbuff_wait_t *w = h_ringbuff_shm_wait(buffer);
+        uint64_t sum = 0, val;
+        for (uint64_t i = 0; i < nprod * SHM_COUNT; i++) {
+                while (h_ringbuff_mpmc_pop(buffer, &val) != RINGBUFF_OK) {
+                        cr_assert_eq(h_ringbuff_wait(w, shm_not_empty, buffer,
+                                                     5000),
+                                     RINGBUFF_OK);
+                }
+                sum += val;
+        }
+
+        for (int k = 0; k < nprod; k++) {
+                int status;
+                wait(&status);
+                cr_expect(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        cr_expect(sum == nprod * (uint64_t)SHM_COUNT * (SHM_COUNT + 1) / 2);
+
+        h_ringbuff_shm_detach(buffer);
+        cr_expect(h_ringbuff_shm_unlink(name) == 0);
+}
+
+
+Test(HELPERS_RINGBUFFER, ringbuffer_shm_memfd)
+{
+        int fd;
+        void *buffer = h_ringbuff_shm_create_fd(&fd, H_RINGBUFF_SHM_FIXED,
+                                                sizeof(uint32_t), 64);
+        cr_assert_not_null(buffer);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+                /* map the inherited descriptor at another address */
+                void *ring = h_ringbuff_shm_attach_fd(fd, H_RINGBUFF_SHM_FIXED);
+                if (!ring) {
+                        _exit(1);
+                }
+                for (uint32_t i = 0; i < SHM_COUNT; i++) {
+                        while (h_ringbuff_push(ring, &i, sizeof(i))) {
+                                x_thread_yield();
+                        }
+                }
+                _exit(0);
+        }
+
+        for (uint32_t i = 0; i < SHM_COUNT; i++) {
+                uint32_t *next;
+                while (!(next = h_ringbuff_read(buffer, sizeof(uint32_t)))) {
+                        x_thread_yield();
+                }
+                cr_assert_eq(*next, i);
+                h_ringbuff_pop(buffer, sizeof(uint32_t));
+        }
+
+        int status;
+        waitpid(pid, &status, 0);
+        cr_expect(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        h_ringbuff_shm_detach(buffer);
+        close(fd);
+}
+#endif
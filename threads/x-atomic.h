@@ -13,6 +13,39 @@
 #        define x_atomic_clear64(A)        (void)InterlockedExchange64(A, 0)
 #        define x_atomic_fetch_add64(A, B) InterlockedExchangeAdd64(A, B)
 #        define x_atomic_fetch_sub64(A, B) InterlockedExchangeAdd64(A, -B)
+#        define x_atomic_cas64(A, E, D)    x_atomic_cas64_msvc(A, E, D)
+#        define x_atomic_xchg64(A, B)      InterlockedExchange64(A, B)
+#        define x_atomic_fetch_or64(A, B)  InterlockedOr64(A, B)
+#        define x_atomic_fetch_and64(A, B) InterlockedAnd64(A, B)
+#        define x_atomic_store32(A, B)     (void)InterlockedExchange(A, B)
+#        define x_atomic_load32(A)         InterlockedCompareExchange(A, 0, 0)
+#        define x_atomic_fetch_add32(A, B) InterlockedExchangeAdd(A, B)
+#        define x_atomic_xchg32(A, B)      InterlockedExchange(A, B)
+#        define x_atomic_cas32(A, E, D)    x_atomic_cas32_msvc(A, E, D)
+#        define x_atomic_fence()           MemoryBarrier()
+#        define x_cpu_relax()              YieldProcessor()
+
+/* like the GCC builtin: on failure *E receives the current value */
+static __inline int x_atomic_cas64_msvc(volatile LONG64 *a, LONG64 *e,
+                                        LONG64 d)
+{
+        LONG64 old = InterlockedCompareExchange64(a, d, *e);
+        if (old == *e) {
+                return 1;
+        }
+        *e = old;
+        return 0;
+}
+
+static __inline int x_atomic_cas32_msvc(volatile LONG *a, LONG *e, LONG d)
+{
+        LONG old = InterlockedCompareExchange(a, d, *e);
+        if (old == *e) {
+                return 1;
+        }
+        *e = old;
+        return 0;
+}
 #elif defined(__GNUC__)
 #        ifdef __clang__
 #                error("Compiler not supported")
@@ -27,6 +60,30 @@
                 __atomic_fetch_add(A, B, __ATOMIC_ACQ_REL)
 #        define x_atomic_fetch_sub64(A, B) \
                 __atomic_fetch_sub(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_cas64(A, E, D)                                     \
+                __atomic_compare_exchange_n(A, E, D, 0, __ATOMIC_ACQ_REL,   \
+                                            __ATOMIC_ACQUIRE)
+#        define x_atomic_xchg64(A, B) __atomic_exchange_n(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_fetch_or64(A, B) \
+                __atomic_fetch_or(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_fetch_and64(A, B) \
+                __atomic_fetch_and(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_store32(A, B) __atomic_store_n(A, B, __ATOMIC_RELEASE)
+#        define x_atomic_load32(A)     __atomic_load_n(A, __ATOMIC_ACQUIRE)
+#        define x_atomic_fetch_add32(A, B) \
+                __atomic_fetch_add(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_xchg32(A, B) __atomic_exchange_n(A, B, __ATOMIC_ACQ_REL)
+#        define x_atomic_cas32(A, E, D)                                     \
+                __atomic_compare_exchange_n(A, E, D, 0, __ATOMIC_ACQ_REL,   \
+                                            __ATOMIC_ACQUIRE)
+#        define x_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#        if defined(__x86_64__) || defined(__i386__)
+#                define x_cpu_relax() __builtin_ia32_pause()
+#        elif defined(__aarch64__) || defined(__arm__)
+#                define x_cpu_relax() __asm__ __volatile__("yield")
+#        else
+#                define x_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#        endif
 #else
 #        error("Compiler not supported")
 #endif
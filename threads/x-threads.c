@@ -1,5 +1,15 @@
+#if defined(__gnu_linux__) && !defined(_GNU_SOURCE) && \
+    !defined(_POSIX_C_SOURCE)
+#        define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "x-threads.h"
 
+#ifdef __gnu_linux__
+#        include <errno.h>
+#        include <time.h>
+#endif
+
 
 #ifdef X_THREADS_TIRTOS
 static x_thread_t thread_create_tirtos(x_thread_func_t fxn,
@@ -92,3 +102,21 @@ void x_thread_kill(x_thread_t t)
         pthread_cancel(t);
 #endif
 }
+
+
+void x_thread_sleep_ms(unsigned int ms)
+{
+#if defined(X_THREADS_TIRTOS)
+        /* assumes the default 1 ms clock tick */
+        Task_sleep(ms);
+#elif defined(_WIN32)
+        Sleep(ms);
+#elif defined(__gnu_linux__)
+        struct timespec ts;
+
+        ts.tv_sec  = ms / 1000;
+        ts.tv_nsec = (long)(ms % 1000) * 1000000;
+        while (nanosleep(&ts, &ts) && errno == EINTR) {
+        }
+#endif
+}
@@ -65,6 +65,8 @@ x_thread_t x_thread_create(x_thread_func_t fxn, x_thread_params_t *p);
 void x_thread_wait_infinite(x_thread_t t);
 void x_thread_yield(void);
 void x_thread_kill(x_thread_t t);
+/* suspends the calling thread for at least ms milliseconds */
+void x_thread_sleep_ms(unsigned int ms);
 #endif
 
 